@@ -0,0 +1,349 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Attitude and heading reference: orientation from gyroscope,
+ * accelerometer and magnetometer samples
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_AHRS_H
+#define MRU_AHRS_H
+
+#include <cmath>
+
+#include "types.h"
+#include "stream.h"
+
+namespace mru {
+
+/*
+ * Conventions
+ *
+ * The earth frame is north, east, down. Sensor axes are forward, starboard,
+ * down. Accelerometers measure specific force: at rest they point up, so the
+ * measured direction of down is minus the acceleration. The filter state is
+ * the quaternion that rotates sensor frame vectors into the earth frame, so
+ * heading, pitch and roll of UnitQuaternion apply directly.
+ */
+
+/// Quaternion of the rotation from sensor to earth frame given the earth
+/// down and north directions observed in the sensor frame
+template<typename FT=DefaultFT>
+UnitQuaternion<FT> align_quaternion(const Vector<FT>& acceleration, const Vector<FT>& magnetic_flux)
+{
+  Vector<FT> down = -acceleration / std::sqrt(acceleration.squared_length());
+  Vector<FT> east = CGAL::cross_product(down, magnetic_flux);
+  east = east / std::sqrt(east.squared_length());
+  Vector<FT> north = CGAL::cross_product(east, down);
+  // Rows of the rotation matrix are north, east and down
+  FT m00 = north.x(), m01 = north.y(), m02 = north.z();
+  FT m10 = east.x(), m11 = east.y(), m12 = east.z();
+  FT m20 = down.x(), m21 = down.y(), m22 = down.z();
+  FT trace = m00 + m11 + m22;
+  if (trace > 0) {
+    FT s = 2 * std::sqrt(1 + trace);
+    return UnitQuaternion<FT>(s / 4, (m21 - m12) / s, (m02 - m20) / s, (m10 - m01) / s);
+  }
+  else if (m00 > m11 && m00 > m22) {
+    FT s = 2 * std::sqrt(1 + m00 - m11 - m22);
+    return UnitQuaternion<FT>((m21 - m12) / s, s / 4, (m01 + m10) / s, (m02 + m20) / s);
+  }
+  else if (m11 > m22) {
+    FT s = 2 * std::sqrt(1 + m11 - m00 - m22);
+    return UnitQuaternion<FT>((m02 - m20) / s, (m01 + m10) / s, s / 4, (m12 + m21) / s);
+  }
+  else {
+    FT s = 2 * std::sqrt(1 + m22 - m00 - m11);
+    return UnitQuaternion<FT>((m10 - m01) / s, (m02 + m20) / s, (m12 + m21) / s, s / 4);
+  }
+}
+
+/**
+ * Madgwick's gradient descent orientation filter
+ *
+ * Gyroscope integration corrected by one normalized gradient descent step
+ * towards the orientation that matches the observed gravity and magnetic
+ * field directions. beta is the correction gain in rad/s.
+ */
+template<typename FT=DefaultFT>
+struct Madgwick {
+  Madgwick(const FT beta=0.1): beta_(beta), q0_(1), q1_(0), q2_(0), q3_(0) {}
+  FT beta() const { return beta_; }
+  void set_beta(const FT beta) { beta_ = beta; }
+  UnitQuaternion<FT> rotation() const { return UnitQuaternion<FT>(q0_, q1_, q2_, q3_); }
+  void set_rotation(const UnitQuaternion<FT>& q) {
+    q0_ = q.qr();
+    q1_ = q.qi();
+    q2_ = q.qj();
+    q3_ = q.qk();
+  }
+  /// Update with gyroscope and accelerometer only
+  void update(const Vec3<FT>& angular_velocity, const Vec3<FT>& acceleration, const FT dt) {
+    FT gx = angular_velocity.x(), gy = angular_velocity.y(), gz = angular_velocity.z();
+    FT qd0 = (-q1_ * gx - q2_ * gy - q3_ * gz) / 2;
+    FT qd1 = (q0_ * gx + q2_ * gz - q3_ * gy) / 2;
+    FT qd2 = (q0_ * gy - q1_ * gz + q3_ * gx) / 2;
+    FT qd3 = (q0_ * gz + q1_ * gy - q2_ * gx) / 2;
+
+    FT an = acceleration.squared_length();
+    if (an > 0) {
+      an = -1 / std::sqrt(an);
+      FT ax = acceleration.x() * an, ay = acceleration.y() * an, az = acceleration.z() * an;
+      FT q0q0 = q0_ * q0_, q1q1 = q1_ * q1_, q2q2 = q2_ * q2_, q3q3 = q3_ * q3_;
+      FT s0 = 4 * q0_ * q2q2 + 2 * q2_ * ax + 4 * q0_ * q1q1 - 2 * q1_ * ay;
+      FT s1 = 4 * q1_ * q3q3 - 2 * q3_ * ax + 4 * q0q0 * q1_ - 2 * q0_ * ay - 4 * q1_ +
+              8 * q1_ * q1q1 + 8 * q1_ * q2q2 + 4 * q1_ * az;
+      FT s2 = 4 * q0q0 * q2_ + 2 * q0_ * ax + 4 * q2_ * q3q3 - 2 * q3_ * ay - 4 * q2_ +
+              8 * q2_ * q1q1 + 8 * q2_ * q2q2 + 4 * q2_ * az;
+      FT s3 = 4 * q1q1 * q3_ - 2 * q1_ * ax + 4 * q2q2 * q3_ - 2 * q2_ * ay;
+      correct_(qd0, qd1, qd2, qd3, s0, s1, s2, s3);
+    }
+    integrate_(qd0, qd1, qd2, qd3, dt);
+  }
+  /// Update with gyroscope, accelerometer and magnetometer
+  void update(const Vec3<FT>& angular_velocity, const Vec3<FT>& acceleration,
+              const Vec3<FT>& magnetic_flux, const FT dt) {
+    FT an = acceleration.squared_length();
+    FT mn = magnetic_flux.squared_length();
+    if (mn <= 0 || an <= 0) {
+      update(angular_velocity, acceleration, dt);
+      return;
+    }
+    FT gx = angular_velocity.x(), gy = angular_velocity.y(), gz = angular_velocity.z();
+    FT qd0 = (-q1_ * gx - q2_ * gy - q3_ * gz) / 2;
+    FT qd1 = (q0_ * gx + q2_ * gz - q3_ * gy) / 2;
+    FT qd2 = (q0_ * gy - q1_ * gz + q3_ * gx) / 2;
+    FT qd3 = (q0_ * gz + q1_ * gy - q2_ * gx) / 2;
+
+    an = -1 / std::sqrt(an);
+    FT ax = acceleration.x() * an, ay = acceleration.y() * an, az = acceleration.z() * an;
+    mn = 1 / std::sqrt(mn);
+    FT mx = magnetic_flux.x() * mn, my = magnetic_flux.y() * mn, mz = magnetic_flux.z() * mn;
+
+    FT q0q1 = q0_ * q1_, q0q2 = q0_ * q2_, q0q3 = q0_ * q3_;
+    FT q1q1 = q1_ * q1_, q1q2 = q1_ * q2_, q1q3 = q1_ * q3_;
+    FT q2q2 = q2_ * q2_, q2q3 = q2_ * q3_, q3q3 = q3_ * q3_;
+
+    // Reference direction of the magnetic field: horizontal north and down
+    FT hx = 2 * (mx * (FT(0.5) - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+    FT hy = 2 * (mx * (q1q2 + q0q3) + my * (FT(0.5) - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+    FT bx = std::sqrt(hx * hx + hy * hy);
+    FT bz = 2 * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (FT(0.5) - q1q1 - q2q2));
+
+    // Objective function: estimated minus measured directions
+    FT fg0 = 2 * (q1q3 - q0q2) - ax;
+    FT fg1 = 2 * (q0q1 + q2q3) - ay;
+    FT fg2 = 2 * (FT(0.5) - q1q1 - q2q2) - az;
+    FT fb0 = 2 * bx * (FT(0.5) - q2q2 - q3q3) + 2 * bz * (q1q3 - q0q2) - mx;
+    FT fb1 = 2 * bx * (q1q2 - q0q3) + 2 * bz * (q0q1 + q2q3) - my;
+    FT fb2 = 2 * bx * (q0q2 + q1q3) + 2 * bz * (FT(0.5) - q1q1 - q2q2) - mz;
+
+    // Gradient: transposed jacobian times objective
+    FT s0 = -2 * q2_ * fg0 + 2 * q1_ * fg1
+            - 2 * bz * q2_ * fb0 + 2 * (-bx * q3_ + bz * q1_) * fb1 + 2 * bx * q2_ * fb2;
+    FT s1 = 2 * q3_ * fg0 + 2 * q0_ * fg1 - 4 * q1_ * fg2
+            + 2 * bz * q3_ * fb0 + 2 * (bx * q2_ + bz * q0_) * fb1 + 2 * (bx * q3_ - 2 * bz * q1_) * fb2;
+    FT s2 = -2 * q0_ * fg0 + 2 * q3_ * fg1 - 4 * q2_ * fg2
+            + 2 * (-2 * bx * q2_ - bz * q0_) * fb0 + 2 * (bx * q1_ + bz * q3_) * fb1
+            + 2 * (bx * q0_ - 2 * bz * q2_) * fb2;
+    FT s3 = 2 * q1_ * fg0 + 2 * q2_ * fg1
+            + 2 * (-2 * bx * q3_ + bz * q1_) * fb0 + 2 * (-bx * q0_ + bz * q2_) * fb1 + 2 * bx * q1_ * fb2;
+    correct_(qd0, qd1, qd2, qd3, s0, s1, s2, s3);
+    integrate_(qd0, qd1, qd2, qd3, dt);
+  }
+private:
+  FT beta_;
+  FT q0_, q1_, q2_, q3_;
+  void correct_(FT& qd0, FT& qd1, FT& qd2, FT& qd3, FT s0, FT s1, FT s2, FT s3) {
+    FT sn = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+    if (sn > 0) {
+      sn = beta_ / std::sqrt(sn);
+      qd0 -= s0 * sn;
+      qd1 -= s1 * sn;
+      qd2 -= s2 * sn;
+      qd3 -= s3 * sn;
+    }
+  }
+  void integrate_(FT qd0, FT qd1, FT qd2, FT qd3, const FT dt) {
+    q0_ += qd0 * dt;
+    q1_ += qd1 * dt;
+    q2_ += qd2 * dt;
+    q3_ += qd3 * dt;
+    FT qn = 1 / std::sqrt(q0_ * q0_ + q1_ * q1_ + q2_ * q2_ + q3_ * q3_);
+    q0_ *= qn;
+    q1_ *= qn;
+    q2_ *= qn;
+    q3_ *= qn;
+  }
+};
+
+/**
+ * Mahony's nonlinear complementary filter
+ *
+ * Gyroscope rates are corrected by the cross product of the observed and
+ * estimated gravity and magnetic field directions: proportional gain kp and
+ * integral gain ki, the latter estimating gyroscope bias.
+ */
+template<typename FT=DefaultFT>
+struct Mahony {
+  Mahony(const FT kp=1, const FT ki=0): kp_(kp), ki_(ki),
+      q0_(1), q1_(0), q2_(0), q3_(0), bx_(0), by_(0), bz_(0) {}
+  FT kp() const { return kp_; }
+  FT ki() const { return ki_; }
+  void set_gains(const FT kp, const FT ki) {
+    kp_ = kp;
+    ki_ = ki;
+  }
+  UnitQuaternion<FT> rotation() const { return UnitQuaternion<FT>(q0_, q1_, q2_, q3_); }
+  void set_rotation(const UnitQuaternion<FT>& q) {
+    q0_ = q.qr();
+    q1_ = q.qi();
+    q2_ = q.qj();
+    q3_ = q.qk();
+  }
+  /// Integral feedback: minus the estimated gyroscope bias
+  Vector<FT> integral() const { return Vector<FT>(bx_, by_, bz_); }
+  void update(const Vec3<FT>& angular_velocity, const Vec3<FT>& acceleration, const FT dt) {
+    update(angular_velocity, acceleration, Vec3<FT>(), dt);
+  }
+  void update(const Vec3<FT>& angular_velocity, const Vec3<FT>& acceleration,
+              const Vec3<FT>& magnetic_flux, const FT dt) {
+    FT gx = angular_velocity.x(), gy = angular_velocity.y(), gz = angular_velocity.z();
+    FT an = acceleration.squared_length();
+    if (an > 0) {
+      an = -1 / std::sqrt(an);
+      FT ax = acceleration.x() * an, ay = acceleration.y() * an, az = acceleration.z() * an;
+      FT q0q1 = q0_ * q1_, q0q2 = q0_ * q2_, q0q3 = q0_ * q3_;
+      FT q1q1 = q1_ * q1_, q1q2 = q1_ * q2_, q1q3 = q1_ * q3_;
+      FT q2q2 = q2_ * q2_, q2q3 = q2_ * q3_, q3q3 = q3_ * q3_;
+      // Estimated direction of down
+      FT vx = 2 * (q1q3 - q0q2);
+      FT vy = 2 * (q0q1 + q2q3);
+      FT vz = 2 * (FT(0.5) - q1q1 - q2q2);
+      FT ex = ay * vz - az * vy;
+      FT ey = az * vx - ax * vz;
+      FT ez = ax * vy - ay * vx;
+      FT mn = magnetic_flux.squared_length();
+      if (mn > 0) {
+        mn = 1 / std::sqrt(mn);
+        FT mx = magnetic_flux.x() * mn, my = magnetic_flux.y() * mn, mz = magnetic_flux.z() * mn;
+        FT hx = 2 * (mx * (FT(0.5) - q2q2 - q3q3) + my * (q1q2 - q0q3) + mz * (q1q3 + q0q2));
+        FT hy = 2 * (mx * (q1q2 + q0q3) + my * (FT(0.5) - q1q1 - q3q3) + mz * (q2q3 - q0q1));
+        FT bx = std::sqrt(hx * hx + hy * hy);
+        FT bz = 2 * (mx * (q1q3 - q0q2) + my * (q2q3 + q0q1) + mz * (FT(0.5) - q1q1 - q2q2));
+        // Estimated direction of the magnetic field
+        FT wx = 2 * (bx * (FT(0.5) - q2q2 - q3q3) + bz * (q1q3 - q0q2));
+        FT wy = 2 * (bx * (q1q2 - q0q3) + bz * (q0q1 + q2q3));
+        FT wz = 2 * (bx * (q0q2 + q1q3) + bz * (FT(0.5) - q1q1 - q2q2));
+        ex += my * wz - mz * wy;
+        ey += mz * wx - mx * wz;
+        ez += mx * wy - my * wx;
+      }
+      if (ki_ > 0) {
+        bx_ += ki_ * ex * dt;
+        by_ += ki_ * ey * dt;
+        bz_ += ki_ * ez * dt;
+      }
+      else {
+        bx_ = by_ = bz_ = 0;
+      }
+      gx += kp_ * ex + bx_;
+      gy += kp_ * ey + by_;
+      gz += kp_ * ez + bz_;
+    }
+    FT h = dt / 2;
+    FT q0 = q0_, q1 = q1_, q2 = q2_;
+    q0_ += (-q1 * gx - q2 * gy - q3_ * gz) * h;
+    q1_ += (q0 * gx + q2 * gz - q3_ * gy) * h;
+    q2_ += (q0 * gy - q1 * gz + q3_ * gx) * h;
+    q3_ += (q0 * gz + q1 * gy - q2 * gx) * h;
+    FT qn = 1 / std::sqrt(q0_ * q0_ + q1_ * q1_ + q2_ * q2_ + q3_ * q3_);
+    q0_ *= qn;
+    q1_ *= qn;
+    q2_ *= qn;
+    q3_ *= qn;
+  }
+private:
+  FT kp_;
+  FT ki_;
+  FT q0_, q1_, q2_, q3_;
+  FT bx_, by_, bz_;
+};
+
+/**
+ * Orientation from chip samples
+ *
+ * Acceleration and magnetic flux samples are held until the next gyroscope
+ * sample. Every gyroscope sample advances the filter by the time since the
+ * previous one and publishes a fused sample. The first update with both
+ * acceleration and magnetic flux available aligns the filter directly
+ * instead of letting it converge from the identity.
+ */
+template<class Filter, typename FT=DefaultFT>
+struct AHRS: public Sample_stream<FT, Rotation, Heading, Pitch, Roll> {
+  typedef Sample_stream<FT, Rotation, Heading, Pitch, Roll> Stream_type;
+  /// Gaps between gyroscope samples longer than this are not integrated
+  static constexpr double max_interval = 1.0;
+  AHRS(const Filter& filter=Filter()): filter_(filter),
+      acceleration_(0, 0, 0), magnetic_flux_(0, 0, 0),
+      time_(), aligned_(false), has_magnetic_flux_(false) {}
+  Filter& filter() { return filter_; }
+  template <Quantity... Qs>
+  void add_acceleration(const Sample<FT, Qs...>& sample) {
+    acceleration_ = get<FT, Acceleration>(sample);
+  }
+  template <Quantity... Qs>
+  void add_magnetic_flux(const Sample<FT, Qs...>& sample) {
+    magnetic_flux_ = get<FT, MagneticFlux>(sample);
+    has_magnetic_flux_ = true;
+  }
+  template <Quantity... Qs>
+  void add_angular_velocity(const Sample<FT, Qs...>& sample) {
+    update(sample.time, get<FT, AngularVelocity>(sample));
+  }
+  void update(const Time& time, const Vec3<FT>& angular_velocity) {
+    if (!aligned_ && has_magnetic_flux_ && acceleration_.squared_length() > 0) {
+      filter_.set_rotation(align_quaternion<FT>(acceleration_, magnetic_flux_));
+      aligned_ = true;
+    }
+    if (time_.valid()) {
+      FT dt = FT(to_seconds(time - time_));
+      if (dt > 0 && dt < max_interval) {
+        if (has_magnetic_flux_)
+          filter_.update(angular_velocity, acceleration_, magnetic_flux_, dt);
+        else
+          filter_.update(angular_velocity, acceleration_, dt);
+        UnitQuaternion<FT> rotation = filter_.rotation();
+        this->push_sample(typename Stream_type::Sample_type(
+            time, rotation, rotation.heading(), rotation.pitch(), rotation.roll()));
+      }
+    }
+    time_ = time;
+  }
+private:
+  Filter filter_;
+  Vec3<FT> acceleration_;
+  Vec3<FT> magnetic_flux_;
+  Time time_;
+  bool aligned_;
+  bool has_magnetic_flux_;
+};
+
+typedef AHRS<Madgwick<> > Madgwick_AHRS;
+typedef AHRS<Mahony<> > Mahony_AHRS;
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
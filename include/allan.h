@@ -0,0 +1,159 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Streaming Allan variance for sensor noise characterization
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_ALLAN_H
+#define MRU_ALLAN_H
+
+#include <cmath>
+#include <vector>
+#include <array>
+
+#include "types.h"
+
+namespace mru {
+
+template<typename FT=DefaultFT>
+struct Allan_point {
+  /// Cluster time in s
+  FT tau;
+  FT variance;
+  /// Number of cluster differences averaged
+  size_t count;
+  FT deviation() const { return std::sqrt(variance); }
+};
+
+/**
+ * Online Allan variance at octave spaced cluster times
+ *
+ * Samples are summed into a pyramid of clusters: two clusters of 2^k
+ * samples make one of 2^(k+1). Each level remembers only its last four
+ * cluster sums. Whenever a cluster completes, the difference between the
+ * averages of the last two and the two before gives one term of the Allan
+ * variance at twice the cluster size, so clusters overlap by half. Level
+ * zero also gives the variance at one sample from consecutive samples.
+ *
+ * Per sample the work is amortized constant, at most one step per level,
+ * and memory is fixed by the number of levels, so this can run alongside
+ * acquisition for hours. Sums are kept in double precision.
+ */
+template<typename FT=DefaultFT, int Channels=3>
+struct Allan {
+  Allan(const FT sample_period, const int levels=24):
+      sample_period_(sample_period), levels_(checked_levels_(levels)), samples_(0),
+      pending_(levels_), count_(levels_, 0), sums_(levels_),
+      squares_(levels_ + 1), terms_(levels_ + 1, 0) {}
+  FT sample_period() const { return sample_period_; }
+  size_t samples() const { return samples_; }
+  void add(const FT* values) {
+    Sums cluster;
+    for (int c = 0; c < Channels; ++c)
+      cluster[c] = values[c];
+    ++samples_;
+    add_cluster_(0, cluster);
+  }
+  template <int C = Channels>
+  typename std::enable_if<C == 3>::type add(const Vec3<FT>& vector) {
+    FT values[3] = { vector.x(), vector.y(), vector.z() };
+    add(values);
+  }
+  template <int C = Channels>
+  typename std::enable_if<C == 1>::type add(const Scalar<FT> value) {
+    add(&value);
+  }
+  /// Allan variance of a channel for every cluster time with data
+  std::vector<Allan_point<FT> > curve(const int channel) const {
+    std::vector<Allan_point<FT> > result;
+    for (int l = 0; l <= levels_; ++l) {
+      if (terms_[l] == 0)
+        continue;
+      Allan_point<FT> point;
+      point.tau = sample_period_ * std::ldexp(1.0, l);
+      point.variance = squares_[l][channel] / (2 * terms_[l]);
+      point.count = terms_[l];
+      result.push_back(point);
+    }
+    return result;
+  }
+private:
+  struct Sums {
+    Sums() { for (auto& v: values) v = 0; }
+    double& operator[](const int c) { return values[c]; }
+    const double& operator[](const int c) const { return values[c]; }
+    double values[Channels];
+  };
+  struct Pending {
+    Pending(): valid(false), sums() {}
+    bool valid;
+    Sums sums;
+  };
+  FT sample_period_;
+  int levels_;
+  size_t samples_;
+  std::vector<Pending> pending_;
+  std::vector<size_t> count_;
+  /// Last four cluster sums per level, oldest first
+  std::vector<std::array<Sums, 4> > sums_;
+  std::vector<Sums> squares_;
+  std::vector<size_t> terms_;
+
+  static int checked_levels_(const int levels) {
+    if (levels < 1 || levels > 48)
+      throw Error("Allan variance levels should be between 1 and 48", levels);
+    return levels;
+  }
+
+  void add_cluster_(const int level, const Sums& cluster) {
+    std::array<Sums, 4>& ring = sums_[level];
+    ring[0] = ring[1];
+    ring[1] = ring[2];
+    ring[2] = ring[3];
+    ring[3] = cluster;
+    size_t count = ++count_[level];
+    if (level == 0 && count >= 2) {
+      for (int c = 0; c < Channels; ++c)
+        squares_[0][c] += sqr(ring[3][c] - ring[2][c]);
+      ++terms_[0];
+    }
+    if (count >= 4) {
+      // Averages over twice the cluster size
+      double m = std::ldexp(1.0, level + 1);
+      for (int c = 0; c < Channels; ++c)
+        squares_[level + 1][c] += sqr((ring[2][c] + ring[3][c] - ring[0][c] - ring[1][c]) / m);
+      ++terms_[level + 1];
+    }
+    if (level + 1 >= levels_)
+      return;
+    Pending& pending = pending_[level];
+    if (pending.valid) {
+      Sums combined;
+      for (int c = 0; c < Channels; ++c)
+        combined[c] = pending.sums[c] + cluster[c];
+      pending.valid = false;
+      add_cluster_(level + 1, combined);
+    }
+    else {
+      pending.sums = cluster;
+      pending.valid = true;
+    }
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
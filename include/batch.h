@@ -0,0 +1,69 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Calibration of blocks of raw readings
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_BATCH_H
+#define MRU_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "types.h"
+#include "calibration.h"
+#include "native.h"
+
+namespace mru {
+
+/// Calibration flattened to plain floats for the batch kernels
+struct Batch_calibration {
+  Mat3x4<float> correction;
+  float value_factor;
+  float value_offset;
+};
+
+template<typename FT>
+Batch_calibration batch_calibration(const Calibration<FT>& calibration) {
+  Batch_calibration result;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 4; ++j)
+      result.correction.m[i][j] = static_cast<float>(calibration.correction.m[i][j]);
+  result.value_factor = static_cast<float>(calibration.value_factor);
+  result.value_offset = static_cast<float>(calibration.value_offset);
+  return result;
+}
+
+/**
+ * Calibrate count raw x, y, z triples, stored interleaved as read from a
+ * chip, into separate x, y and z arrays
+ *
+ * Same result as Calibration::correct on each reading, in single precision.
+ * The loop is compiled for several instruction sets and the best one for
+ * the running CPU is picked at load time, so large blocks run at memory
+ * speed. Output arrays must not overlap the input.
+ */
+extern void calibrate_triples(const int16_t* raw, const size_t count,
+                              const Batch_calibration& calibration,
+                              float* x, float* y, float* z);
+
+/// Calibrate count raw scalar values, such as temperatures
+extern void calibrate_values(const int16_t* raw, const size_t count,
+                             const Batch_calibration& calibration, float* values);
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,302 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Acquisition from several buses at once
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_BUS_MANAGER_H
+#define MRU_BUS_MANAGER_H
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "errors.h"
+#include "clock.h"
+#include "i2cbus.h"
+#include "pipeline.h"
+#include "work_pool.h"
+
+namespace mru {
+
+/// Acquisition counts of one bus, or of all buses together
+struct Bus_statistics {
+  Bus_statistics(): polls(0), overruns(0), samples(0), processed(0), busy() {}
+  /// Rounds of polling all chips on the bus
+  size_t polls;
+  /// Rounds that took longer than the poll period
+  size_t overruns;
+  /// Samples read from the chips
+  size_t samples;
+  /// Samples handed to their processor on the pool
+  size_t processed;
+  /// Time spent polling
+  Duration busy;
+  Bus_statistics& operator+=(const Bus_statistics& other) {
+    polls += other.polls;
+    overruns += other.overruns;
+    samples += other.samples;
+    processed += other.processed;
+    busy += other.busy;
+    return *this;
+  }
+};
+
+namespace detail {
+
+/// A chip on a managed bus with the batch of samples of the current round
+struct Managed_chip {
+  virtual ~Managed_chip() {}
+  virtual void poll() = 0;
+  /// Hand the batch to the chip's processor and return its size
+  virtual size_t flush(Strand& strand, std::atomic<size_t>& processed) = 0;
+};
+
+template<class Chip, class Process>
+struct Managed_chip_t: public Managed_chip {
+  typedef typename Chip::Sample_type Sample_type;
+  Managed_chip_t(Chip* chip, const Process& process): chip_(chip), process_(process), batch_() {
+    chip_->set_sample_handler([this](const Sample_type& sample) { batch_.push_back(sample); });
+  }
+  Chip& chip() { return *chip_; }
+  virtual void poll() { chip_->poll(); }
+  virtual size_t flush(Strand& strand, std::atomic<size_t>& processed) {
+    const size_t count = batch_.size();
+    if (count > 0) {
+      strand.submit(Task_(process_, std::move(batch_), processed));
+      batch_ = Batch<Sample_type>();
+    }
+    return count;
+  }
+private:
+  /// The batch moves into the task instead of being copied per sample
+  struct Task_ {
+    Task_(Process& process, Batch<Sample_type>&& batch, std::atomic<size_t>& processed):
+        process(&process), batch(std::move(batch)), processed(&processed) {}
+    void operator()() {
+      (*process)(static_cast<const Batch<Sample_type>&>(batch));
+      *processed += batch.size();
+    }
+    Process* process;
+    Batch<Sample_type> batch;
+    std::atomic<size_t>* processed;
+  };
+  std::unique_ptr<Chip> chip_;
+  Process process_;
+  Batch<Sample_type> batch_;
+};
+
+}  // namespace detail
+
+/**
+ * Sensor units on several buses, polled in parallel
+ *
+ * Buses are half duplex and slow, so polling the chips of several buses
+ * from one loop adds up their transfer times. Here every bus gets an
+ * acquisition thread of its own that does nothing but poll its chips at
+ * the bus's period; the samples a round yields are handed, as one batch
+ * per chip, to a processor function running on a shared Work_pool. Work
+ * for one bus runs in order and one batch at a time, so a processor can
+ * keep filter state (calibration, fusion) without locking; different buses
+ * are processed in parallel. Acquisition then scales with the number of
+ * buses until the cores are used up by processing.
+ *
+ * The manager owns the buses and chips. Chips are set up (initialize())
+ * on the returned reference before start(), and finalized after stop().
+ * An exception on a bus thread stops that bus and is rethrown by stop();
+ * without one, stop() rethrows the first exception of a processor.
+ */
+template<class Bus=I2C_bus>
+struct Bus_manager {
+  /// Manager with a pool of workers threads, or one per core for 0
+  explicit Bus_manager(const int workers=0):
+      buses_(), stopping_(false), started_(), stopped_(), mutex_(), error_(), pool_(workers) {}
+  ~Bus_manager() {
+    if (running()) {
+      try {
+        stop();
+      }
+      catch (...) {
+      }
+    }
+  }
+  Bus_manager(const Bus_manager&) = delete;
+  Bus_manager& operator=(const Bus_manager&) = delete;
+
+  /// Open bus busno, polled every period. A zero period polls back to back.
+  Bus& add_bus(const int busno, const Duration& period) {
+    if (running())
+      throw Error("Can't add a bus to a running manager", busno);
+    buses_.push_back(std::unique_ptr<Unit_>(new Unit_(new Bus(busno), period, pool_)));
+    return *buses_.back()->bus;
+  }
+  /// Create a Chip(bus, args...) on a bus of this manager. process is
+  /// called on the pool with each const Batch<Chip::Sample_type>&.
+  template<class Chip, class Process, typename... Args>
+  Chip& add_chip(Bus& bus, const Process& process, Args&&... args) {
+    if (running())
+      throw Error("Can't add a chip to a running manager");
+    Unit_& unit = unit_(bus);
+    auto managed = new detail::Managed_chip_t<Chip, Process>(
+        new Chip(bus, std::forward<Args>(args)...), process);
+    unit.chips.push_back(std::unique_ptr<detail::Managed_chip>(managed));
+    return managed->chip();
+  }
+  size_t bus_count() const { return buses_.size(); }
+  Work_pool& pool() { return pool_; }
+
+  void start() {
+    if (running())
+      throw Error("Bus manager already running");
+    stopping_ = false;
+    started_ = std::chrono::steady_clock::now();
+    for (auto& unit: buses_)
+      unit->thread = std::thread(&Bus_manager::run_, this, std::ref(*unit));
+  }
+  /// Stop polling and wait until every sample read has been processed
+  void stop() {
+    stopping_ = true;
+    for (auto& unit: buses_)
+      if (unit->thread.joinable())
+        unit->thread.join();
+    stopped_ = std::chrono::steady_clock::now();
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::swap(error, error_);
+    }
+    // The bus error goes first; a processor's is only kept when there is none
+    try {
+      pool_.wait();
+    }
+    catch (...) {
+      if (!error)
+        error = std::current_exception();
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+  bool running() const {
+    for (auto& unit: buses_)
+      if (unit->thread.joinable())
+        return true;
+    return false;
+  }
+
+  /// Counts of bus busno
+  Bus_statistics statistics(const int busno) const {
+    for (auto& unit: buses_)
+      if (unit->bus->get_bus() == busno)
+        return unit->statistics();
+    throw Error("Bus not managed", busno);
+  }
+  /// Counts of all buses together
+  Bus_statistics statistics() const {
+    Bus_statistics result;
+    for (auto& unit: buses_)
+      result += unit->statistics();
+    return result;
+  }
+  /// Samples read per second over all buses from start() until now or stop()
+  double throughput() const {
+    const std::chrono::steady_clock::time_point end =
+        running() ? std::chrono::steady_clock::now() : stopped_;
+    const double seconds = std::chrono::duration<double>(end - started_).count();
+    return seconds > 0 ? statistics().samples / seconds : 0;
+  }
+private:
+  struct Unit_ {
+    Unit_(Bus* bus, const Duration& period, Work_pool& pool):
+        bus(bus), period(period), chips(), strand(pool), thread(),
+        polls(0), overruns(0), samples(0), processed(0), busy(0) {}
+    std::unique_ptr<Bus> bus;
+    Duration period;
+    std::vector<std::unique_ptr<detail::Managed_chip> > chips;
+    Strand strand;
+    std::thread thread;
+    std::atomic<size_t> polls, overruns, samples, processed;
+    std::atomic<int64_t> busy;
+    Bus_statistics statistics() const {
+      Bus_statistics result;
+      result.polls = polls;
+      result.overruns = overruns;
+      result.samples = samples;
+      result.processed = processed;
+      result.busy = from_nanoseconds(busy);
+      return result;
+    }
+  };
+  std::vector<std::unique_ptr<Unit_> > buses_;
+  std::atomic<bool> stopping_;
+  std::chrono::steady_clock::time_point started_;
+  std::chrono::steady_clock::time_point stopped_;
+  std::mutex mutex_;
+  std::exception_ptr error_;
+  // Last so it is destroyed first: its tasks refer to the strands and
+  // processors of the buses
+  Work_pool pool_;
+
+  Unit_& unit_(const Bus& bus) {
+    for (auto& unit: buses_)
+      if (unit->bus.get() == &bus)
+        return *unit;
+    throw Error("Bus not managed", bus.get_bus());
+  }
+
+  void run_(Unit_& unit) {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::duration period = std::chrono::nanoseconds(to_nanoseconds(unit.period));
+    Clock::time_point next = Clock::now();
+    try {
+      while (!stopping_.load(std::memory_order_acquire)) {
+        const Time begin = now();
+        for (auto& chip: unit.chips)
+          chip->poll();
+        size_t count = 0;
+        for (auto& chip: unit.chips)
+          count += chip->flush(unit.strand, unit.processed);
+        unit.samples += count;
+        ++unit.polls;
+        unit.busy += to_nanoseconds(now() - begin);
+        if (period == Clock::duration::zero())
+          continue;
+        next += period;
+        const Clock::time_point current = Clock::now();
+        // Late: skip the missed rounds rather than polling back to back
+        if (next <= current) {
+          ++unit.overruns;
+          next = current;
+        }
+        else
+          std::this_thread::sleep_until(next);
+      }
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -18,31 +18,37 @@
 #ifndef MRU_CALIBRATION_H
 #define MRU_CALIBRATION_H
 
+#include <map>
+#include <string>
+
 #include <boost/filesystem.hpp>
 
 #include "types.h"
+#include "native.h"
 
 namespace mru {
 
+/// Affine correction of a raw reading, in the native layout so correcting
+/// a sample is a plain matrix product
 template<typename FT=DefaultFT>
-struct Correction: public Transformation<FT> {
+struct Correction: public Mat3x4<FT> {
   Correction(const Scalar<FT>& x_factor, const Scalar<FT>& x_offset,
              const Scalar<FT>& y_factor, const Scalar<FT>& y_offset,
              const Scalar<FT>& z_factor, const Scalar<FT>& z_offset):
-    Transformation<FT>(
-        x_factor, 0, 0, x_offset,
-        0, y_factor, 0, y_offset,
-        0, 0, z_factor, z_offset) {}
+    Mat3x4<FT>{{
+        {x_factor, 0, 0, x_offset},
+        {0, y_factor, 0, y_offset},
+        {0, 0, z_factor, z_offset}}} {}
   Correction(const Scalar<FT>& xx_factor, const Scalar<FT>& xy_factor, 
              const Scalar<FT>& xz_factor, const Scalar<FT>& x_offset,
              const Scalar<FT>& yx_factor, const Scalar<FT>& yy_factor, 
              const Scalar<FT>& yz_factor, const Scalar<FT>& y_offset,
              const Scalar<FT>& zx_factor, const Scalar<FT>& zy_factor, 
              const Scalar<FT>& zz_factor, const Scalar<FT>& z_offset):
-    Transformation<FT>(
-        xx_factor, xy_factor, xz_factor, x_offset,
-        yx_factor, yy_factor, yz_factor, y_offset,
-        zx_factor, zy_factor, zz_factor, z_offset) {}
+    Mat3x4<FT>{{
+        {xx_factor, xy_factor, xz_factor, x_offset},
+        {yx_factor, yy_factor, yz_factor, y_offset},
+        {zx_factor, zy_factor, zz_factor, z_offset}}} {}
 };
 
 template<typename FT=DefaultFT>
@@ -80,22 +86,22 @@ struct Calibration {
     return *this;
   }
   Scalar<FT> x_factor() const {
-    return correction.m(0, 0);
+    return correction(0, 0);
   }
   Scalar<FT> x_offset() const {
-    return correction.m(0, 3);
+    return correction(0, 3);
   }
   Scalar<FT> y_factor() const {
-    return correction.m(1, 1);
+    return correction(1, 1);
   }
   Scalar<FT> y_offset() const {
-    return correction.m(1, 3);
+    return correction(1, 3);
   }
   Scalar<FT> z_factor() const {
-    return correction.m(2, 2);
+    return correction(2, 2);
   }
   Scalar<FT> z_offset() const {
-    return correction.m(2, 3);
+    return correction(2, 3);
   }
   Scalar<FT> v_factor() const {
     return value_factor;
@@ -103,6 +109,73 @@ struct Calibration {
   Scalar<FT> v_offset() const {
     return value_offset;
   }
+  Vec3<FT> correct(const Vec3<FT>& raw) const {
+    return correction(raw);
+  }
+  Vec3<FT> correct(const Point<FT>& point) const {
+    return correction(Vec3<FT>(point.x(), point.y(), point.z()));
+  }
+  Scalar<FT> correct(const Scalar<FT>& value) const {
+    return value * value_factor + value_offset;
+  }
+};
+
+/**
+ * Temperature dependence of bias and scale per axis
+ *
+ * Polynomials in the temperature difference from the reference temperature,
+ * applied after the calibration: value = (1 + scale(t)) * (calibrated - bias(t)).
+ * All coefficients zero means no temperature dependence.
+ */
+template<typename FT=DefaultFT>
+struct Temperature_model {
+  static constexpr int max_degree = 3;
+  Temperature_model(const Scalar<FT>& reference=25): reference(reference), bias(), scale() {}
+  Scalar<FT> reference;
+  /// Coefficients of dt^0 .. dt^max_degree
+  Scalar<FT> bias[3][max_degree + 1];
+  /// Relative scale error, coefficients of dt^0 .. dt^max_degree
+  Scalar<FT> scale[3][max_degree + 1];
+  bool empty() const {
+    for (int i = 0; i < 3; ++i)
+      for (int k = 0; k <= max_degree; ++k)
+        if (bias[i][k] != 0 || scale[i][k] != 0)
+          return false;
+    return true;
+  }
+  Scalar<FT> bias_at(const int axis, const Scalar<FT>& temperature) const {
+    return evaluate_(bias[axis], temperature - reference);
+  }
+  Scalar<FT> scale_at(const int axis, const Scalar<FT>& temperature) const {
+    return evaluate_(scale[axis], temperature - reference);
+  }
+private:
+  static Scalar<FT> evaluate_(const Scalar<FT> (&c)[max_degree + 1], const Scalar<FT>& dt) {
+    Scalar<FT> result = c[max_degree];
+    for (int k = max_degree - 1; k >= 0; --k)
+      result = result * dt + c[k];
+    return result;
+  }
+};
+
+/**
+ * All calibrations of a calibration file, by section
+ *
+ * Made by parsing the file once, and not changed after. Sections that are
+ * missing give the default calibration, like load_calibration does.
+ */
+template<typename FT=DefaultFT>
+struct Calibration_set {
+  std::map<std::string, Calibration<FT> > calibrations;
+  std::map<std::string, Temperature_model<FT> > temperature_models;
+  Calibration<FT> calibration(const std::string& section) const {
+    auto found = calibrations.find(section);
+    return found != calibrations.end() ? found->second : Calibration<FT>();
+  }
+  Temperature_model<FT> temperature_model(const std::string& section) const {
+    auto found = temperature_models.find(section);
+    return found != temperature_models.end() ? found->second : Temperature_model<FT>();
+  }
 };
 
 template<typename FT=DefaultFT>
@@ -115,6 +188,13 @@ extern void save_calibration(const std::string& filename, const std::string& sec
 template<typename FT=DefaultFT>
 extern void save_calibration(const boost::filesystem::path& filename, const std::string& section,
                              const Calibration<FT>& calibration);
+template<typename FT=DefaultFT>
+extern Temperature_model<FT> load_temperature_model(const std::string& filename, const std::string& section);
+template<typename FT=DefaultFT>
+extern Calibration_set<FT> load_calibration_set(const std::string& filename);
+template<typename FT=DefaultFT>
+extern void save_temperature_model(const std::string& filename, const std::string& section,
+                                   const Temperature_model<FT>& model);
 
 }  // namespace mru
 
@@ -19,73 +19,127 @@
 #define MRU_CHIPS_H
 
 #include <chrono>
+#include <cmath>
 #include <thread>
+#include <memory>
 
 #include <boost/filesystem.hpp>
 
 #include "types.h"
+#include "stream.h"
 #include "i2cbus.h"
 #include "calibration.h"
-
-#define history_item_count (100000)
+#include "thermal.h"
+#include "published.h"
 
 namespace mru {
 
+/// Signed 16 bit value from a big endian register pair
+inline int16_t big_endian_int16(const Byte msb, const Byte lsb) {
+  return static_cast<int16_t>((msb << 8) | lsb);
+}
 
-template<class Device, typename FT=DefaultFT>
-struct Chip {
+/// Signed 16 bit value from a little endian register pair
+inline int16_t little_endian_int16(const Byte lsb, const Byte msb) {
+  return static_cast<int16_t>((msb << 8) | lsb);
+}
+
+/**
+ * Reconstructs the times of samples drained from a chip FIFO
+ *
+ * The chip takes samples at its output data rate, so the samples of a drain
+ * are one period apart with the newest one taken less than a period before the
+ * drain. The newest sample times of successive drains go through a
+ * Timestamp_filter, so bus and scheduling latency don't show up as jitter in
+ * the sample times and the spacing follows the chip's actual rate.
+ */
+struct Fifo_clock {
+  Fifo_clock(const Duration& period): filter_(period) {}
+  /// Estimated sample period
+  Duration period() const { return filter_.period(); }
+  void set_period(const Duration& period) { filter_.set_nominal_period(period); }
+  /// Returns the time of the first of count samples drained at drain_time
+  Time first(const Time& drain_time, const int count) {
+    if (count <= 0)
+      return drain_time;
+    Time newest = filter_.add(drain_time - filter_.nominal_period() / 2, count);
+    return newest - offset_(count - 1);
+  }
+  /// Time of sample index of a drain that started at first. Spaced by the
+  /// unrounded period, so a long FIFO doesn't add up rounding errors
+  Time at(const Time& first, const int index) const { return first + offset_(index); }
+private:
+  Timestamp_filter filter_;
+  Duration offset_(const int samples) const {
+    return from_nanoseconds(std::llround(samples * filter_.period_nanoseconds()));
+  }
+};
+
+template<class Device, typename FT=DefaultFT, Quantity... Qs>
+struct Chip: public Sample_stream<FT, Qs...> {
   virtual std::string chip_name() { return "unknown"; }
   virtual void initialize(const std::string& calibration_file="") {
-    calibration_ = load_calibration(calibration_file, chip_name());
+    set_calibration(load_calibration<FT>(calibration_file, chip_name()));
+    set_temperature_model(load_temperature_model<FT>(calibration_file, chip_name()));
   }
   void initialize(const boost::filesystem::path& calibration_file) {
     initialize(calibration_file.string());
   }
+  /// Calibration in use. It stays valid while another thread replaces it,
+  /// until the chip goes or reclaim()
+  const Calibration<FT>& calibration() const { return *calibration_.get(); }
+  /// Replace the calibration of a running chip, effective from the next poll
+  void set_calibration(const Calibration<FT>& calibration) {
+    calibration_.emplace(calibration);
+  }
+  /// Free replaced calibrations and compensations. Only while nothing polls
+  /// or reads them
+  void reclaim() {
+    calibration_.reclaim();
+    compensation_.reclaim();
+  }
+  /// Temperature compensation in use, null when there is none. Valid like
+  /// calibration()
+  const Temperature_compensation<FT>* compensation() const { return compensation_.get(); }
+  /// Replace the temperature dependence of a running chip. The lookup table is
+  /// built here, so polling only interpolates
+  void set_temperature_model(const Temperature_model<FT>& model) {
+    if (model.empty())
+      compensation_.reset();
+    else
+      compensation_.emplace(model);
+  }
+  /// Calibrated value corrected for temperature
+  Vec3<FT> compensate(const Vec3<FT>& value, const Scalar<FT>& temperature) const {
+    const Temperature_compensation<FT>* compensation = compensation_.get();
+    return compensation ? compensation->correct(value, temperature) : value;
+  }
   virtual void poll() = 0;
   virtual void finalize() = 0;
-  const Sample<FT>& data() const { return data_; }
-  const Samples<FT>& history() const { return history_; }
   int id() { return id_; }
   int version() { return version_; }
   int status() { return status_; }
   Chip(typename Device::Bus_type& bus, const int address, bool little_endian):
-      device_(bus, address, little_endian), calibration_(), data_(), history_(),
+      device_(bus, address, little_endian),
+      calibration_(Calibration<FT>()),
       id_(0), version_(0), status_(0) {}
 protected:
-  Chip& push_sample(const Sample<FT>& sample) {
-    data_ = sample;
-    history_.push_back(data_);
-    trim_history();
-    return *this;
-  }
-  Chip& push_sample(Sample<FT>&& sample) {
-    data_ = sample;
-    history_.push_back(data_);
-    trim_history();
-    return *this;
-  }
   void set_id(const int value) { id_ = value; }
   void set_version(const int value) { version_ = value; }
   void set_status(const int value) { status_ = value; }
   Device& device() { return device_; }
-  Calibration<FT>& calibration() { return calibration_; }
 private:
   Device device_;
-  Calibration<FT> calibration_;
-  Sample<FT> data_;
-  Samples<FT> history_;
+  Published<Calibration<FT> > calibration_;
+  Published<Temperature_compensation<FT> > compensation_;
   int id_;
   int version_;
   int status_;
-  void trim_history() {
-    while (history_.size() > history_item_count) {
-      history_.pop_front();
-    }
-  }
 };
 
 template<class Device, typename FT=DefaultFT>
-struct HMC5843T: public Chip<Device> {
+struct HMC5843T: public Chip<Device, FT, MagneticFlux> {
+  typedef Chip<Device, FT, MagneticFlux> Chip_type;
 
   static constexpr int default_address = 0x1E;
 
@@ -144,7 +198,7 @@ struct HMC5843T: public Chip<Device> {
 
   virtual std::string chip_name() { return "hmc5843"; }
   virtual void initialize(const std::string& calibration_file="") {
-    Chip<Device>::initialize(calibration_file);
+    Chip_type::initialize(calibration_file);
     // 10Hz output, no bias
     this->device().write_byte(reg_config_a, reg_config_a_nobias | reg_config_a_10hz);
     // 1 Gauss range
@@ -158,18 +212,18 @@ struct HMC5843T: public Chip<Device> {
     // Continuous data aquisition
     this->device().write_byte(reg_mode, reg_mode_continuous);
   }
-  using Chip<Device>::initialize;
+  using Chip_type::initialize;
   virtual void poll() {
     //auto ready = this->device().read_byte(reg_status) & reg_status_rdy;
     //if (ready) {
     Words words = this->device().read_words(reg_data, 3);
 
-    auto point = Point<FT>{
+    auto point = Vec3<FT>{
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[0])),
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[1])),
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[2]))};
 
-    //this->push_sample(Sample<FT>(point, 0);
+    this->push_sample(typename Chip_type::Sample_type(this->calibration().correct(point)));
     //}
   }
   virtual void finalize() {
@@ -180,28 +234,29 @@ struct HMC5843T: public Chip<Device> {
   void set_output_rate(Reg_config_a_rate rate) {
   }
   HMC5843T(typename Device::Bus_type& bus, const int address): 
-      Chip<Device>(bus, address, false) {}
-  HMC5843T(typename Device::Bus_type& bus): Chip<Device>(bus, default_address, false) {}
+      Chip_type(bus, address, false) {}
+  HMC5843T(typename Device::Bus_type& bus): Chip_type(bus, default_address, false) {}
 };
 
 typedef HMC5843T<I2C_device> HMC5843;
 
 template<class Device, typename FT=DefaultFT>
-struct HMC5883T: public HMC5843T<Device> {
+struct HMC5883T: public HMC5843T<Device, FT> {
   static constexpr int default_address = 0x1E;
   virtual std::string chip_name() { return "hmc5883"; }
-  HMC5883T(typename Device::Bus_type& bus, const int address): HMC5843T<Device>(bus, address) {}
-  HMC5883T(typename Device::Bus_type& bus): HMC5843T<Device>(bus, default_address) {}
+  HMC5883T(typename Device::Bus_type& bus, const int address): HMC5843T<Device, FT>(bus, address) {}
+  HMC5883T(typename Device::Bus_type& bus): HMC5843T<Device, FT>(bus, default_address) {}
 };
 
 typedef HMC5883T<I2C_device> HMC5883;
 
 template<class Device, typename FT=DefaultFT>
-struct ADXL345T: public Chip<Device> {
+struct ADXL345T: public Chip<Device, FT, Acceleration> {
+  typedef Chip<Device, FT, Acceleration> Chip_type;
   static constexpr int default_address = 0x53;
   virtual std::string chip_name() { return "adxl345"; }
   virtual void initialize(const std::string& calibration_file="") {
-    Chip<Device>::initialize(calibration_file);
+    Chip_type::initialize(calibration_file);
     // Clear the sleep bit (when it was set)
     this->device().write_byte(0x2D, 0x00);
     // Enable measure bit (get out of standby)
@@ -211,14 +266,14 @@ struct ADXL345T: public Chip<Device> {
     // scale is 4mg/bit
     this->device().write_byte(0x31, 0x0B);
   }
-  using Chip<Device>::initialize;
+  using Chip_type::initialize;
   virtual void poll() {
     Words words = this->device().read_words(0x32, 3);
-    auto point = Point<FT>{
+    auto point = Vec3<FT>{
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[0])),
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[1])),
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[2]))};
-    //this->push_sample(Sample<FT>
+    this->push_sample(typename Chip_type::Sample_type(this->calibration().correct(point)));
   }
   virtual void finalize() {
     // Disable measure bit (set to standby)
@@ -226,18 +281,19 @@ struct ADXL345T: public Chip<Device> {
     // Put the device to sleep
     this->device().write_byte(0x2D, 0x07);
   }
-  ADXL345T(typename Device::Bus_type& bus, const int address): Chip<Device>(bus, address, true) {}
-  ADXL345T(typename Device::Bus_type& bus): Chip<Device>(bus, default_address, true) {}
+  ADXL345T(typename Device::Bus_type& bus, const int address): Chip_type(bus, address, true) {}
+  ADXL345T(typename Device::Bus_type& bus): Chip_type(bus, default_address, true) {}
 };
 
 typedef ADXL345T<I2C_device> ADXL345;
 
 template<class Device, typename FT=DefaultFT>
-struct BMA180T: public Chip<Device> {
+struct BMA180T: public Chip<Device, FT, Acceleration, Temperature> {
+  typedef Chip<Device, FT, Acceleration, Temperature> Chip_type;
   static constexpr int default_address = 0x40;  // alternative 0x41
   virtual std::string chip_name() { return "bma180"; }
   virtual void initialize(const std::string& calibration_file="") {
-    Chip<Device>::initialize(calibration_file);
+    Chip_type::initialize(calibration_file);
 
     // Start by soft resetting the device
     this->device().write_byte(0x10, 0xB6);
@@ -268,7 +324,7 @@ struct BMA180T: public Chip<Device> {
     this->set_id(this->device().read_byte(0x00));
     this->set_version(this->device().read_byte(0x01));
   }
-  using Chip<Device>::initialize;
+  using Chip_type::initialize;
   virtual void poll() {
     Words xyz = this->device().read_words(0x02, 3);
     auto temp = static_cast<int8_t>(this->device().read_byte(0x08));
@@ -276,32 +332,35 @@ struct BMA180T: public Chip<Device> {
     auto x = static_cast<int16_t>(xyz[0]) >> 2;
     auto y = static_cast<int16_t>(xyz[1]) >> 2;
     auto z = static_cast<int16_t>(xyz[2]) >> 2;
-    auto point = Point<FT>{
+    auto point = Vec3<FT>{
         static_cast<Scalar<FT> >(x),
         static_cast<Scalar<FT> >(y),
         static_cast<Scalar<FT> >(z)};
     auto tempf = static_cast<Scalar<FT> >(temp);
 
-    //    this->calibration()
-    //this->push_sample(sample);
+    const Calibration<FT>& calibration = this->calibration();
+    const Scalar<FT> temperature = calibration.correct(tempf);
+    this->push_sample(typename Chip_type::Sample_type(
+        this->compensate(calibration.correct(point), temperature), temperature));
   }
   virtual void finalize() {
     // Put the device to sleep
     this->device().write_byte(0x0D, 0x02);
   }
-  BMA180T(typename Device::Bus_type& bus, const int address): Chip<Device>(bus, address, true) {}
-  BMA180T(typename Device::Bus_type& bus): Chip<Device>(bus, default_address, true) {}
+  BMA180T(typename Device::Bus_type& bus, const int address): Chip_type(bus, address, true) {}
+  BMA180T(typename Device::Bus_type& bus): Chip_type(bus, default_address, true) {}
 };
 
 typedef BMA180T<I2C_device> BMA180;
 
 template<class Device, typename FT=DefaultFT>
-struct ITG3200T: public Chip<Device> {
+struct ITG3200T: public Chip<Device, FT, AngularVelocity, Temperature> {
+  typedef Chip<Device, FT, AngularVelocity, Temperature> Chip_type;
   static constexpr int default_address = 0x68;
 
   virtual std::string chip_name() { return "itg3200"; }
   virtual void initialize(const std::string& calibration_file="") {
-    Chip<Device>::initialize(calibration_file);
+    Chip_type::initialize(calibration_file);
     // First reset the chip
     this->device().write_byte(0x3E, 0x80);
     // Wait a little for it to come back up
@@ -313,86 +372,134 @@ struct ITG3200T: public Chip<Device> {
     // Get out of sleep and select PLL with X Gyro reference as clock
     this->device().write_byte(0x3E, 0x01);
   }
-  using Chip<Device>::initialize;
+  using Chip_type::initialize;
   virtual void poll() {
     Words words = this->device().read_words(0x1B, 4);
-    auto gyr = Point<FT>{
+    auto gyr = Vec3<FT>{
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[1])),
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[2])),
         static_cast<Scalar<FT> >(static_cast<int16_t>(words[3]))};
     auto temp = static_cast<Scalar<FT> >(static_cast<int16_t>(words[0]));
 
-    //    this->calibration()
-    //this->push_sample(sample);
+    const Calibration<FT>& calibration = this->calibration();
+    const Scalar<FT> temperature = calibration.correct(temp);
+    this->push_sample(typename Chip_type::Sample_type(
+        this->compensate(calibration.correct(gyr), temperature), temperature));
   }
   virtual void finalize() {
     // Put to sleep and select internal oscillator as clock
     this->device().write_byte(0x3E, 0x40);
   }
-  ITG3200T(typename Device::Bus_type& bus, const int address): Chip<Device>(bus, address, false) {}
-  ITG3200T(typename Device::Bus_type& bus): Chip<Device>(bus, default_address, false) {}
+  ITG3200T(typename Device::Bus_type& bus, const int address): Chip_type(bus, address, false) {}
+  ITG3200T(typename Device::Bus_type& bus): Chip_type(bus, default_address, false) {}
 };
 
 typedef ITG3200T<I2C_device> ITG3200;
 
 template<class Device, typename FT=DefaultFT>
-struct ITG3205T: public ITG3200T<Device> {
+struct ITG3205T: public ITG3200T<Device, FT> {
   static constexpr int default_address = 0x68; // alternative 0x69: pin 9 high
   virtual std::string chip_name() { return "itg3205"; }
-  ITG3205T(typename Device::Bus_type& bus, const int address): ITG3200T<Device>(bus, address) {}
-  ITG3205T(typename Device::Bus_type& bus): ITG3200T<Device>(bus, default_address) {}
+  ITG3205T(typename Device::Bus_type& bus, const int address): ITG3200T<Device, FT>(bus, address) {}
+  ITG3205T(typename Device::Bus_type& bus): ITG3200T<Device, FT>(bus, default_address) {}
 };
 
 typedef ITG3205T<I2C_device> ITG3205;
 
+/**
+ * BMP085/BMP180 pressure sensor
+ *
+ * Conversions are scheduled on time rather than on the number of poll calls.
+ * A poll before the running conversion is done returns without touching the
+ * bus, so polls can be interleaved freely with other chips' I/O. When a
+ * conversion is done, its result is read and the next one is started right
+ * away. Temperature is only converted once every temperature_interval 
+ * pressure readings. Pressure samples are stamped with the middle of their
+ * conversion.
+ */
 template<class Device, typename FT=DefaultFT>
-struct BMP085T: public Chip<Device, FT> {
+struct BMP085T: public Chip<Device, FT, Pressure, Temperature> {
+  typedef Chip<Device, FT, Pressure, Temperature> Chip_type;
+  typedef std::chrono::steady_clock Clock;
   static constexpr int default_address = 0x77;
+  static constexpr int default_temperature_interval = 32;
+
+  static constexpr uint8_t reg_calibration = 0xAA;
+  static constexpr uint8_t reg_id = 0xD0;
+  static constexpr uint8_t reg_control = 0xF4;
+  static constexpr uint8_t reg_control_temperature = 0x2E;
+  static constexpr uint8_t reg_control_pressure = 0x34;
+  static constexpr int reg_control_oss_shift = 6;
+  static constexpr uint8_t reg_data = 0xF6;
+
   virtual std::string chip_name() { return "bmp085"; }
   virtual void initialize(const std::string& calibration_file="") {
-    Chip<Device, FT>::initialize(calibration_file);
+    Chip_type::initialize(calibration_file);
     // Read calibration data from EEPROM
-    Words words = this->device().read_words(0xAA, 11);
+    Words words = this->device().read_words(reg_calibration, 11);
     set_calibration_data(words);
+    this->set_id(this->device().read_byte(reg_id));
+    state_ = idle;
+    ready_time_ = Clock::now();
   }
-  using Chip<Device, FT>::initialize;
+  using Chip_type::initialize;
   virtual void poll() {
-    if (loop_count_ % 120 == 0) {
-      loop_count_ = 0;
-      // Get temperature
-      this->device().write_byte(0xF4, 0x2E);
-    } else if (loop_count_ == 1) {
-      // Read temperature
-      Word raw_temp = this->device().read_word(0xF6);
-      temp_ = eval_temp(raw_temp);
-    } else if (loop_count_ % 2 == 0) {
-      // Get pressure 8 times oversampling: takes 25ms
-      this->device().write_byte(0xF4, 0x34 + (oss_ << 6));
-    } else {
-      Bytes raw_pressure = this->device().read_bytes(0xF6, 3);
-      int32_t pressure = (raw_pressure[0] << 16) + (raw_pressure[1] << 8) + raw_pressure[0];
-      pressure >>= (8 - oss_);
-      pressure = eval_pressure(pressure);
-
-
-      //this->push_sample(
-      //  Sample<FT>(Point<FT>(
-      //      0, 0, static_cast<Scalar<FT> >(pressure)),
-      //      static_cast<Scalar<FT> >(temp_)));
+    if (Clock::now() < ready_time_)
+      return;
+    switch (state_) {
+      case converting_temperature: {
+        Word raw_temp = this->device().read_word(reg_data);
+        temp_ = eval_temp(raw_temp);
+        break;
+      }
+      case converting_pressure: {
+        Bytes raw_pressure = this->device().read_bytes(reg_data, 3);
+        int32_t pressure = (raw_pressure[0] << 16) + (raw_pressure[1] << 8) + raw_pressure[2];
+        pressure >>= (8 - oss_);
+        pressure = eval_pressure(pressure);
+        ++pressure_count_;
+        const Calibration<FT>& calibration = this->calibration();
+        this->push_sample(typename Chip_type::Sample_type(
+            conversion_start_ + conversion_time(oss_) / 2,
+            calibration.z_factor() * pressure + calibration.z_offset(),
+            calibration.correct(static_cast<Scalar<FT> >(temp_))));
+        break;
+      }
+      case idle:
+        break;
     }
-    loop_count_++;
+    start_conversion();
   }
   virtual void finalize() {
+    state_ = idle;
+  }
+  /// Time at which the running conversion is done. Polling earlier is a no-op.
+  Clock::time_point ready_time() const { return ready_time_; }
+  int oversampling() const { return oss_; }
+  int temperature_interval() const { return temperature_interval_; }
+  void set_temperature_interval(const int interval) { temperature_interval_ = interval; }
+  /// Maximum conversion time of a pressure reading for oversampling setting oss
+  static Duration conversion_time(const int oss) {
+    return std::chrono::microseconds(1500 + (3000 << oss));
+  }
+  /// Maximum conversion time of a temperature reading
+  static Duration temperature_conversion_time() {
+    return std::chrono::microseconds(4500);
   }
   BMP085T(typename Device::Bus_type& bus, const int address, const int oss):
-        Chip<Device>(bus, address, false), loop_count_(0), oss_(oss) {}
-  BMP085T(typename Device::Bus_type& bus, const int address): Chip<Device>(bus, address, false), loop_count_(0), oss_(3) {}
-  BMP085T(typename Device::Bus_type& bus): Chip<Device>(bus, default_address, false), loop_count_(0), oss_(3) {}
+        Chip_type(bus, address, false), oss_(oss) {}
+  BMP085T(typename Device::Bus_type& bus, const int address): Chip_type(bus, address, false), oss_(3) {}
+  BMP085T(typename Device::Bus_type& bus): Chip_type(bus, default_address, false), oss_(3) {}
 protected:
   int32_t eval_temp(const Word raw_temp);
   int32_t eval_pressure(const int32_t raw_pressure);
   void set_calibration_data(const Words& calibration_data);
 private:
+  enum State {
+    idle,
+    converting_temperature,
+    converting_pressure
+  };
   // Oversampling rate
   int oss_;
   // Calibration parameters
@@ -408,9 +515,29 @@ private:
   int16_t mb_;
   int16_t mc_;
   int16_t md_;
-  // State machine position indicator
-  int loop_count_;
-  int32_t temp_;
+  // Conversion pipeline
+  State state_ = idle;
+  Clock::time_point ready_time_ = Clock::time_point();
+  Time conversion_start_;
+  int pressure_count_ = 0;
+  int temperature_interval_ = default_temperature_interval;
+  int32_t temp_ = 0;
+  void start_conversion() {
+    Duration duration;
+    if (state_ == idle || pressure_count_ >= temperature_interval_) {
+      this->device().write_byte(reg_control, reg_control_temperature);
+      state_ = converting_temperature;
+      pressure_count_ = 0;
+      duration = temperature_conversion_time();
+    }
+    else {
+      this->device().write_byte(reg_control, reg_control_pressure + (oss_ << reg_control_oss_shift));
+      state_ = converting_pressure;
+      duration = conversion_time(oss_);
+    }
+    conversion_start_ = now();
+    ready_time_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(duration);
+  }
 };
 
 template <class Device, typename FT>
@@ -469,32 +596,73 @@ int32_t BMP085T<Device, FT>::eval_pressure(const int32_t raw_pressure)
 
 typedef BMP085T<I2C_device> BMP085;
 
+/// BMP180 is register and timing compatible with the BMP085
+template<class Device, typename FT=DefaultFT>
+struct BMP180T: public BMP085T<Device, FT> {
+  static constexpr int default_address = 0x77;
+  virtual std::string chip_name() { return "bmp180"; }
+  BMP180T(typename Device::Bus_type& bus, const int address, const int oss): 
+      BMP085T<Device, FT>(bus, address, oss) {}
+  BMP180T(typename Device::Bus_type& bus, const int address): BMP085T<Device, FT>(bus, address) {}
+  BMP180T(typename Device::Bus_type& bus): BMP085T<Device, FT>(bus, default_address) {}
+};
+
+typedef BMP180T<I2C_device> BMP180;
+
 
 template <class Device, typename FT=DefaultFT>
-struct BNO055T: public Chip<Device> {
+struct BNO055T: public Chip<Device, FT, Acceleration, MagneticFlux, AngularVelocity,
+                            Rotation, Heading, Pitch, Roll,
+                            LinearAcceleration, Gravity, Temperature> {
+  typedef Chip<Device, FT, Acceleration, MagneticFlux, AngularVelocity,
+               Rotation, Heading, Pitch, Roll,
+               LinearAcceleration, Gravity, Temperature> Chip_type;
   static constexpr int default_address = 0x28;
+
+  // Output block: sensor data, fusion results, temperature and status
+  static constexpr uint8_t reg_data = 0x08;
+  static constexpr uint8_t reg_acc_data = 0x08;
+  static constexpr uint8_t reg_mag_data = 0x0E;
+  static constexpr uint8_t reg_gyr_data = 0x14;
+  static constexpr uint8_t reg_eul_data = 0x1A;
+  static constexpr uint8_t reg_qua_data = 0x20;
+  static constexpr uint8_t reg_lia_data = 0x28;
+  static constexpr uint8_t reg_grv_data = 0x2E;
+  static constexpr uint8_t reg_temp = 0x34;
+  static constexpr uint8_t reg_calib_stat = 0x35;
+  static constexpr uint8_t reg_sys_status = 0x39;
+  static constexpr uint8_t reg_sys_err = 0x3A;
+  static constexpr int data_size = reg_sys_err - reg_data + 1;
+  static constexpr uint8_t reg_sys_status_fusion = 0x05;  // fusion algorithm running
+
+  // Scale factors with units m/s^2, rad/s and celcius selected
+  static constexpr FT acc_lsb = 100;
+  static constexpr FT mag_lsb = 16;
+  static constexpr FT gyr_lsb = 900;
+  static constexpr FT qua_lsb = 1 << 14;
+
   virtual std::string chip_name() { return "bno055"; }
   virtual void initialize(const std::string& calibration_file="") {
-    Chip<Device>::initialize(calibration_file);
+    Chip_type::initialize(calibration_file);
 
     // Switch the chip to config mode
-    this->device()->write_byte(0x3D, 0x00);
+    this->device().write_byte(0x3D, 0x00);
 
     // The switch takes a little while
     std::this_thread::sleep_for(std::chrono::milliseconds(25));
 
     // Set/switch to normal power mode
-    this->device()->write_byte(0x3E, 0x00);
+    this->device().write_byte(0x3E, 0x00);
 
     // Select units: m/s^2, rad/s, rad, celcius
-    this->device()->write_byte(0x3B, 0x06);
+    this->device().write_byte(0x3B, 0x06);
 
     // Axes configuration: z axes down
-    this->device()->write_byte(0x41, 0x24);
-    this->device()->write_byte(0x42, 0x03);
+    this->device().write_byte(0x41, 0x24);
+    this->device().write_byte(0x42, 0x03);
 
     // Switch chip to fusion mode: NDOF
-    this->device()->write_byte(0x3D, 0x0C);
+    this->device().write_byte(0x3D, 0x0C);
 
     // The switch takes a little while
     std::this_thread::sleep_for(std::chrono::milliseconds(15));
@@ -503,38 +671,408 @@ struct BNO055T: public Chip<Device> {
     this->set_id(this->device().read_byte(0x00));
     this->set_version((this->device().read_byte(0x05) << 8) + this->device().read_byte(0x04));
   }
-  using Chip<Device>::initialize;
+  using Chip_type::initialize;
   virtual void poll() {
-    int status = this->device()->read_word(0x39);
-    // Expected the "sensor fusion algorithm running" bit to be set. Toggle that so status becomes 0
-    // when everything is as expected. Any bits set either indicate an unexpected state or an error
-    this->set_status(status ^ 0x0020);
-
-    calibration_ = this->device()->read_byte(0x35);
+    // The whole output block in a single transaction
+    Bytes bytes = this->device().read_bytes(reg_data, data_size);
+
+    // Expect the "fusion algorithm running" status. Toggle that so status becomes 0
+    // when everything is as expected. Any bits set either indicate an unexpected 
+    // state or an error
+    this->set_status(
+        (bytes[reg_sys_err - reg_data] << 8) | 
+        (bytes[reg_sys_status - reg_data] ^ reg_sys_status_fusion));
+    calibration_status_ = bytes[reg_calib_stat - reg_data];
+
+    auto rotation = UnitQuaternion<FT>(
+        value(bytes, reg_qua_data, 0, qua_lsb), value(bytes, reg_qua_data, 1, qua_lsb),
+        value(bytes, reg_qua_data, 2, qua_lsb), value(bytes, reg_qua_data, 3, qua_lsb));
+
+    // The euler angles in the output block follow Bosch's conventions (pitch 
+    // +/-180, roll +/-90), so the angles are taken from the quaternion instead
+    this->push_sample(typename Chip_type::Sample_type(
+        vector(bytes, reg_acc_data, acc_lsb),
+        vector(bytes, reg_mag_data, mag_lsb),
+        vector(bytes, reg_gyr_data, gyr_lsb),
+        rotation, rotation.heading(), rotation.pitch(), rotation.roll(),
+        vector(bytes, reg_lia_data, acc_lsb),
+        vector(bytes, reg_grv_data, acc_lsb),
+        static_cast<Scalar<FT> >(static_cast<int8_t>(bytes[reg_temp - reg_data]))));
   }
   virtual void finalize() {
     // Switch the chip to config mode
-    this->device()->write_byte(0x3D, 0x00);
+    this->device().write_byte(0x3D, 0x00);
 
     // The switch takes a little while
     std::this_thread::sleep_for(std::chrono::milliseconds(25));
 
     // Suspend the chip
-    this->device()->write_byte(0x3E, 0x02);
+    this->device().write_byte(0x3E, 0x02);
   }
   BNO055T(typename Device::Bus_type& bus, const int address, const int oss):
-        Chip<Device>(bus, address, false), calibration_(0) {}
-  BNO055T(typename Device::Bus_type& bus, const int address): Chip<Device>(bus, address, false), calibration_(0) {}
-  BNO055T(typename Device::Bus_type& bus): Chip<Device>(bus, default_address, false), calibration_(0) {}
-  int get_calibrarion() {
-    return calibration_;
+        Chip_type(bus, address, true), calibration_status_(0) {}
+  BNO055T(typename Device::Bus_type& bus, const int address): Chip_type(bus, address, true), calibration_status_(0) {}
+  BNO055T(typename Device::Bus_type& bus): Chip_type(bus, default_address, true), calibration_status_(0) {}
+  /// Calibration status of system, gyroscope, accelerometer and magnetometer (2 bits each)
+  int calibration_status() {
+    return calibration_status_;
   }
 private:
-  int calibration_;
+  int calibration_status_;
+  static Scalar<FT> value(const Bytes& bytes, const uint8_t reg, const int index, const FT lsb) {
+    int offset = reg - reg_data + 2 * index;
+    return little_endian_int16(bytes[offset], bytes[offset + 1]) / lsb;
+  }
+  static Vec3<FT> vector(const Bytes& bytes, const uint8_t reg, const FT lsb) {
+    return Vec3<FT>(value(bytes, reg, 0, lsb), value(bytes, reg, 1, lsb), value(bytes, reg, 2, lsb));
+  }
 };
 
 typedef BNO055T<I2C_device> BNO055;
 
+template<class Device, typename FT=DefaultFT>
+struct FXOS8700T: public Chip<Device, FT, Acceleration, MagneticFlux> {
+  typedef Chip<Device, FT, Acceleration, MagneticFlux> Chip_type;
+  static constexpr int default_address = 0x1F;  // alternatives 0x1C, 0x1D, 0x1E
+
+  static constexpr uint8_t reg_status = 0x00;
+  static constexpr uint8_t reg_status_zyxdr = 0x08;  // new x, y and z data
+  static constexpr uint8_t reg_who_am_i = 0x0D;
+  static constexpr uint8_t reg_xyz_data_cfg = 0x0E;
+  enum Reg_xyz_data_cfg_range: uint8_t {
+    reg_xyz_data_cfg_2g,
+    reg_xyz_data_cfg_4g,
+    reg_xyz_data_cfg_8g
+  };
+  static constexpr uint8_t reg_ctrl_1 = 0x2A;
+  static constexpr uint8_t reg_ctrl_1_active = 0x01;
+  static constexpr uint8_t reg_ctrl_1_lnoise = 0x04;  // only for ranges up to 4g
+  // Output data rates in hybrid mode: half the accelerometer only rates
+  enum Reg_ctrl_1_rate: uint8_t {
+    reg_ctrl_1_400hz,
+    reg_ctrl_1_200hz,
+    reg_ctrl_1_100hz,
+    reg_ctrl_1_50hz,
+    reg_ctrl_1_25hz,
+    reg_ctrl_1_6_25hz,
+    reg_ctrl_1_3_125hz,
+    reg_ctrl_1_0_78hz
+  };
+  static constexpr int reg_ctrl_1_rate_shift = 3;
+  static constexpr uint8_t reg_ctrl_2 = 0x2B;
+  static constexpr uint8_t reg_ctrl_2_high_res = 0x02;
+  static constexpr uint8_t reg_m_ctrl_1 = 0x5B;
+  static constexpr uint8_t reg_m_ctrl_1_hybrid = 0x03;  // accelerometer and magnetometer
+  static constexpr uint8_t reg_m_ctrl_1_os_max = 0x1C;  // maximum oversampling for the rate
+  static constexpr uint8_t reg_m_ctrl_2 = 0x5C;
+  // Burst reads roll over from the accelerometer to the magnetometer registers
+  static constexpr uint8_t reg_m_ctrl_2_hyb_autoinc = 0x20;
+
+  virtual std::string chip_name() { return "fxos8700"; }
+  virtual void initialize(const std::string& calibration_file="") {
+    Chip_type::initialize(calibration_file);
+    magnetic_calibration_ = load_calibration<FT>(calibration_file, chip_name() + "_mag");
+
+    // Configuration is only possible in standby
+    this->device().write_byte(reg_ctrl_1, 0x00);
+    // +-4g range: 0.488mg/bit
+    this->device().write_byte(reg_xyz_data_cfg, reg_xyz_data_cfg_4g);
+    this->device().write_byte(reg_ctrl_2, reg_ctrl_2_high_res);
+    // Hybrid mode with auto increment from accelerometer into magnetometer
+    // data, so both come back in a single burst
+    this->device().write_byte(reg_m_ctrl_1, reg_m_ctrl_1_os_max | reg_m_ctrl_1_hybrid);
+    this->device().write_byte(reg_m_ctrl_2, reg_m_ctrl_2_hyb_autoinc);
+
+    this->set_id(this->device().read_byte(reg_who_am_i));
+
+    this->device().write_byte(reg_ctrl_1,
+        (rate_ << reg_ctrl_1_rate_shift) | reg_ctrl_1_lnoise | reg_ctrl_1_active);
+  }
+  using Chip_type::initialize;
+  virtual void poll() {
+    // Status, accelerometer and magnetometer data in one go
+    Bytes bytes = this->device().read_bytes(reg_status, 13);
+    if ((bytes[0] & reg_status_zyxdr) == 0)
+      return;
+    // Accelerometer data is 14 bits, left justified
+    auto acc = Vec3<FT>{
+        static_cast<Scalar<FT> >(big_endian_int16(bytes[1], bytes[2]) >> 2),
+        static_cast<Scalar<FT> >(big_endian_int16(bytes[3], bytes[4]) >> 2),
+        static_cast<Scalar<FT> >(big_endian_int16(bytes[5], bytes[6]) >> 2)};
+    auto mag = Vec3<FT>{
+        static_cast<Scalar<FT> >(big_endian_int16(bytes[7], bytes[8])),
+        static_cast<Scalar<FT> >(big_endian_int16(bytes[9], bytes[10])),
+        static_cast<Scalar<FT> >(big_endian_int16(bytes[11], bytes[12]))};
+    this->push_sample(typename Chip_type::Sample_type(
+        this->calibration().correct(acc), magnetic_calibration_.correct(mag)));
+  }
+  virtual void finalize() {
+    // Put device in standby
+    this->device().write_byte(reg_ctrl_1, 0x00);
+  }
+  FXOS8700T(typename Device::Bus_type& bus, const int address, const Reg_ctrl_1_rate rate):
+      Chip_type(bus, address, false), magnetic_calibration_(), rate_(rate) {}
+  FXOS8700T(typename Device::Bus_type& bus, const int address):
+      Chip_type(bus, address, false), magnetic_calibration_(), rate_(reg_ctrl_1_100hz) {}
+  FXOS8700T(typename Device::Bus_type& bus):
+      Chip_type(bus, default_address, false), magnetic_calibration_(), rate_(reg_ctrl_1_100hz) {}
+protected:
+  Calibration<FT>& magnetic_calibration() { return magnetic_calibration_; }
+private:
+  Calibration<FT> magnetic_calibration_;
+  Reg_ctrl_1_rate rate_;
+};
+
+typedef FXOS8700T<I2C_device> FXOS8700;
+
+template<class Device, typename FT=DefaultFT>
+struct FXAS21002T: public Chip<Device, FT, AngularVelocity, Temperature> {
+  typedef Chip<Device, FT, AngularVelocity, Temperature> Chip_type;
+  static constexpr int default_address = 0x21;  // alternative 0x20
+  static constexpr int fifo_size = 32;
+
+  static constexpr uint8_t reg_out_x_msb = 0x01;
+  static constexpr uint8_t reg_f_status = 0x08;
+  static constexpr uint8_t reg_f_status_ovf = 0x80;  // FIFO overflow
+  static constexpr uint8_t reg_f_status_cnt = 0x3F;  // FIFO sample count
+  static constexpr uint8_t reg_f_setup = 0x09;
+  static constexpr uint8_t reg_f_setup_circular = 0x40;
+  static constexpr uint8_t reg_who_am_i = 0x0C;
+  static constexpr uint8_t reg_ctrl_0 = 0x0D;
+  enum Reg_ctrl_0_range: uint8_t {
+    reg_ctrl_0_2000dps,
+    reg_ctrl_0_1000dps,
+    reg_ctrl_0_500dps,
+    reg_ctrl_0_250dps
+  };
+  static constexpr uint8_t reg_temp = 0x12;
+  static constexpr uint8_t reg_ctrl_1 = 0x13;
+  static constexpr uint8_t reg_ctrl_1_active = 0x02;
+  enum Reg_ctrl_1_rate: uint8_t {
+    reg_ctrl_1_800hz,
+    reg_ctrl_1_400hz,
+    reg_ctrl_1_200hz,
+    reg_ctrl_1_100hz,
+    reg_ctrl_1_50hz,
+    reg_ctrl_1_25hz,
+    reg_ctrl_1_12_5hz
+  };
+  static constexpr int reg_ctrl_1_rate_shift = 2;
+  static constexpr uint8_t reg_ctrl_3 = 0x15;
+  // Burst reads wrap from the last data register back to the first, so a
+  // single burst drains several FIFO samples
+  static constexpr uint8_t reg_ctrl_3_wraptoone = 0x08;
+
+  virtual std::string chip_name() { return "fxas21002"; }
+  virtual void initialize(const std::string& calibration_file="") {
+    Chip_type::initialize(calibration_file);
+    // Configuration is only possible in standby
+    this->device().write_byte(reg_ctrl_1, 0x00);
+    // +-500 degrees/s: 15.625 mdps/bit
+    this->device().write_byte(reg_ctrl_0, reg_ctrl_0_500dps);
+    this->device().write_byte(reg_ctrl_3, reg_ctrl_3_wraptoone);
+    // Circular FIFO: keeps the most recent 32 samples
+    this->device().write_byte(reg_f_setup, reg_f_setup_circular);
+
+    this->set_id(this->device().read_byte(reg_who_am_i));
+
+    this->device().write_byte(reg_ctrl_1, (rate_ << reg_ctrl_1_rate_shift) | reg_ctrl_1_active);
+  }
+  using Chip_type::initialize;
+  virtual void poll() {
+    Time drain_time = now();
+    // FIFO status up to and including the temperature in one go
+    Bytes status = this->device().read_bytes(reg_f_status, reg_temp - reg_f_status + 1);
+    int count = status[0] & reg_f_status_cnt;
+    if (status[0] & reg_f_status_ovf) {
+      count = fifo_size;
+    }
+    if (count == 0)
+      return;
+    const Calibration<FT>& calibration = this->calibration();
+    Scalar<FT> temp = calibration.correct(
+        static_cast<Scalar<FT> >(static_cast<int8_t>(status[reg_temp - reg_f_status])));
+
+    Bytes bytes = this->device().read_bytes(reg_out_x_msb, count * 6);
+    const Time first = clock_.first(drain_time, count);
+    for (int i = 0; i < count; ++i) {
+      const Byte* data = &bytes[i * 6];
+      auto gyr = Vec3<FT>{
+          static_cast<Scalar<FT> >(big_endian_int16(data[0], data[1])),
+          static_cast<Scalar<FT> >(big_endian_int16(data[2], data[3])),
+          static_cast<Scalar<FT> >(big_endian_int16(data[4], data[5]))};
+      this->push_sample(typename Chip_type::Sample_type(
+          clock_.at(first, i), calibration.correct(gyr), temp));
+    }
+  }
+  virtual void finalize() {
+    // Put device in standby
+    this->device().write_byte(reg_ctrl_1, 0x00);
+  }
+  static Duration rate_period(const Reg_ctrl_1_rate rate) {
+    return std::chrono::microseconds(1250 << rate);
+  }
+  FXAS21002T(typename Device::Bus_type& bus, const int address, const Reg_ctrl_1_rate rate):
+      Chip_type(bus, address, false), rate_(rate), clock_(rate_period(rate)) {}
+  FXAS21002T(typename Device::Bus_type& bus, const int address):
+      Chip_type(bus, address, false), rate_(reg_ctrl_1_200hz), clock_(rate_period(rate_)) {}
+  FXAS21002T(typename Device::Bus_type& bus):
+      Chip_type(bus, default_address, false), rate_(reg_ctrl_1_200hz), clock_(rate_period(rate_)) {}
+private:
+  Reg_ctrl_1_rate rate_;
+  Fifo_clock clock_;
+};
+
+typedef FXAS21002T<I2C_device> FXAS21002;
+
+template<class Device, typename FT=DefaultFT>
+struct LSM303DLHCT: public Chip<Device, FT, Acceleration, MagneticFlux> {
+  typedef Chip<Device, FT, Acceleration, MagneticFlux> Chip_type;
+  // Accelerometer and magnetometer respond to their own address
+  static constexpr int default_address = 0x19;
+  static constexpr int default_magnetometer_address = 0x1E;
+  static constexpr int fifo_size = 32;
+
+  // Set in the register address for multi byte reads and writes
+  static constexpr uint8_t auto_increment = 0x80;
+
+  static constexpr uint8_t reg_ctrl_1_a = 0x20;
+  static constexpr uint8_t reg_ctrl_1_a_xyz = 0x07;
+  enum Reg_ctrl_1_a_rate: uint8_t {
+    reg_ctrl_1_a_1hz = 1,
+    reg_ctrl_1_a_10hz,
+    reg_ctrl_1_a_25hz,
+    reg_ctrl_1_a_50hz,
+    reg_ctrl_1_a_100hz,
+    reg_ctrl_1_a_200hz,
+    reg_ctrl_1_a_400hz,
+    reg_ctrl_1_a_1344hz = 9
+  };
+  static constexpr int reg_ctrl_1_a_rate_shift = 4;
+  static constexpr uint8_t reg_ctrl_4_a = 0x23;
+  static constexpr uint8_t reg_ctrl_4_a_bdu = 0x80;  // block data update
+  static constexpr uint8_t reg_ctrl_4_a_4g = 0x10;
+  static constexpr uint8_t reg_ctrl_4_a_hr = 0x08;  // high resolution
+  static constexpr uint8_t reg_ctrl_5_a = 0x24;
+  static constexpr uint8_t reg_ctrl_5_a_fifo_en = 0x40;
+  static constexpr uint8_t reg_out_x_l_a = 0x28;
+  static constexpr uint8_t reg_fifo_ctrl_a = 0x2E;
+  static constexpr uint8_t reg_fifo_ctrl_a_stream = 0x80;
+  static constexpr uint8_t reg_fifo_src_a = 0x2F;
+  static constexpr uint8_t reg_fifo_src_a_ovrn = 0x40;  // FIFO full, oldest overwritten
+  static constexpr uint8_t reg_fifo_src_a_fss = 0x1F;  // unread samples
+
+  static constexpr uint8_t reg_cra_m = 0x00;
+  enum Reg_cra_m_rate: uint8_t {
+    reg_cra_m_0_75hz,
+    reg_cra_m_1_5hz,
+    reg_cra_m_3hz,
+    reg_cra_m_7_5hz,
+    reg_cra_m_15hz,
+    reg_cra_m_30hz,
+    reg_cra_m_75hz,
+    reg_cra_m_220hz
+  };
+  static constexpr int reg_cra_m_rate_shift = 2;
+  static constexpr uint8_t reg_crb_m = 0x01;
+  static constexpr uint8_t reg_crb_m_1_3g = 0x20;
+  static constexpr uint8_t reg_mr_m = 0x02;
+  static constexpr uint8_t reg_mr_m_continuous = 0x00;
+  static constexpr uint8_t reg_mr_m_sleep = 0x03;
+  static constexpr uint8_t reg_out_x_h_m = 0x03;
+  static constexpr uint8_t reg_ira_m = 0x0A;
+  static constexpr uint8_t reg_irb_m = 0x0B;
+  static constexpr uint8_t reg_irc_m = 0x0C;
+
+  virtual std::string chip_name() { return "lsm303dlhc"; }
+  virtual void initialize(const std::string& calibration_file="") {
+    Chip_type::initialize(calibration_file);
+    magnetic_calibration_ = load_calibration<FT>(calibration_file, chip_name() + "_mag");
+
+    // +-4g range, high resolution (12 bits): 2mg/bit
+    this->device().write_byte(reg_ctrl_4_a, reg_ctrl_4_a_bdu | reg_ctrl_4_a_4g | reg_ctrl_4_a_hr);
+    // FIFO in stream mode: keeps the most recent 32 samples
+    this->device().write_byte(reg_ctrl_5_a, reg_ctrl_5_a_fifo_en);
+    this->device().write_byte(reg_fifo_ctrl_a, reg_fifo_ctrl_a_stream);
+    this->device().write_byte(reg_ctrl_1_a, (rate_ << reg_ctrl_1_a_rate_shift) | reg_ctrl_1_a_xyz);
+
+    // 75Hz output, +-1.3 gauss: 1100 bits/gauss (x, y), 980 bits/gauss (z)
+    magnetometer_.write_byte(reg_cra_m, reg_cra_m_75hz << reg_cra_m_rate_shift);
+    magnetometer_.write_byte(reg_crb_m, reg_crb_m_1_3g);
+    magnetometer_.write_byte(reg_mr_m, reg_mr_m_continuous);
+
+    this->set_id(
+        (magnetometer_.read_byte(reg_ira_m) << 16) +
+        (magnetometer_.read_byte(reg_irb_m) << 8) +
+        magnetometer_.read_byte(reg_irc_m));
+  }
+  using Chip_type::initialize;
+  virtual void poll() {
+    Time drain_time = now();
+    int count = fifo_count();
+    if (count == 0)
+      return;
+    // With the FIFO enabled, auto increment rolls back from the last to the
+    // first output register, so a single burst drains all pending samples
+    Bytes bytes = this->device().read_bytes(reg_out_x_l_a | auto_increment, count * 6);
+    const Time first = clock_.first(drain_time, count);
+
+    // Magnetometer registers are ordered x, z, y
+    Bytes mag_bytes = magnetometer_.read_bytes(reg_out_x_h_m, 6);
+    auto mag = magnetic_calibration_.correct(Vec3<FT>{
+        static_cast<Scalar<FT> >(big_endian_int16(mag_bytes[0], mag_bytes[1])),
+        static_cast<Scalar<FT> >(big_endian_int16(mag_bytes[4], mag_bytes[5])),
+        static_cast<Scalar<FT> >(big_endian_int16(mag_bytes[2], mag_bytes[3]))});
+
+    const Calibration<FT>& calibration = this->calibration();
+    for (int i = 0; i < count; ++i) {
+      const Byte* data = &bytes[i * 6];
+      // Data is 12 bits, left justified
+      auto acc = Vec3<FT>{
+          static_cast<Scalar<FT> >(little_endian_int16(data[0], data[1]) >> 4),
+          static_cast<Scalar<FT> >(little_endian_int16(data[2], data[3]) >> 4),
+          static_cast<Scalar<FT> >(little_endian_int16(data[4], data[5]) >> 4)};
+      this->push_sample(typename Chip_type::Sample_type(
+          clock_.at(first, i), calibration.correct(acc), mag));
+    }
+  }
+  virtual void finalize() {
+    // Power down accelerometer and magnetometer
+    this->device().write_byte(reg_ctrl_1_a, 0x00);
+    magnetometer_.write_byte(reg_mr_m, reg_mr_m_sleep);
+  }
+  static Duration rate_period(const Reg_ctrl_1_a_rate rate) {
+    static const int frequencies[] = {0, 1, 10, 25, 50, 100, 200, 400, 1620, 1344};
+    return std::chrono::nanoseconds(1000000000 / frequencies[rate]);
+  }
+  LSM303DLHCT(typename Device::Bus_type& bus, const int address, const int magnetometer_address,
+              const Reg_ctrl_1_a_rate rate):
+      Chip_type(bus, address, false), magnetometer_(bus, magnetometer_address, false),
+      magnetic_calibration_(), rate_(rate), clock_(rate_period(rate)) {}
+  LSM303DLHCT(typename Device::Bus_type& bus, const Reg_ctrl_1_a_rate rate):
+      Chip_type(bus, default_address, false), magnetometer_(bus, default_magnetometer_address, false),
+      magnetic_calibration_(), rate_(rate), clock_(rate_period(rate)) {}
+  LSM303DLHCT(typename Device::Bus_type& bus):
+      Chip_type(bus, default_address, false), magnetometer_(bus, default_magnetometer_address, false),
+      magnetic_calibration_(), rate_(reg_ctrl_1_a_400hz), clock_(rate_period(rate_)) {}
+protected:
+  Device& magnetometer() { return magnetometer_; }
+  Calibration<FT>& magnetic_calibration() { return magnetic_calibration_; }
+private:
+  Device magnetometer_;
+  Calibration<FT> magnetic_calibration_;
+  Reg_ctrl_1_a_rate rate_;
+  Fifo_clock clock_;
+  int fifo_count() {
+    Byte status = this->device().read_byte(reg_fifo_src_a);
+    if (status & reg_fifo_src_a_ovrn)
+      return fifo_size;
+    return status & reg_fifo_src_a_fss;
+  }
+};
+
+typedef LSM303DLHCT<I2C_device> LSM303DLHC;
+
 } //namespace mru
 
 #endif
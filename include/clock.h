@@ -0,0 +1,175 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Monotonic sample times and their filtering
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_CLOCK_H
+#define MRU_CLOCK_H
+
+extern "C" {
+  #include <time.h>
+}
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <ostream>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace mru {
+
+/// Time span in nanoseconds, like Time. Coarser std::chrono durations
+/// convert to it implicitly.
+using Duration = std::chrono::nanoseconds;
+
+inline int64_t to_nanoseconds(const Duration& duration) { return duration.count(); }
+inline Duration from_nanoseconds(const int64_t nanoseconds) { return Duration(nanoseconds); }
+inline double to_seconds(const Duration& duration) { return duration.count() / 1E9; }
+
+/**
+ * Point in time as nanoseconds on CLOCK_MONOTONIC_RAW
+ *
+ * That clock is not slewed or stepped by NTP, so differences between sample
+ * times are true intervals. One 64 bit integer, trivially copyable. The
+ * default is an invalid time; to_utc() maps onto wall clock time.
+ */
+struct Time {
+  constexpr Time(): nanoseconds_(invalid_) {}
+  static constexpr Time from_nanoseconds(const int64_t nanoseconds) { return Time(nanoseconds); }
+  constexpr int64_t nanoseconds() const { return nanoseconds_; }
+  constexpr bool valid() const { return nanoseconds_ != invalid_; }
+  Time& operator+=(const Duration& duration) {
+    nanoseconds_ += to_nanoseconds(duration);
+    return *this;
+  }
+  Time& operator-=(const Duration& duration) {
+    nanoseconds_ -= to_nanoseconds(duration);
+    return *this;
+  }
+private:
+  static constexpr int64_t invalid_ = std::numeric_limits<int64_t>::min();
+  constexpr explicit Time(const int64_t nanoseconds): nanoseconds_(nanoseconds) {}
+  int64_t nanoseconds_;
+};
+
+inline Time operator+(Time time, const Duration& duration) { return time += duration; }
+inline Time operator-(Time time, const Duration& duration) { return time -= duration; }
+inline Duration operator-(const Time& a, const Time& b) {
+  return mru::from_nanoseconds(a.nanoseconds() - b.nanoseconds());
+}
+inline bool operator==(const Time& a, const Time& b) { return a.nanoseconds() == b.nanoseconds(); }
+inline bool operator!=(const Time& a, const Time& b) { return a.nanoseconds() != b.nanoseconds(); }
+inline bool operator<(const Time& a, const Time& b) { return a.nanoseconds() < b.nanoseconds(); }
+inline bool operator>(const Time& a, const Time& b) { return a.nanoseconds() > b.nanoseconds(); }
+inline bool operator<=(const Time& a, const Time& b) { return a.nanoseconds() <= b.nanoseconds(); }
+inline bool operator>=(const Time& a, const Time& b) { return a.nanoseconds() >= b.nanoseconds(); }
+
+/// Seconds since an arbitrary (boot) epoch with nanosecond digits
+inline std::ostream& operator<<(std::ostream& o, const Time& time) {
+  int64_t ns = time.nanoseconds();
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%lld.%09lld",
+           static_cast<long long>(ns / 1000000000), static_cast<long long>(ns % 1000000000));
+  return o << buffer;
+}
+
+/// Current time on the monotonic clock
+inline Time now() {
+  timespec ts;
+#ifdef CLOCK_MONOTONIC_RAW
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return Time::from_nanoseconds(int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec);
+}
+
+/// Current wall clock time, UTC
+inline boost::posix_time::ptime utc_now() {
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+/**
+ * Mapping from monotonic time onto UTC
+ *
+ * The offset between the clocks is taken at construction and on
+ * synchronize(), from the closest of a few back to back readings. Later
+ * steps of the wall clock don't move mapped times until the next
+ * synchronize().
+ */
+struct Utc_mapping {
+  Utc_mapping() { synchronize(); }
+  void synchronize();
+  boost::posix_time::ptime utc(const Time& time) const;
+  Time time(const boost::posix_time::ptime& utc) const;
+private:
+  Time reference_;
+  boost::posix_time::ptime utc_reference_;
+};
+
+/// UTC of a monotonic time, using a mapping taken on first use
+boost::posix_time::ptime to_utc(const Time& time);
+
+/**
+ * Sample times from host capture times and the chip's output data rate
+ *
+ * Captures (e.g. the time of a FIFO drain or data ready poll) lag the
+ * actual sampling by bus and scheduling latency that varies from capture to
+ * capture. The sample index, advanced by the number of samples per capture,
+ * is regressed against the capture times by least squares with exponential
+ * forgetting over about window captures. The slope is drawn towards the
+ * nominal period until the captures span enough samples to estimate it, so
+ * the filter starts well and then follows the chip's actual rate, which
+ * can be off by a few percent. Filtered times lie on the fitted line: the
+ * jitter goes, the mean latency stays.
+ *
+ * A capture further than max_error from the line (zero for one nominal
+ * period) restarts the fit.
+ */
+struct Timestamp_filter {
+  Timestamp_filter(const Duration& period, const int window=64,
+                   const Duration& max_error=Duration());
+  Duration nominal_period() const { return mru::from_nanoseconds(int64_t(nominal_)); }
+  void set_nominal_period(const Duration& period);
+  /// Current estimate of the sample period
+  Duration period() const;
+  /// The same in nanoseconds with their fraction, for spacing many samples
+  double period_nanoseconds() const { return synchronized_ ? slope_ : nominal_; }
+  /// Fitted time of the newest of count samples captured at capture
+  Time add(const Time& capture, const int count=1);
+  void reset() { synchronized_ = false; }
+  bool synchronized() const { return synchronized_; }
+private:
+  double nominal_;
+  double lambda_;
+  double prior_;
+  double max_error_;
+  bool synchronized_;
+  /// Last capture: origin of the sums below
+  Time reference_;
+  double s0_, sn_, snn_, st_, snt_;
+  /// Weight of the nominal slope
+  double weight_;
+  double offset_, slope_;
+  void solve_();
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
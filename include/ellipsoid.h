@@ -0,0 +1,309 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Online hard and soft iron calibration of magnetometers
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_ELLIPSOID_H
+#define MRU_ELLIPSOID_H
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include "types.h"
+#include "matrix.h"
+#include "calibration.h"
+
+namespace mru {
+
+/**
+ * Least squares ellipsoid through magnetometer readings
+ *
+ * Fits the quadric a x2 + b y2 + c z2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y
+ * + 2i z = 1. Only the normal equations are accumulated, so memory and work
+ * per reading are constant no matter how many readings go in.
+ *
+ * Coverage is the fraction of 24 direction bins (6 cube faces, 4 quadrants
+ * each) around the center of the readings' bounding box that hold at least
+ * min_bin_count readings. It is computed from a fixed size random subset of
+ * the readings, so the bins follow the center as it settles. A fit is only
+ * meaningful with good coverage.
+ *
+ * The solution maps the ellipsoid onto a sphere: a symmetric matrix (soft
+ * iron) and an offset (hard iron), scaled so the enclosed volume stays the
+ * same. The field strength of the input is therefore preserved on average.
+ */
+template<typename FT=DefaultFT>
+struct Ellipsoid_fit {
+  static constexpr int bins = 24;
+  static constexpr int reservoir_size = 240;
+  Ellipsoid_fit(const int min_bin_count=3, const FT max_axis_ratio=4):
+      min_bin_count_(min_bin_count), max_axis_ratio_(max_axis_ratio) {
+    reset();
+  }
+  void reset() {
+    normal_ = Matrix<9, 9, double>();
+    right_ = Matrix<9, 1, double>();
+    count_ = 0;
+    scale_ = 0;
+    for (int i = 0; i < 3; ++i) {
+      min_[i] = std::numeric_limits<double>::max();
+      max_[i] = -std::numeric_limits<double>::max();
+    }
+    random_ = 1;
+  }
+  size_t count() const { return count_; }
+  FT coverage() const {
+    int counts[bins] = {};
+    size_t stored = std::min<size_t>(count_, reservoir_size);
+    for (size_t i = 0; i < stored; ++i)
+      ++counts[bin_(reservoir_[i])];
+    int covered = 0;
+    for (auto c: counts)
+      if (c >= min_bin_count_)
+        ++covered;
+    return FT(covered) / bins;
+  }
+  void add(const Vector<FT>& reading) {
+    double v[3] = { reading.x(), reading.y(), reading.z() };
+    // Readings are scaled by the first magnitude to keep the sums well conditioned
+    if (scale_ == 0) {
+      double length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+      if (length == 0)
+        return;
+      scale_ = 1 / length;
+    }
+    // Reservoir sampling: every reading has the same chance to be kept
+    size_t slot = count_;
+    if (count_ >= reservoir_size) {
+      random_ = random_ * 1103515245 + 12345;
+      slot = (random_ >> 8) % (count_ + 1);
+    }
+    for (int i = 0; i < 3; ++i) {
+      min_[i] = std::min(min_[i], v[i]);
+      max_[i] = std::max(max_[i], v[i]);
+      if (slot < reservoir_size)
+        reservoir_[slot][i] = v[i];
+      v[i] *= scale_;
+    }
+    double d[9] = {
+        v[0] * v[0], v[1] * v[1], v[2] * v[2],
+        2 * v[0] * v[1], 2 * v[0] * v[2], 2 * v[1] * v[2],
+        2 * v[0], 2 * v[1], 2 * v[2] };
+    for (int i = 0; i < 9; ++i) {
+      for (int j = i; j < 9; ++j)
+        normal_(i, j) += d[i] * d[j];
+      right_(i, 0) += d[i];
+    }
+    ++count_;
+  }
+  /// Correction from the readings onto a sphere. False when the readings
+  /// don't determine a plausible ellipsoid
+  bool solve(Correction<FT>& correction) const {
+    if (count_ < 9)
+      return false;
+    Matrix<9, 9, double> normal = normal_;
+    for (int i = 0; i < 9; ++i)
+      for (int j = 0; j < i; ++j)
+        normal(i, j) = normal(j, i);
+    Matrix<9, 1, double> p;
+    if (!mru::solve(normal, right_, p))
+      return false;
+    Matrix<3, 3, double> a;
+    a(0, 0) = p(0, 0); a(1, 1) = p(1, 0); a(2, 2) = p(2, 0);
+    a(0, 1) = a(1, 0) = p(3, 0);
+    a(0, 2) = a(2, 0) = p(4, 0);
+    a(1, 2) = a(2, 1) = p(5, 0);
+    Matrix<3, 1, double> g;
+    g(0, 0) = -p(6, 0); g(1, 0) = -p(7, 0); g(2, 0) = -p(8, 0);
+    Matrix<3, 1, double> center;
+    if (!mru::solve(a, g, center))
+      return false;
+    double k = 1;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        k += center(i, 0) * a(i, j) * center(j, 0);
+    if (!(k > 0))
+      return false;
+    Matrix<3, 1, double> values;
+    Matrix<3, 3, double> vectors;
+    symmetric_eigen(a * (1 / k), values, vectors);
+    double smallest = values(0, 0), largest = values(0, 0), volume = 1;
+    for (int i = 0; i < 3; ++i) {
+      smallest = std::min(smallest, values(i, 0));
+      largest = std::max(largest, values(i, 0));
+      volume *= values(i, 0);
+    }
+    // Eigenvalues are inverse squared semi axes
+    if (!(smallest > 0) || largest > smallest * sqr(double(max_axis_ratio_)))
+      return false;
+    double factor = std::pow(volume, -1.0 / 6);
+    Matrix<3, 3, double> root;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        for (int l = 0; l < 3; ++l)
+          root(i, j) += vectors(i, l) * std::sqrt(values(l, 0)) * vectors(j, l) * factor;
+    // Back from scaled readings: the matrix is scale free, the center is not
+    Matrix<3, 1, double> offset = root * center * (-1 / scale_);
+    correction = Correction<FT>(
+        root(0, 0), root(0, 1), root(0, 2), offset(0, 0),
+        root(1, 0), root(1, 1), root(1, 2), offset(1, 0),
+        root(2, 0), root(2, 1), root(2, 2), offset(2, 0));
+    return true;
+  }
+private:
+  int min_bin_count_;
+  FT max_axis_ratio_;
+  Matrix<9, 9, double> normal_;
+  Matrix<9, 1, double> right_;
+  size_t count_;
+  double scale_;
+  double min_[3];
+  double max_[3];
+  double reservoir_[reservoir_size][3];
+  uint32_t random_;
+
+  int bin_(const double (&reading)[3]) const {
+    double v[3] = { reading[0], reading[1], reading[2] };
+    for (int i = 0; i < 3; ++i)
+      v[i] -= (min_[i] + max_[i]) / 2;
+    int axis = 0;
+    for (int i = 1; i < 3; ++i)
+      if (std::fabs(v[i]) > std::fabs(v[axis]))
+        axis = i;
+    int face = 2 * axis + (v[axis] < 0 ? 1 : 0);
+    int quadrant = (v[(axis + 1) % 3] < 0 ? 1 : 0) + (v[(axis + 2) % 3] < 0 ? 2 : 0);
+    return 4 * face + quadrant;
+  }
+};
+
+/**
+ * Background magnetometer calibration of a running chip
+ *
+ * Calibrated magnetic flux samples of the chip are handed to add_sample(),
+ * typically from the chip's sample handler. That only queues the reading;
+ * a worker thread accumulates the ellipsoid fit. Once enough readings with
+ * enough coverage are in, the fitted correction is applied on top of the
+ * chip's current calibration and swapped into the chip as a whole, and
+ * optionally saved. Then fitting starts over, so slow changes in the
+ * magnetic environment are followed without stopping acquisition.
+ *
+ * When the queue is full, readings are dropped rather than blocking.
+ */
+template<class Magnetometer, typename FT=DefaultFT>
+struct Magnetic_calibrator {
+  static constexpr size_t max_queue_size = 1000;
+  Magnetic_calibrator(Magnetometer& magnetometer, const std::string& calibration_file="",
+                      const size_t min_count=500, const FT min_coverage=0.75):
+      magnetometer_(magnetometer), calibration_file_(calibration_file),
+      min_count_(min_count), min_coverage_(min_coverage),
+      fit_(), queue_(), mutex_(), condition_(), quit_(false), updates_(0),
+      thread_(&Magnetic_calibrator::run_, this) {}
+  ~Magnetic_calibrator() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      quit_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+  }
+  /// Number of calibrations swapped into the chip so far
+  int updates() const { return updates_; }
+  template <Quantity... Qs>
+  void add_sample(const Sample<FT, Qs...>& sample) {
+    add_reading(get<FT, MagneticFlux>(sample));
+  }
+  void add_reading(const Vector<FT>& reading) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queue_.size() >= max_queue_size)
+        return;
+      queue_.push_back(reading);
+    }
+    condition_.notify_one();
+  }
+private:
+  Magnetometer& magnetometer_;
+  std::string calibration_file_;
+  size_t min_count_;
+  FT min_coverage_;
+  Ellipsoid_fit<FT> fit_;
+  std::deque<Vector<FT> > queue_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool quit_;
+  std::atomic<int> updates_;
+  std::thread thread_;
+
+  void run_() {
+    std::deque<Vector<FT> > readings;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this]() { return quit_ || !queue_.empty(); });
+        if (quit_)
+          return;
+        readings.swap(queue_);
+      }
+      for (auto& reading: readings)
+        fit_.add(reading);
+      readings.clear();
+      if (fit_.count() >= min_count_ && fit_.coverage() >= min_coverage_)
+        update_();
+    }
+  }
+
+  void update_() {
+    Correction<FT> fitted(1, 0, 1, 0, 1, 0);
+    bool solved = fit_.solve(fitted);
+    fit_.reset();
+    if (!solved)
+      return;
+    // Readings were corrected already: apply the fit after the current correction
+    Calibration<FT> current = magnetometer_.calibration();
+    FT m[3][4];
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        m[i][j] = j == 3 ? fitted(i, 3) : 0;
+        for (int k = 0; k < 3; ++k)
+          m[i][j] += fitted(i, k) * current.correction(k, j);
+      }
+    }
+    Calibration<FT> calibration(
+        m[0][0], m[0][1], m[0][2], m[0][3],
+        m[1][0], m[1][1], m[1][2], m[1][3],
+        m[2][0], m[2][1], m[2][2], m[2][3],
+        current.value_factor, current.value_offset);
+    magnetometer_.set_calibration(calibration);
+    {
+      // Queued readings used the old calibration
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.clear();
+    }
+    if (!calibration_file_.empty())
+      save_calibration<FT>(calibration_file_, magnetometer_.chip_name(), calibration);
+    ++updates_;
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,123 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Fast heading, pitch and roll of whole quaternion arrays
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_EULER_H
+#define MRU_EULER_H
+
+#include <cmath>
+#include <vector>
+
+#include "types.h"
+#include "rotations.h"
+
+namespace mru {
+
+/**
+ * Arc tangent of y / x in [-pi, pi] without calls into libm
+ *
+ * The octant is reduced to [0, 1] and the arc tangent there is the odd
+ * polynomial of Abramowitz and Stegun 4.4.47, maximum error 4E-8 rad.
+ * Octant and quadrant are restored with selects rather than branches, so a
+ * loop over it vectorizes. The total error is that plus a few rounding
+ * errors in FT.
+ */
+template<typename FT>
+inline FT fast_atan2(const FT y, const FT x) {
+  const FT ax = std::fabs(x), ay = std::fabs(y);
+  const FT big = std::max(ax, ay), small = std::min(ax, ay);
+  // atan2(0, 0) gives 0 like the library version
+  const FT a = small / std::max(big, std::numeric_limits<FT>::min());
+  const FT a2 = a * a;
+  FT r = FT(-0.0040540580);
+  r = r * a2 + FT(0.0218612288);
+  r = r * a2 + FT(-0.0559098861);
+  r = r * a2 + FT(0.0964200441);
+  r = r * a2 + FT(-0.1390853351);
+  r = r * a2 + FT(0.1994653599);
+  r = r * a2 + FT(-0.3332985605);
+  r = r * a2 + FT(0.9999993329);
+  r *= a;
+  r = ay > ax ? FT(1.5707963267948966) - r : r;
+  r = x < 0 ? FT(3.1415926535897932) - r : r;
+  return std::copysign(r, y);
+}
+
+/**
+ * Arc sine of s, clamped to [-1, 1], without calls into libm other than sqrt
+ *
+ * Abramowitz and Stegun 4.4.46: pi / 2 - sqrt(1 - |s|) times a degree 7
+ * polynomial, maximum error 3E-8 rad, plus rounding in FT.
+ */
+template<typename FT>
+inline FT fast_asin(const FT s) {
+  const FT a = std::min(std::fabs(s), FT(1));
+  FT r = FT(-0.0012624911);
+  r = r * a + FT(0.0066700901);
+  r = r * a + FT(-0.0170881256);
+  r = r * a + FT(0.0308918810);
+  r = r * a + FT(-0.0501743046);
+  r = r * a + FT(0.0889789874);
+  r = r * a + FT(-0.2145988016);
+  r = r * a + FT(1.5707963050);
+  r = FT(1.5707963267948966) - std::sqrt(1 - a) * r;
+  return std::copysign(r, s);
+}
+
+namespace detail {
+
+template<typename FT>
+void euler_angles(const size_t n,
+    const FT* __restrict qw, const FT* __restrict qx, const FT* __restrict qy, const FT* __restrict qz,
+    FT* __restrict heading, FT* __restrict pitch, FT* __restrict roll) {
+  constexpr FT two_pi = RotScalar<0, 4, FT>::two_pi;
+  for (size_t i = 0; i < n; ++i) {
+    const FT w = qw[i], x = qx[i], y = qy[i], z = qz[i];
+    FT h = fast_atan2<FT>(2 * (w * z + x * y), 1 - 2 * (y * y + z * z));
+    // Same as RotScalar<0, 4>::wrap for the [-pi, pi] range of atan2
+    h = h < 0 ? h + two_pi : h;
+    heading[i] = h >= two_pi ? h - two_pi : h;
+    pitch[i] = fast_asin<FT>(2 * (w * y - z * x));
+    roll[i] = fast_atan2<FT>(2 * (w * x + y * z), 1 - 2 * (x * x + y * y));
+  }
+}
+
+}  // namespace detail
+
+/**
+ * Heading, pitch and roll of every unit quaternion in q
+ *
+ * Same angles and ranges as UnitQuaternion::heading(), pitch() and roll():
+ * heading in [0, 2 pi), pitch in [-pi / 2, pi / 2] and roll in [-pi, pi].
+ * The approximations above keep every angle within 4E-8 rad of the exact
+ * value before rounding. The outputs are resized to the size of q.
+ */
+template<typename FT>
+void euler_angles(const Quaternion_array<FT>& q,
+    std::vector<FT>& heading, std::vector<FT>& pitch, std::vector<FT>& roll) {
+  const size_t n = q.size();
+  heading.resize(n);
+  pitch.resize(n);
+  roll.resize(n);
+  detail::euler_angles<FT>(n, q.w.data(), q.x.data(), q.y.data(), q.z.data(),
+      heading.data(), pitch.data(), roll.data());
+}
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,391 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief IIR and FIR filters on sample streams
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_FILTERS_H
+#define MRU_FILTERS_H
+
+extern "C" {
+  #include <stdlib.h>
+}
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "errors.h"
+#include "types.h"
+#include "stream.h"
+#include "resample.h"
+
+namespace mru {
+
+/**
+ * Coefficients of one second order section, normalized on a0
+ *
+ * y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+ */
+struct Biquad {
+  double b0, b1, b2, a1, a2;
+  /// Complex response at frequency for a sample rate
+  std::complex<double> response(const double frequency, const double rate) const {
+    const std::complex<double> z1 = std::polar(1.0, -2 * M_PI * frequency / rate);
+    const std::complex<double> z2 = z1 * z1;
+    return (b0 + b1 * z1 + b2 * z2) / (1.0 + a1 * z1 + a2 * z2);
+  }
+};
+
+typedef std::vector<Biquad> Biquads;
+
+namespace detail {
+
+inline double design_angle(const double frequency, const double rate) {
+  if (!(frequency > 0 && frequency < rate / 2))
+    throw Error("Filter frequency should be between 0 and half the sample rate");
+  return 2 * M_PI * frequency / rate;
+}
+
+}  // namespace detail
+
+/*
+ * Designs
+ *
+ * Second order sections by the bilinear transform with the frequency
+ * prewarped, as in Robert Bristow-Johnson's audio EQ cookbook. They are
+ * computed in double precision once, when a filter is configured.
+ */
+
+inline Biquad lowpass_biquad(const double cutoff, const double rate, const double q=M_SQRT1_2) {
+  const double w = detail::design_angle(cutoff, rate);
+  const double alpha = std::sin(w) / (2 * q), c = std::cos(w), a0 = 1 + alpha;
+  return Biquad{(1 - c) / 2 / a0, (1 - c) / a0, (1 - c) / 2 / a0, -2 * c / a0, (1 - alpha) / a0};
+}
+
+inline Biquad highpass_biquad(const double cutoff, const double rate, const double q=M_SQRT1_2) {
+  const double w = detail::design_angle(cutoff, rate);
+  const double alpha = std::sin(w) / (2 * q), c = std::cos(w), a0 = 1 + alpha;
+  return Biquad{(1 + c) / 2 / a0, -(1 + c) / a0, (1 + c) / 2 / a0, -2 * c / a0, (1 - alpha) / a0};
+}
+
+/// Notch at frequency with a -3 dB width of frequency / q
+inline Biquad notch_biquad(const double frequency, const double rate, const double q=10) {
+  const double w = detail::design_angle(frequency, rate);
+  const double alpha = std::sin(w) / (2 * q), c = std::cos(w), a0 = 1 + alpha;
+  return Biquad{1 / a0, -2 * c / a0, 1 / a0, -2 * c / a0, (1 - alpha) / a0};
+}
+
+/// Butterworth lowpass of order as second order sections, with a first
+/// order section for odd orders
+inline Biquads butterworth_lowpass(const int order, const double cutoff, const double rate) {
+  if (order < 1)
+    throw Error("Filter order should be positive", order);
+  Biquads result;
+  for (int k = 0; k < order / 2; ++k)
+    result.push_back(lowpass_biquad(cutoff, rate, 1 / (2 * std::sin(M_PI * (2 * k + 1) / (2 * order)))));
+  if (order % 2 == 1) {
+    const double t = std::tan(detail::design_angle(cutoff, rate) / 2);
+    result.push_back(Biquad{t / (1 + t), t / (1 + t), 0, (t - 1) / (t + 1), 0});
+  }
+  return result;
+}
+
+inline Biquads butterworth_highpass(const int order, const double cutoff, const double rate) {
+  if (order < 1)
+    throw Error("Filter order should be positive", order);
+  Biquads result;
+  for (int k = 0; k < order / 2; ++k)
+    result.push_back(highpass_biquad(cutoff, rate, 1 / (2 * std::sin(M_PI * (2 * k + 1) / (2 * order)))));
+  if (order % 2 == 1) {
+    const double t = std::tan(detail::design_angle(cutoff, rate) / 2);
+    result.push_back(Biquad{1 / (1 + t), -1 / (1 + t), 0, (t - 1) / (t + 1), 0});
+  }
+  return result;
+}
+
+/// Notches at the first harmonics of an engine or shaft turning at rpm,
+/// leaving out those at or above half the sample rate
+inline Biquads rpm_notches(const double rpm, const int harmonics, const double rate, const double q=10) {
+  Biquads result;
+  for (int h = 1; h <= harmonics; ++h) {
+    const double frequency = h * rpm / 60;
+    if (frequency > 0 && frequency < rate / 2)
+      result.push_back(notch_biquad(frequency, rate, q));
+  }
+  return result;
+}
+
+/// Linear phase lowpass of taps coefficients: windowed sinc (Hamming) with
+/// unity gain at DC
+inline std::vector<double> fir_lowpass(const int taps, const double cutoff, const double rate) {
+  if (taps < 1)
+    throw Error("Filter length should be positive", taps);
+  const double w = detail::design_angle(cutoff, rate);
+  std::vector<double> result(taps);
+  const double middle = (taps - 1) / 2.0;
+  double sum = 0;
+  for (int i = 0; i < taps; ++i) {
+    const double x = i - middle;
+    const double sinc = x == 0 ? w / M_PI : std::sin(w * x) / (M_PI * x);
+    const double window = taps > 1 ? 0.54 - 0.46 * std::cos(2 * M_PI * i / (taps - 1)) : 1;
+    result[i] = sinc * window;
+    sum += result[i];
+  }
+  for (auto& h: result)
+    h /= sum;
+  return result;
+}
+
+namespace detail {
+
+/// Zero initialized array on a boundary suitable for AVX loads
+template<typename T>
+struct Aligned_array {
+  static constexpr size_t alignment = 32;
+  explicit Aligned_array(const size_t size=0): data_(nullptr), size_(0) { allocate_(size); }
+  Aligned_array(const Aligned_array& other): data_(nullptr), size_(0) {
+    allocate_(other.size_);
+    std::copy(other.data_, other.data_ + size_, data_);
+  }
+  Aligned_array& operator=(Aligned_array other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+  ~Aligned_array() { free(data_); }
+  size_t size() const { return size_; }
+  T* data() { return data_; }
+  const T* data() const { return data_; }
+  T& operator[](const size_t i) { return data_[i]; }
+  const T& operator[](const size_t i) const { return data_[i]; }
+  void fill(const T& value) { std::fill(data_, data_ + size_, value); }
+private:
+  T* data_;
+  size_t size_;
+  void allocate_(const size_t size) {
+    if (size == 0)
+      return;
+    void* memory = nullptr;
+    if (posix_memalign(&memory, alignment, size * sizeof(T)) != 0)
+      throw std::bad_alloc();
+    data_ = static_cast<T*>(memory);
+    size_ = size;
+    fill(T());
+  }
+};
+
+}  // namespace detail
+
+/**
+ * Cascade of second order sections on Channels channels at once
+ *
+ * Every channel (e.g. the x, y and z of one or more vector streams) goes
+ * through the same sections with state of its own. Blocks are frames of
+ * Channels interleaved values, as vectors are stored. The whole block goes
+ * through one section at a time in transposed direct form II; the inner
+ * loop runs over the channels of a frame with the state in aligned arrays,
+ * so it compiles to SIMD across channels.
+ */
+template<typename FT=DefaultFT, int Channels=3>
+struct Biquad_cascade {
+  static_assert(Channels > 0, "Filter needs channels");
+  static constexpr int channels = Channels;
+  Biquad_cascade(): coefficients_(), state_() {}
+  explicit Biquad_cascade(const Biquads& sections):
+      coefficients_(5 * sections.size()), state_(2 * Channels * sections.size()) {
+    for (size_t s = 0; s < sections.size(); ++s)
+      set_section(s, sections[s]);
+  }
+  size_t size() const { return coefficients_.size() / 5; }
+  /// Replace the coefficients of a section, keeping the state; e.g. to
+  /// follow a notch with the engine speed
+  void set_section(const size_t index, const Biquad& section) {
+    FT* c = coefficients_.data() + 5 * index;
+    c[0] = FT(section.b0);
+    c[1] = FT(section.b1);
+    c[2] = FT(section.b2);
+    c[3] = FT(section.a1);
+    c[4] = FT(section.a2);
+  }
+  Biquad section(const size_t index) const {
+    const FT* c = coefficients_.data() + 5 * index;
+    return Biquad{c[0], c[1], c[2], c[3], c[4]};
+  }
+  /// Gain of the whole cascade at frequency
+  double gain(const double frequency, const double rate) const {
+    std::complex<double> h = 1;
+    for (size_t s = 0; s < size(); ++s)
+      h *= section(s).response(frequency, rate);
+    return std::abs(h);
+  }
+  void reset() { state_.fill(0); }
+  /// Filter frames frames of Channels interleaved values. in and out may
+  /// be the same
+  void process(const FT* in, FT* out, const size_t frames) {
+    if (in != out)
+      std::memmove(out, in, frames * Channels * sizeof(FT));
+    for (size_t s = 0; s < size(); ++s)
+      section_(s, out, frames);
+  }
+  /// Filter one frame in place
+  void process(FT* frame) { process(frame, frame, 1); }
+private:
+  detail::Aligned_array<FT> coefficients_;
+  detail::Aligned_array<FT> state_;
+
+  void section_(const size_t s, FT* __restrict data, const size_t frames) {
+    const FT* c = coefficients_.data() + 5 * s;
+    const FT b0 = c[0], b1 = c[1], b2 = c[2], a1 = c[3], a2 = c[4];
+    FT* __restrict z1 = state_.data() + 2 * Channels * s;
+    FT* __restrict z2 = z1 + Channels;
+    for (size_t f = 0; f < frames; ++f) {
+      FT* __restrict x = data + f * Channels;
+      for (int ch = 0; ch < Channels; ++ch) {
+        const FT y = b0 * x[ch] + z1[ch];
+        z1[ch] = b1 * x[ch] - a1 * y + z2[ch];
+        z2[ch] = b2 * x[ch] - a2 * y;
+        x[ch] = y;
+      }
+    }
+  }
+};
+
+/**
+ * Finite impulse response filter on Channels channels at once
+ *
+ * The delay line is stored twice in a row, so the taps always read one
+ * contiguous stretch of it without wrapping, frames of Channels values in
+ * aligned arrays. Cost per frame is linear in the number of taps.
+ */
+template<typename FT=DefaultFT, int Channels=3>
+struct Fir {
+  static_assert(Channels > 0, "Filter needs channels");
+  static constexpr int channels = Channels;
+  Fir(): taps_(), history_(), position_(0) {}
+  explicit Fir(const std::vector<double>& taps):
+      taps_(taps.size()), history_(2 * taps.size() * Channels), position_(0) {
+    for (size_t k = 0; k < taps.size(); ++k)
+      taps_[k] = FT(taps[k]);
+  }
+  size_t size() const { return taps_.size(); }
+  double gain(const double frequency, const double rate) const {
+    std::complex<double> h = 0;
+    for (size_t k = 0; k < size(); ++k)
+      h += double(taps_[k]) * std::polar(1.0, -2 * M_PI * frequency / rate * k);
+    return std::abs(h);
+  }
+  void reset() {
+    history_.fill(0);
+    position_ = 0;
+  }
+  void process(const FT* in, FT* out, const size_t frames) {
+    const size_t n = size();
+    if (n == 0) {
+      if (in != out)
+        std::memmove(out, in, frames * Channels * sizeof(FT));
+      return;
+    }
+    const FT* __restrict h = taps_.data();
+    FT* history = history_.data();
+    for (size_t f = 0; f < frames; ++f) {
+      // Newest first: taps[k] multiplies the frame k back
+      position_ = (position_ == 0 ? n : position_) - 1;
+      FT* newest = history + position_ * Channels;
+      FT* copy = history + (position_ + n) * Channels;
+      FT sum[Channels];
+      for (int ch = 0; ch < Channels; ++ch) {
+        newest[ch] = copy[ch] = in[f * Channels + ch];
+        sum[ch] = 0;
+      }
+      for (size_t k = 0; k < n; ++k) {
+        const FT* __restrict x = newest + k * Channels;
+        for (int ch = 0; ch < Channels; ++ch)
+          sum[ch] += h[k] * x[ch];
+      }
+      for (int ch = 0; ch < Channels; ++ch)
+        out[f * Channels + ch] = sum[ch];
+    }
+  }
+  void process(FT* frame) { process(frame, frame, 1); }
+private:
+  detail::Aligned_array<FT> taps_;
+  detail::Aligned_array<FT> history_;
+  size_t position_;
+};
+
+/**
+ * Filtered copy of a stream
+ *
+ * Takes the quantities Qs (scalars or vectors) of every sample that comes
+ * in, runs their components through Filter as one frame and publishes a
+ * sample with the filtered values and the same time. Filter is a
+ * Biquad_cascade or Fir with as many channels as Qs have components; see
+ * Iir_stream and Fir_stream. Attach it to a chip to get the filtered values
+ * as another output of the chip.
+ */
+template<class Filter, typename FT, Quantity... Qs>
+struct Filtered_stream: public Sample_stream<FT, Qs...> {
+  typedef typename Sample_stream<FT, Qs...>::Sample_type Sample_type;
+  static_assert(Filter::channels == detail::Component_layout<FT, Qs...>::count,
+                "Filter channels should match the components of the quantities");
+  explicit Filtered_stream(const Filter& filter): filter_(filter) {}
+  Filter& filter() { return filter_; }
+  template<Quantity... Ss>
+  void add_sample(const Sample<FT, Ss...>& sample) {
+    typedef typename detail::Make_indices<sizeof...(Qs)>::type Indices;
+    split_(sample, Indices());
+    filter_.process(frame_);
+    this->push_sample(join_(sample.time, Indices()));
+  }
+  /// Filter every sample of a stream. This takes the stream's sample handler.
+  template<class Stream>
+  void attach(Stream& stream) {
+    stream.set_sample_handler([this](const typename Stream::Sample_type& sample) {
+      add_sample(sample);
+    });
+  }
+private:
+  Filter filter_;
+  FT frame_[Filter::channels];
+
+  template<Quantity... Ss, int... Is>
+  void split_(const Sample<FT, Ss...>& sample, detail::Indices<Is...>) {
+    int dummy[] = { 0, (detail::Components<typename Quantity_type<Qs, FT>::type, FT>::split(
+        get<FT, Qs>(sample), frame_ + detail::component_offset<FT, Qs...>(Is)), 0)... };
+    (void)dummy;
+  }
+  template<int... Is>
+  Sample_type join_(const Time& time, detail::Indices<Is...>) const {
+    return Sample_type(time, detail::Components<typename Quantity_type<Qs, FT>::type, FT>::join(
+        frame_ + detail::component_offset<FT, Qs...>(Is))...);
+  }
+};
+
+template<typename FT, Quantity... Qs>
+using Iir_stream = Filtered_stream<Biquad_cascade<FT, detail::Component_layout<FT, Qs...>::count>, FT, Qs...>;
+
+template<typename FT, Quantity... Qs>
+using Fir_stream = Filtered_stream<Fir<FT, detail::Component_layout<FT, Qs...>::count>, FT, Qs...>;
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
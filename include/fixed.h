@@ -0,0 +1,282 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Fixed point numbers for targets without floating point unit
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_FIXED_H
+#define MRU_FIXED_H
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+#include "types.h"
+#include "calibration.h"
+
+namespace mru {
+
+template<typename Storage> struct Wider {};
+template<> struct Wider<int16_t> { typedef int32_t type; };
+template<> struct Wider<int32_t> { typedef int64_t type; };
+
+/// Clamp a wide intermediate result to the range of Storage
+template<typename Storage, typename Wide>
+inline Storage saturate(const Wide value) {
+  return value > std::numeric_limits<Storage>::max() ? std::numeric_limits<Storage>::max() :
+      (value < std::numeric_limits<Storage>::min() ? std::numeric_limits<Storage>::min() :
+       static_cast<Storage>(value));
+}
+
+/**
+ * Signed fixed point number with Fraction fractional bits
+ *
+ * All arithmetic is integer only and saturates at the ends of the range
+ * instead of wrapping around. Products are rounded to nearest. Conversion
+ * from and to double is for setting up and checking, not for the pipeline.
+ */
+template<typename Storage, int Fraction>
+struct Fixed {
+  typedef Storage storage_type;
+  typedef typename Wider<Storage>::type wide_type;
+  static constexpr int fraction_bits = Fraction;
+  static_assert(Fraction > 0 && Fraction < int(8 * sizeof(Storage)), "Invalid number of fraction bits");
+  Storage raw;
+  constexpr Fixed(): raw(0) {}
+  static constexpr Fixed from_raw(const Storage raw) { return Fixed(raw, 0); }
+  static Fixed max() { return from_raw(std::numeric_limits<Storage>::max()); }
+  static Fixed min() { return from_raw(std::numeric_limits<Storage>::min()); }
+  static Fixed from_double(const double value) {
+    return from_raw(saturate<Storage>(static_cast<int64_t>(std::llround(std::ldexp(value, Fraction)))));
+  }
+  double to_double() const { return std::ldexp(double(raw), -Fraction); }
+  Fixed operator-() const { return from_raw(saturate<Storage>(-wide_type(raw))); }
+  Fixed operator+(const Fixed& f) const { return from_raw(saturate<Storage>(wide_type(raw) + f.raw)); }
+  Fixed operator-(const Fixed& f) const { return from_raw(saturate<Storage>(wide_type(raw) - f.raw)); }
+  Fixed operator*(const Fixed& f) const {
+    wide_type product = wide_type(raw) * f.raw + (wide_type(1) << (Fraction - 1));
+    return from_raw(saturate<Storage>(product >> Fraction));
+  }
+  /// Division by zero gives the end of the range with the sign of the dividend
+  Fixed operator/(const Fixed& f) const {
+    if (f.raw == 0)
+      return raw < 0 ? min() : max();
+    return from_raw(saturate<Storage>(wide_type(raw) * (wide_type(1) << Fraction) / f.raw));
+  }
+  Fixed& operator+=(const Fixed& f) { return *this = *this + f; }
+  Fixed& operator-=(const Fixed& f) { return *this = *this - f; }
+  Fixed& operator*=(const Fixed& f) { return *this = *this * f; }
+  bool operator==(const Fixed& f) const { return raw == f.raw; }
+  bool operator!=(const Fixed& f) const { return raw != f.raw; }
+  bool operator<(const Fixed& f) const { return raw < f.raw; }
+  bool operator>(const Fixed& f) const { return raw > f.raw; }
+private:
+  constexpr Fixed(const Storage raw, int): raw(raw) {}
+};
+
+/// Fractions in [-1, 1)
+typedef Fixed<int16_t, 15> Q15;
+typedef Fixed<int32_t, 31> Q31;
+/// Physical values up to +-32768 with a resolution of 1.5E-5
+typedef Fixed<int32_t, 16> Q16_16;
+
+/**
+ * Calibration applied with integers only
+ *
+ * The factors of a Calibration are stored as 32 bit mantissas with one
+ * shift for the whole matrix, chosen so the largest factor uses the full
+ * range; raw 16 bit readings then keep their resolution whatever the size
+ * of the factors. Offsets and results are Q16.16.
+ */
+struct Fixed_calibration {
+  template<typename FT>
+  explicit Fixed_calibration(const Calibration<FT>& calibration) {
+    double largest = 0;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        largest = std::max(largest, std::fabs(double(calibration.correction(i, j))));
+    shift_ = shift_for_(largest);
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 3; ++j)
+        m_[i][j] = saturate<int32_t>(std::llround(std::ldexp(double(calibration.correction(i, j)), shift_)));
+      offset_[i] = Q16_16::from_double(calibration.correction(i, 3));
+    }
+    value_shift_ = shift_for_(std::fabs(double(calibration.value_factor)));
+    value_factor_ = saturate<int32_t>(std::llround(std::ldexp(double(calibration.value_factor), value_shift_)));
+    value_offset_ = Q16_16::from_double(calibration.value_offset);
+  }
+  void correct(const int16_t (&raw)[3], Q16_16 (&result)[3]) const {
+    for (int i = 0; i < 3; ++i) {
+      int64_t sum = int64_t(m_[i][0]) * raw[0] + int64_t(m_[i][1]) * raw[1] + int64_t(m_[i][2]) * raw[2];
+      result[i] = Q16_16::from_raw(saturate<int32_t>(scale_(sum, shift_))) + offset_[i];
+    }
+  }
+  Q16_16 correct(const int16_t raw) const {
+    return Q16_16::from_raw(saturate<int32_t>(scale_(int64_t(value_factor_) * raw, value_shift_))) + value_offset_;
+  }
+private:
+  int32_t m_[3][3];
+  Q16_16 offset_[3];
+  int shift_;
+  int32_t value_factor_;
+  Q16_16 value_offset_;
+  int value_shift_;
+
+  static int shift_for_(const double largest) {
+    // The factor times the largest mantissa stays below 2^30, the shift between 16 and 62
+    int shift = 62;
+    while (shift > 16 && std::ldexp(largest, shift) >= 1073741824.0)
+      --shift;
+    return shift;
+  }
+  /// Rounded shift from 2^-shift to Q16.16
+  static int64_t scale_(const int64_t value, const int shift) {
+    const int s = shift - 16;
+    return s > 0 ? (value + (int64_t(1) << (s - 1))) >> s : value;
+  }
+};
+
+/**
+ * Unit quaternion with Q31 components
+ *
+ * Products are accumulated in 64 bits and rounded once per component.
+ * Normalization uses the first order correction (3 - |q|^2) / 2, which
+ * needs no square root or division and is exact enough for a quaternion
+ * that is renormalized after every small update, as in an AHRS.
+ */
+struct Fixed_quaternion {
+  Fixed_quaternion(): w(Q31::max()), x(), y(), z() {}
+  Fixed_quaternion(const Q31 w, const Q31 x, const Q31 y, const Q31 z): w(w), x(x), y(y), z(z) {}
+  template<typename FT>
+  static Fixed_quaternion from_quaternion(const Quaternion<FT>& q) {
+    return Fixed_quaternion(Q31::from_double(q.qr()), Q31::from_double(q.qi()),
+                            Q31::from_double(q.qj()), Q31::from_double(q.qk()));
+  }
+  template<typename FT>
+  UnitQuaternion<FT> to_quaternion() const {
+    return UnitQuaternion<FT>(w.to_double(), x.to_double(), y.to_double(), z.to_double());
+  }
+  Fixed_quaternion conjugate() const { return Fixed_quaternion(w, -x, -y, -z); }
+  Fixed_quaternion operator*(const Fixed_quaternion& r) const {
+    return Fixed_quaternion(
+        round_(int64_t(w.raw) * r.w.raw - int64_t(x.raw) * r.x.raw - int64_t(y.raw) * r.y.raw - int64_t(z.raw) * r.z.raw),
+        round_(int64_t(w.raw) * r.x.raw + int64_t(x.raw) * r.w.raw + int64_t(y.raw) * r.z.raw - int64_t(z.raw) * r.y.raw),
+        round_(int64_t(w.raw) * r.y.raw - int64_t(x.raw) * r.z.raw + int64_t(y.raw) * r.w.raw + int64_t(z.raw) * r.x.raw),
+        round_(int64_t(w.raw) * r.z.raw + int64_t(x.raw) * r.y.raw - int64_t(y.raw) * r.x.raw + int64_t(z.raw) * r.w.raw));
+  }
+  void normalize() {
+    // |q|^2 in Q31, possibly a little above one. Terms are shifted one by one
+    // so the sum can't overflow
+    int64_t n = ((int64_t(w.raw) * w.raw) >> 31) + ((int64_t(x.raw) * x.raw) >> 31) +
+                ((int64_t(y.raw) * y.raw) >> 31) + ((int64_t(z.raw) * z.raw) >> 31);
+    int64_t f = ((int64_t(3) << 31) - n) >> 1;
+    Q31* c[4] = { &w, &x, &y, &z };
+    for (auto q: c)
+      *q = round_(int64_t(q->raw) * f);
+  }
+  /// Rotate by the angular rate in rad/s over dt seconds: q += q (0, rate dt / 2)
+  void integrate(const Q16_16 (&rate)[3], const Q31 dt) {
+    // Half angles in Q31: Q16.16 times Q31 shifted by 16 and halved
+    int64_t h[3];
+    for (int i = 0; i < 3; ++i)
+      h[i] = (int64_t(rate[i].raw) * dt.raw + (int64_t(1) << 16)) >> 17;
+    Fixed_quaternion d(
+        round_(-int64_t(x.raw) * h[0] - int64_t(y.raw) * h[1] - int64_t(z.raw) * h[2]),
+        round_(int64_t(w.raw) * h[0] + int64_t(y.raw) * h[2] - int64_t(z.raw) * h[1]),
+        round_(int64_t(w.raw) * h[1] - int64_t(x.raw) * h[2] + int64_t(z.raw) * h[0]),
+        round_(int64_t(w.raw) * h[2] + int64_t(x.raw) * h[1] - int64_t(y.raw) * h[0]));
+    w += d.w;
+    x += d.x;
+    y += d.y;
+    z += d.z;
+    normalize();
+  }
+  /// Rotate a vector: v + w t + q x t with t = 2 q x v
+  void rotate(const Q16_16 (&v)[3], Q16_16 (&result)[3]) const {
+    const int64_t q[3] = { x.raw, y.raw, z.raw };
+    int64_t t[3];
+    for (int i = 0; i < 3; ++i) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      t[i] = (q[j] * v[k].raw - q[k] * v[j].raw + (int64_t(1) << 29)) >> 30;
+    }
+    for (int i = 0; i < 3; ++i) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      int64_t r = v[i].raw + ((int64_t(w.raw) * t[i] + q[j] * t[k] - q[k] * t[j] + (int64_t(1) << 30)) >> 31);
+      result[i] = Q16_16::from_raw(saturate<int32_t>(r));
+    }
+  }
+  Q31 w, x, y, z;
+private:
+  static Q31 round_(const int64_t product) {
+    return Q31::from_raw(saturate<int32_t>((product + (int64_t(1) << 30)) >> 31));
+  }
+};
+
+/**
+ * Angle as a binary fraction of a full turn, wrapped like RotScalar
+ *
+ * A full turn is 2^32, so wrapping into a range of a full turn is just the
+ * integer overflow of the 32 bit value: unsigned for 0 to 2 pi, signed for
+ * -pi to pi. The half turn range -pi/2 to pi/2 of pitch folds back at its
+ * ends like RotScalar does.
+ */
+template<int MinQ=0, int MaxQ=4>
+struct Binary_angle {
+  static constexpr int Quarters = MaxQ - MinQ;
+  static_assert((Quarters == 4 && (MinQ == 0 || MinQ == -2)) || (Quarters == 2 && MinQ == -1),
+                "Binary angles cover 0 to 2 pi, -pi to pi or -pi/2 to pi/2");
+  Binary_angle(): raw_(0) {}
+  static Binary_angle from_raw(const uint32_t turn) {
+    Binary_angle result;
+    result.raw_ = fold_(turn);
+    return result;
+  }
+  /// Angle in radians as Q16.16
+  static Binary_angle from_radians(const Q16_16 radians) {
+    // Turns of 2^32 per radian: 2^32 / (2 pi)
+    static const int64_t per_radian = 683565276;
+    return from_raw(static_cast<uint32_t>((int64_t(radians.raw) * per_radian) >> 16));
+  }
+  static Binary_angle from_double(const double radians) {
+    return from_raw(static_cast<uint32_t>(static_cast<int64_t>(std::llround(std::ldexp(radians / (2 * M_PI), 32)))));
+  }
+  /// Full turns in 2^32 steps: unsigned for 0 to 2 pi, otherwise signed
+  uint32_t raw() const { return raw_; }
+  double to_double() const {
+    double turns = MinQ == 0 ? double(raw_) : double(static_cast<int32_t>(raw_));
+    return std::ldexp(turns, -32) * 2 * M_PI;
+  }
+  Binary_angle operator+(const Binary_angle& a) const { return from_raw(raw_ + a.raw_); }
+  Binary_angle operator-(const Binary_angle& a) const { return from_raw(raw_ - a.raw_); }
+private:
+  uint32_t raw_;
+  static uint32_t fold_(const uint32_t turn) {
+    if (Quarters == 4)
+      return turn;
+    // Beyond a quarter turn either way: mirror about +-pi/2
+    int32_t signed_turn = static_cast<int32_t>(turn);
+    const int64_t quarter = int64_t(1) << 30;
+    if (signed_turn > quarter)
+      return static_cast<uint32_t>(static_cast<int32_t>((quarter << 1) - signed_turn));
+    if (signed_turn < -quarter)
+      return static_cast<uint32_t>(static_cast<int32_t>(-(quarter << 1) - signed_turn));
+    return turn;
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,262 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Accelerometer calibration from static multi position recordings
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_GRAVITY_FIT_H
+#define MRU_GRAVITY_FIT_H
+
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+#include "errors.h"
+#include "types.h"
+#include "matrix.h"
+#include "calibration.h"
+
+namespace mru {
+
+/**
+ * Readings taken while the sensor was held still
+ *
+ * The recording is cut in blocks of window readings. A block is kept when
+ * the standard deviation of every axis is below max_relative_deviation
+ * times the magnitude of the block mean, so the threshold doesn't depend on
+ * the units of the readings. Blocks in which the sensor was being turned to
+ * the next position are dropped. The window should be positive.
+ */
+template<typename FT=DefaultFT>
+std::vector<Vector<FT> > stationary_readings(const std::vector<Vector<FT> >& readings,
+                                             const size_t window=50,
+                                             const FT max_relative_deviation=0.01) {
+  if (window == 0)
+    throw Error("Stationary window should be positive");
+  std::vector<Vector<FT> > result;
+  for (size_t start = 0; start + window <= readings.size(); start += window) {
+    double sum[3] = {}, squares[3] = {};
+    for (size_t i = start; i < start + window; ++i) {
+      double v[3] = { readings[i].x(), readings[i].y(), readings[i].z() };
+      for (int j = 0; j < 3; ++j) {
+        sum[j] += v[j];
+        squares[j] += v[j] * v[j];
+      }
+    }
+    double magnitude = 0, variance = 0;
+    for (int j = 0; j < 3; ++j) {
+      double mean = sum[j] / window;
+      magnitude += mean * mean;
+      variance = std::max(variance, squares[j] / window - mean * mean);
+    }
+    if (variance <= sqr(double(max_relative_deviation)) * magnitude)
+      result.insert(result.end(), readings.begin() + start, readings.begin() + start + window);
+  }
+  return result;
+}
+
+/**
+ * Full accelerometer correction from static readings in many orientations
+ *
+ * Finds the 3x3 matrix M and offset b for which |M x + b| equals gravity
+ * for every reading x, by Levenberg-Marquardt on the residuals of all
+ * readings. Gravity alone can't tell a rotated frame from the real one, so
+ * M is kept symmetric by three weighted constraint residuals. Each
+ * orientation gives one equation, so the remaining nine degrees of freedom
+ * of the 12 Correction parameters need at least nine well spread
+ * orientations; solve() fails when they are not determined.
+ *
+ * Residuals and Jacobian are evaluated in slices of the readings on all
+ * cores and reduced into the 12x12 normal equations, which are then solved
+ * on the calling thread.
+ */
+template<typename FT=DefaultFT>
+struct Gravity_fit {
+  static constexpr int parameters = 12;
+  Gravity_fit(const FT gravity=standard_gravity, const int max_iterations=100,
+              const unsigned threads=0):
+      gravity_(gravity), max_iterations_(max_iterations),
+      threads_(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+      iterations_(0), rms_(0) {}
+  /// Iterations used by the last solve
+  int iterations() const { return iterations_; }
+  /// Root mean square of the magnitude errors after the last solve
+  FT rms() const { return rms_; }
+  /// False when the readings don't determine the correction
+  bool solve(const std::vector<Vector<FT> >& readings, Correction<FT>& correction) {
+    iterations_ = 0;
+    const size_t n = readings.size();
+    if (n < parameters)
+      return false;
+    data_.resize(3 * n);
+    double length = 0;
+    for (size_t i = 0; i < n; ++i) {
+      data_[3 * i] = readings[i].x();
+      data_[3 * i + 1] = readings[i].y();
+      data_[3 * i + 2] = readings[i].z();
+      length += std::sqrt(readings[i].squared_length());
+    }
+    length /= n;
+    if (!(length > 0))
+      return false;
+    // Start from a pure scale onto gravity
+    double p[parameters] = {};
+    p[0] = p[4] = p[8] = gravity_ / length;
+    // Constraint weight: comparable to the pull of all readings on M
+    constraint_weight_ = std::sqrt(double(n)) * length;
+    Sums sums = accumulate_(p, true);
+    double lambda = 1E-3;
+    for (iterations_ = 1; iterations_ <= max_iterations_; ++iterations_) {
+      Matrix<parameters, parameters, double> normal = sums.normal;
+      for (int i = 0; i < parameters; ++i) {
+        for (int j = 0; j < i; ++j)
+          normal(i, j) = normal(j, i);
+        normal(i, i) *= 1 + lambda;
+      }
+      Matrix<parameters, 1, double> step;
+      if (!mru::solve(normal, sums.gradient * -1.0, step))
+        return false;
+      double trial[parameters];
+      for (int i = 0; i < parameters; ++i)
+        trial[i] = p[i] + step(i, 0);
+      Sums next = accumulate_(trial, false);
+      if (next.cost < sums.cost) {
+        double decrease = sums.cost - next.cost;
+        std::copy(trial, trial + parameters, p);
+        sums = accumulate_(p, true);
+        lambda = std::max(lambda / 10, 1E-12);
+        if (decrease <= 1E-14 * sums.cost + 1E-30)
+          break;
+      }
+      else {
+        lambda *= 10;
+        if (lambda > 1E12)
+          break;
+      }
+    }
+    // Damping hides directions the readings don't determine: check the
+    // conditioning of the undamped, scale free normal equations
+    Matrix<parameters, parameters, double> normal = sums.normal;
+    double scale[parameters];
+    for (int i = 0; i < parameters; ++i)
+      scale[i] = normal(i, i) > 0 ? 1 / std::sqrt(normal(i, i)) : 0;
+    for (int i = 0; i < parameters; ++i)
+      for (int j = i; j < parameters; ++j)
+        normal(i, j) = normal(j, i) = normal(i, j) * scale[i] * scale[j];
+    Matrix<parameters, 1, double> values;
+    Matrix<parameters, parameters, double> vectors;
+    symmetric_eigen(normal, values, vectors);
+    double smallest = values(0, 0);
+    for (int i = 1; i < parameters; ++i)
+      smallest = std::min(smallest, values(i, 0));
+    if (smallest < 1E-4)
+      return false;
+    rms_ = std::sqrt(sums.residuals / n);
+    correction = Correction<FT>(
+        p[0], p[1], p[2], p[9],
+        p[3], p[4], p[5], p[10],
+        p[6], p[7], p[8], p[11]);
+    return true;
+  }
+private:
+  struct Sums {
+    Sums(): normal(), gradient(), cost(0), residuals(0) {}
+    Matrix<parameters, parameters, double> normal;
+    Matrix<parameters, 1, double> gradient;
+    double cost;
+    /// Cost of the readings alone, without the constraints
+    double residuals;
+  };
+  FT gravity_;
+  int max_iterations_;
+  unsigned threads_;
+  int iterations_;
+  FT rms_;
+  double constraint_weight_;
+  std::vector<double> data_;
+
+  void accumulate_slice_(const double* p, const size_t begin, const size_t end,
+                         const bool jacobian, Sums& sums) const {
+    const double g = gravity_;
+    for (size_t i = begin; i < end; ++i) {
+      const double* x = &data_[3 * i];
+      double y[3];
+      for (int j = 0; j < 3; ++j)
+        y[j] = p[3 * j] * x[0] + p[3 * j + 1] * x[1] + p[3 * j + 2] * x[2] + p[9 + j];
+      double norm = std::sqrt(y[0] * y[0] + y[1] * y[1] + y[2] * y[2]);
+      double r = norm - g;
+      sums.residuals += r * r;
+      if (!jacobian || norm == 0)
+        continue;
+      double d[parameters];
+      for (int j = 0; j < 3; ++j) {
+        double u = y[j] / norm;
+        d[3 * j] = u * x[0];
+        d[3 * j + 1] = u * x[1];
+        d[3 * j + 2] = u * x[2];
+        d[9 + j] = u;
+      }
+      for (int a = 0; a < parameters; ++a) {
+        for (int b = a; b < parameters; ++b)
+          sums.normal(a, b) += d[a] * d[b];
+        sums.gradient(a, 0) += d[a] * r;
+      }
+    }
+  }
+
+  Sums accumulate_(const double* p, const bool jacobian) const {
+    const size_t n = data_.size() / 3;
+    // Not worth a thread below a few thousand readings per slice
+    const size_t slices = std::max<size_t>(1, std::min<size_t>(threads_, n / 4096));
+    std::vector<Sums> partial(slices);
+    std::vector<std::thread> workers;
+    for (size_t s = 1; s < slices; ++s) {
+      workers.emplace_back(&Gravity_fit::accumulate_slice_, this, p,
+                           n * s / slices, n * (s + 1) / slices, jacobian, std::ref(partial[s]));
+    }
+    accumulate_slice_(p, 0, n / slices, jacobian, partial[0]);
+    for (auto& worker: workers)
+      worker.join();
+    Sums result = partial[0];
+    for (size_t s = 1; s < slices; ++s) {
+      result.normal += partial[s].normal;
+      result.gradient += partial[s].gradient;
+      result.residuals += partial[s].residuals;
+    }
+    // Symmetry constraints on M: w (m_jk - m_kj)
+    const int pairs[3][2] = { {1, 3}, {2, 6}, {5, 7} };
+    const double w = constraint_weight_;
+    result.cost = result.residuals;
+    for (auto& pair: pairs) {
+      double r = w * (p[pair[0]] - p[pair[1]]);
+      result.cost += r * r;
+      if (!jacobian)
+        continue;
+      result.normal(pair[0], pair[0]) += w * w;
+      result.normal(pair[1], pair[1]) += w * w;
+      result.normal(pair[0], pair[1]) -= w * w;
+      result.gradient(pair[0], 0) += w * r;
+      result.gradient(pair[1], 0) -= w * r;
+    }
+    return result;
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
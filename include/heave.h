@@ -0,0 +1,155 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Heave, surge and sway from acceleration and orientation
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_HEAVE_H
+#define MRU_HEAVE_H
+
+#include <cmath>
+
+#include "types.h"
+#include "stream.h"
+
+namespace mru {
+
+/**
+ * Double integration of acceleration to velocity and displacement
+ *
+ * Acceleration, velocity and displacement each pass a first order high pass
+ * filter, so sensor offsets and integration errors can't accumulate. The
+ * cutoff follows the motion: it is cutoff_ratio times the frequency of the
+ * displacement, estimated from the time between upward zero crossings.
+ * Periods outside min_period .. max_period are ignored.
+ *
+ * Work per sample is constant and there are no buffers.
+ */
+template<typename FT=DefaultFT>
+struct Drift_free_integrator {
+  Drift_free_integrator(const FT period=8, const FT cutoff_ratio=0.1,
+                        const FT min_period=1, const FT max_period=30):
+      period_(period), cutoff_ratio_(cutoff_ratio),
+      min_period_(min_period), max_period_(max_period),
+      started_(false), acceleration_(0), filtered_acceleration_(0),
+      velocity_(0), displacement_(0), elapsed_(0) {}
+  FT velocity() const { return velocity_; }
+  FT displacement() const { return displacement_; }
+  /// Estimated period of the motion in s
+  FT period() const { return period_; }
+  /// Current high pass cutoff in Hz
+  FT cutoff() const { return cutoff_ratio_ / period_; }
+  void update(const FT acceleration, const FT dt) {
+    if (!started_) {
+      acceleration_ = acceleration;
+      started_ = true;
+      return;
+    }
+    FT tau = period_ / (2 * FT(M_PI) * cutoff_ratio_);
+    FT alpha = tau / (tau + dt);
+
+    FT filtered_acceleration = alpha * (filtered_acceleration_ + acceleration - acceleration_);
+    FT velocity = alpha * (velocity_ + (filtered_acceleration + filtered_acceleration_) * dt / 2);
+    FT displacement = alpha * (displacement_ + (velocity + velocity_) * dt / 2);
+    acceleration_ = acceleration;
+    filtered_acceleration_ = filtered_acceleration;
+    velocity_ = velocity;
+
+    elapsed_ += dt;
+    if (displacement_ < 0 && displacement >= 0) {
+      if (elapsed_ >= min_period_ && elapsed_ <= max_period_) {
+        period_ += (elapsed_ - period_) / 4;
+      }
+      elapsed_ = 0;
+    }
+    else if (elapsed_ > max_period_) {
+      elapsed_ = 0;
+    }
+    displacement_ = displacement;
+  }
+private:
+  FT period_;
+  FT cutoff_ratio_;
+  FT min_period_;
+  FT max_period_;
+  bool started_;
+  FT acceleration_;
+  FT filtered_acceleration_;
+  FT velocity_;
+  FT displacement_;
+  FT elapsed_;
+};
+
+/**
+ * Vessel motion from acceleration and orientation samples
+ *
+ * Accelerations are rotated into the earth frame with the latest orientation
+ * sample, gravity is removed and the result is turned to the vessel heading:
+ * x is surge (forward), y is sway (starboard) and z is heave (down), all
+ * horizontal or vertical regardless of pitch and roll. Every acceleration
+ * sample publishes a sample of displacement and velocity in this frame.
+ */
+template<typename FT=DefaultFT>
+struct Heave: public Sample_stream<FT, Displacement, Velocity> {
+  typedef Sample_stream<FT, Displacement, Velocity> Stream_type;
+  /// Gaps between acceleration samples longer than this are not integrated
+  static constexpr double max_interval = 1.0;
+  Heave(const Drift_free_integrator<FT>& integrator=Drift_free_integrator<FT>()):
+      surge_(integrator), sway_(integrator), heave_(integrator),
+      rotation_(), time_(), has_rotation_(false) {}
+  const Drift_free_integrator<FT>& surge() const { return surge_; }
+  const Drift_free_integrator<FT>& sway() const { return sway_; }
+  const Drift_free_integrator<FT>& heave() const { return heave_; }
+  template <Quantity... Qs>
+  void add_rotation(const Sample<FT, Qs...>& sample) {
+    rotation_ = get<FT, Rotation>(sample);
+    has_rotation_ = true;
+  }
+  template <Quantity... Qs>
+  void add_acceleration(const Sample<FT, Qs...>& sample) {
+    update(sample.time, get<FT, Acceleration>(sample));
+  }
+  void update(const Time& time, const Vec3<FT>& acceleration) {
+    if (!has_rotation_)
+      return;
+    if (time_.valid()) {
+      FT dt = FT(to_seconds(time - time_));
+      if (dt > 0 && dt < max_interval) {
+        Vec3<FT> earth = rotation_.rotate(acceleration);
+        FT heading = rotation_.heading();
+        FT c = std::cos(heading), s = std::sin(heading);
+        surge_.update(c * earth.x() + s * earth.y(), dt);
+        sway_.update(c * earth.y() - s * earth.x(), dt);
+        heave_.update(earth.z() + FT(standard_gravity), dt);
+        this->push_sample(typename Stream_type::Sample_type(time,
+            Vector<FT>(surge_.displacement(), sway_.displacement(), heave_.displacement()),
+            Vector<FT>(surge_.velocity(), sway_.velocity(), heave_.velocity())));
+      }
+    }
+    time_ = time;
+  }
+private:
+  Drift_free_integrator<FT> surge_;
+  Drift_free_integrator<FT> sway_;
+  Drift_free_integrator<FT> heave_;
+  UnitQuaternion<FT> rotation_;
+  Time time_;
+  bool has_rotation_;
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
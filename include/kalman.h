@@ -0,0 +1,226 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Error state Kalman filter for orientation and gyroscope bias
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_KALMAN_H
+#define MRU_KALMAN_H
+
+#include <cmath>
+
+#include "types.h"
+#include "matrix.h"
+#include "ahrs.h"
+
+namespace mru {
+
+/**
+ * Multiplicative extended Kalman filter
+ *
+ * The full orientation is kept as a quaternion, with the same conventions
+ * as the other filters in ahrs.h. The filter itself estimates a six state
+ * error: a small rotation in the sensor frame and the gyroscope bias error.
+ * After every update the error is folded into the quaternion and the bias
+ * and reset to zero, so the error stays small and linearization holds.
+ *
+ * Gravity is observed as a direction: accelerations that differ from 1 g by
+ * more than acceleration_gate (relative) are ignored. The magnetometer only
+ * corrects heading, so magnetic disturbances don't leak into pitch and roll.
+ *
+ * Noise parameters are standard deviations: gyroscope noise in rad/s/sqrt(Hz),
+ * bias random walk in rad/s/sqrt(s), gravity direction in rad, heading in rad.
+ */
+template<typename FT=DefaultFT>
+struct Kalman {
+  static constexpr int states = 6;
+  typedef Matrix<states, states, FT> Covariance;
+  typedef Matrix<states, 1, FT> State;
+
+  Kalman(const FT gyro_noise=0.003, const FT bias_noise=0.0002,
+         const FT acceleration_noise=0.03, const FT heading_noise=0.05):
+      gyro_variance_(sqr(gyro_noise)), bias_variance_(sqr(bias_noise)),
+      acceleration_variance_(sqr(acceleration_noise)), heading_variance_(sqr(heading_noise)),
+      acceleration_gate_(0.1),
+      q0_(1), q1_(0), q2_(0), q3_(0), bx_(0), by_(0), bz_(0), x_(), p_() {
+    reset_covariance();
+  }
+  UnitQuaternion<FT> rotation() const { return UnitQuaternion<FT>(q0_, q1_, q2_, q3_); }
+  void set_rotation(const UnitQuaternion<FT>& q) {
+    q0_ = q.qr();
+    q1_ = q.qi();
+    q2_ = q.qj();
+    q3_ = q.qk();
+  }
+  /// Estimated gyroscope bias: subtracted from every gyroscope reading
+  Vector<FT> bias() const { return Vector<FT>(bx_, by_, bz_); }
+  void set_bias(const Vector<FT>& bias) {
+    bx_ = bias.x();
+    by_ = bias.y();
+    bz_ = bias.z();
+  }
+  const Covariance& covariance() const { return p_; }
+  /// Initial uncertainty: 0.1 rad of attitude and 0.02 rad/s of bias
+  void reset_covariance(const FT attitude_sigma=0.1, const FT bias_sigma=0.02) {
+    p_ = Covariance();
+    for (int i = 0; i < 3; ++i) {
+      p_(i, i) = sqr(attitude_sigma);
+      p_(i + 3, i + 3) = sqr(bias_sigma);
+    }
+  }
+  FT acceleration_gate() const { return acceleration_gate_; }
+  void set_acceleration_gate(const FT gate) { acceleration_gate_ = gate; }
+
+  void update(const Vec3<FT>& angular_velocity, const Vec3<FT>& acceleration, const FT dt) {
+    predict_(angular_velocity, dt);
+    observe_gravity_(acceleration);
+    inject_();
+  }
+  void update(const Vec3<FT>& angular_velocity, const Vec3<FT>& acceleration,
+              const Vec3<FT>& magnetic_flux, const FT dt) {
+    predict_(angular_velocity, dt);
+    observe_gravity_(acceleration);
+    observe_heading_(magnetic_flux);
+    inject_();
+  }
+private:
+  FT gyro_variance_;
+  FT bias_variance_;
+  FT acceleration_variance_;
+  FT heading_variance_;
+  FT acceleration_gate_;
+  FT q0_, q1_, q2_, q3_;
+  FT bx_, by_, bz_;
+  State x_;
+  Covariance p_;
+
+  void predict_(const Vec3<FT>& angular_velocity, const FT dt) {
+    FT wx = angular_velocity.x() - bx_;
+    FT wy = angular_velocity.y() - by_;
+    FT wz = angular_velocity.z() - bz_;
+
+    // Quaternion exponent of the rotation over dt, multiplied from the right
+    FT angle = std::sqrt(wx * wx + wy * wy + wz * wz) * dt;
+    FT c, s;
+    if (angle > FT(1E-6)) {
+      c = std::cos(angle / 2);
+      s = std::sin(angle / 2) * dt / angle;
+    }
+    else {
+      c = 1;
+      s = dt / 2;
+    }
+    FT rx = wx * s, ry = wy * s, rz = wz * s;
+    FT q0 = q0_, q1 = q1_, q2 = q2_, q3 = q3_;
+    q0_ = q0 * c - q1 * rx - q2 * ry - q3 * rz;
+    q1_ = q0 * rx + q1 * c + q2 * rz - q3 * ry;
+    q2_ = q0 * ry - q1 * rz + q2 * c + q3 * rx;
+    q3_ = q0 * rz + q1 * ry - q2 * rx + q3 * c;
+    normalize_();
+
+    // Error propagation: attitude error rotates against the rate and
+    // integrates the bias error
+    Covariance f = Covariance::identity();
+    f.set_block(0, 0, Matrix<3, 3, FT>::identity() - skew<FT>(Vector<FT>(wx, wy, wz)) * dt);
+    f.set_block(0, 3, Matrix<3, 3, FT>(-dt));
+    p_ = f * p_ * f.transposed();
+    for (int i = 0; i < 3; ++i) {
+      p_(i, i) += gyro_variance_ * dt;
+      p_(i + 3, i + 3) += bias_variance_ * dt;
+    }
+  }
+
+  void observe_gravity_(const Vec3<FT>& acceleration) {
+    FT an = std::sqrt(acceleration.squared_length());
+    if (std::fabs(an - standard_gravity) > acceleration_gate_ * standard_gravity)
+      return;
+    // Measured and predicted direction of down in the sensor frame
+    FT mx = -acceleration.x() / an, my = -acceleration.y() / an, mz = -acceleration.z() / an;
+    FT dx = 2 * (q1_ * q3_ - q0_ * q2_);
+    FT dy = 2 * (q0_ * q1_ + q2_ * q3_);
+    FT dz = 1 - 2 * (q1_ * q1_ + q2_ * q2_);
+    // A small sensor frame rotation e changes the prediction by d x e
+    Matrix<1, states, FT> h;
+    h(0, 1) = -dz; h(0, 2) = dy;
+    observe_(h, mx - dx, acceleration_variance_);
+    h = Matrix<1, states, FT>();
+    h(0, 0) = dz; h(0, 2) = -dx;
+    observe_(h, my - dy, acceleration_variance_);
+    h = Matrix<1, states, FT>();
+    h(0, 0) = -dy; h(0, 1) = dx;
+    observe_(h, mz - dz, acceleration_variance_);
+  }
+
+  void observe_heading_(const Vec3<FT>& magnetic_flux) {
+    FT mx = magnetic_flux.x(), my = magnetic_flux.y(), mz = magnetic_flux.z();
+    // Horizontal part of the field in the earth frame
+    FT hx = (1 - 2 * (q2_ * q2_ + q3_ * q3_)) * mx + 2 * (q1_ * q2_ - q0_ * q3_) * my +
+            2 * (q1_ * q3_ + q0_ * q2_) * mz;
+    FT hy = 2 * (q1_ * q2_ + q0_ * q3_) * mx + (1 - 2 * (q1_ * q1_ + q3_ * q3_)) * my +
+            2 * (q2_ * q3_ - q0_ * q1_) * mz;
+    if (hx * hx + hy * hy <= std::numeric_limits<FT>::epsilon() * magnetic_flux.squared_length())
+      return;
+    // Earth frame heading error is the down row of the rotation matrix
+    // applied to the sensor frame error
+    Matrix<1, states, FT> h;
+    h(0, 0) = 2 * (q1_ * q3_ - q0_ * q2_);
+    h(0, 1) = 2 * (q0_ * q1_ + q2_ * q3_);
+    h(0, 2) = 1 - 2 * (q1_ * q1_ + q2_ * q2_);
+    observe_(h, -std::atan2(hy, hx), heading_variance_);
+  }
+
+  /// Sequential scalar update: no matrix inversion needed
+  void observe_(const Matrix<1, states, FT>& h, FT residual, const FT variance) {
+    State ph = p_ * h.transposed();
+    FT innovation_variance = variance;
+    for (int i = 0; i < states; ++i) {
+      innovation_variance += h(0, i) * ph(i, 0);
+      residual -= h(0, i) * x_(i, 0);
+    }
+    State k = ph * (1 / innovation_variance);
+    x_ += k * residual;
+    p_ -= k * ph.transposed();
+  }
+
+  void inject_() {
+    FT ex = x_(0, 0) / 2, ey = x_(1, 0) / 2, ez = x_(2, 0) / 2;
+    FT q0 = q0_, q1 = q1_, q2 = q2_, q3 = q3_;
+    q0_ = q0 - q1 * ex - q2 * ey - q3 * ez;
+    q1_ = q1 + q0 * ex + q2 * ez - q3 * ey;
+    q2_ = q2 + q0 * ey - q1 * ez + q3 * ex;
+    q3_ = q3 + q0 * ez + q1 * ey - q2 * ex;
+    normalize_();
+    bx_ += x_(3, 0);
+    by_ += x_(4, 0);
+    bz_ += x_(5, 0);
+    x_ = State();
+    p_.symmetrize();
+  }
+
+  void normalize_() {
+    FT qn = 1 / std::sqrt(q0_ * q0_ + q1_ * q1_ + q2_ * q2_ + q3_ * q3_);
+    q0_ *= qn;
+    q1_ *= qn;
+    q2_ *= qn;
+    q3_ *= qn;
+  }
+};
+
+typedef AHRS<Kalman<> > Kalman_AHRS;
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,226 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Fixed size matrices for small filters
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_MATRIX_H
+#define MRU_MATRIX_H
+
+#include "types.h"
+
+namespace mru {
+
+/**
+ * Dense matrix with dimensions fixed at compile time
+ *
+ * Storage is a plain row major array on the stack: no allocation and loops
+ * with constant bounds that the compiler can unroll. Meant for the handful
+ * of states of an orientation filter, not for general linear algebra.
+ */
+template<int Rows, int Cols, typename FT=DefaultFT>
+struct Matrix {
+  static_assert(Rows > 0 && Cols > 0, "Matrix dimensions should be positive");
+  static constexpr int rows = Rows;
+  static constexpr int cols = Cols;
+  Matrix(): m_() {}
+  explicit Matrix(const FT diagonal): m_() {
+    for (int i = 0; i < (Rows < Cols ? Rows : Cols); ++i)
+      m_[i][i] = diagonal;
+  }
+  static Matrix identity() {
+    return Matrix(1);
+  }
+  FT& operator()(const int row, const int col) {
+    return m_[row][col];
+  }
+  const FT& operator()(const int row, const int col) const {
+    return m_[row][col];
+  }
+  Matrix<Cols, Rows, FT> transposed() const {
+    Matrix<Cols, Rows, FT> result;
+    for (int i = 0; i < Rows; ++i)
+      for (int j = 0; j < Cols; ++j)
+        result(j, i) = m_[i][j];
+    return result;
+  }
+  /// Copy of the Rs by Cs block at row, col
+  template<int Rs, int Cs>
+  Matrix<Rs, Cs, FT> block(const int row, const int col) const {
+    Matrix<Rs, Cs, FT> result;
+    for (int i = 0; i < Rs; ++i)
+      for (int j = 0; j < Cs; ++j)
+        result(i, j) = m_[row + i][col + j];
+    return result;
+  }
+  template<int Rs, int Cs>
+  void set_block(const int row, const int col, const Matrix<Rs, Cs, FT>& block) {
+    for (int i = 0; i < Rs; ++i)
+      for (int j = 0; j < Cs; ++j)
+        m_[row + i][col + j] = block(i, j);
+  }
+  Matrix& operator+=(const Matrix& other) {
+    for (int i = 0; i < Rows; ++i)
+      for (int j = 0; j < Cols; ++j)
+        m_[i][j] += other.m_[i][j];
+    return *this;
+  }
+  Matrix& operator-=(const Matrix& other) {
+    for (int i = 0; i < Rows; ++i)
+      for (int j = 0; j < Cols; ++j)
+        m_[i][j] -= other.m_[i][j];
+    return *this;
+  }
+  Matrix& operator*=(const FT s) {
+    for (int i = 0; i < Rows; ++i)
+      for (int j = 0; j < Cols; ++j)
+        m_[i][j] *= s;
+    return *this;
+  }
+  /// Average with the transpose to remove rounding asymmetry
+  template<int R = Rows>
+  typename std::enable_if<R == Cols, Matrix&>::type symmetrize() {
+    for (int i = 0; i < Rows; ++i)
+      for (int j = i + 1; j < Cols; ++j)
+        m_[i][j] = m_[j][i] = (m_[i][j] + m_[j][i]) / 2;
+    return *this;
+  }
+private:
+  FT m_[Rows][Cols];
+};
+
+template<int Rows, int Cols, typename FT>
+inline Matrix<Rows, Cols, FT> operator+(Matrix<Rows, Cols, FT> a, const Matrix<Rows, Cols, FT>& b) {
+  return a += b;
+}
+
+template<int Rows, int Cols, typename FT>
+inline Matrix<Rows, Cols, FT> operator-(Matrix<Rows, Cols, FT> a, const Matrix<Rows, Cols, FT>& b) {
+  return a -= b;
+}
+
+template<int Rows, int Cols, typename FT>
+inline Matrix<Rows, Cols, FT> operator*(Matrix<Rows, Cols, FT> a, const FT s) {
+  return a *= s;
+}
+
+template<int Rows, int Inner, int Cols, typename FT>
+inline Matrix<Rows, Cols, FT> operator*(const Matrix<Rows, Inner, FT>& a, const Matrix<Inner, Cols, FT>& b) {
+  Matrix<Rows, Cols, FT> result;
+  for (int i = 0; i < Rows; ++i)
+    for (int k = 0; k < Inner; ++k) {
+      const FT aik = a(i, k);
+      for (int j = 0; j < Cols; ++j)
+        result(i, j) += aik * b(k, j);
+    }
+  return result;
+}
+
+/// Skew symmetric matrix of v: skew(v) * w equals the cross product v x w
+template<typename FT>
+inline Matrix<3, 3, FT> skew(const Vector<FT>& v) {
+  Matrix<3, 3, FT> result;
+  result(0, 1) = -v.z();
+  result(0, 2) = v.y();
+  result(1, 0) = v.z();
+  result(1, 2) = -v.x();
+  result(2, 0) = -v.y();
+  result(2, 1) = v.x();
+  return result;
+}
+
+/// Solve a x = b by Gaussian elimination with partial pivoting. Returns
+/// false when a is (numerically) singular
+template<int N, typename FT>
+bool solve(Matrix<N, N, FT> a, Matrix<N, 1, FT> b, Matrix<N, 1, FT>& x) {
+  FT scale = 0;
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j)
+      scale = std::max<FT>(scale, std::fabs(a(i, j)));
+  const FT tiny = scale * N * std::numeric_limits<FT>::epsilon();
+  for (int k = 0; k < N; ++k) {
+    int pivot = k;
+    for (int i = k + 1; i < N; ++i)
+      if (std::fabs(a(i, k)) > std::fabs(a(pivot, k)))
+        pivot = i;
+    if (!(std::fabs(a(pivot, k)) > tiny))
+      return false;
+    if (pivot != k) {
+      for (int j = k; j < N; ++j)
+        std::swap(a(k, j), a(pivot, j));
+      std::swap(b(k, 0), b(pivot, 0));
+    }
+    for (int i = k + 1; i < N; ++i) {
+      FT f = a(i, k) / a(k, k);
+      for (int j = k; j < N; ++j)
+        a(i, j) -= f * a(k, j);
+      b(i, 0) -= f * b(k, 0);
+    }
+  }
+  for (int i = N - 1; i >= 0; --i) {
+    FT sum = b(i, 0);
+    for (int j = i + 1; j < N; ++j)
+      sum -= a(i, j) * x(j, 0);
+    x(i, 0) = sum / a(i, i);
+  }
+  return true;
+}
+
+/// Eigen decomposition of a symmetric matrix by cyclic Jacobi rotations:
+/// a = vectors * diag(values) * vectors^T, eigenvectors in the columns
+template<int N, typename FT>
+void symmetric_eigen(Matrix<N, N, FT> a, Matrix<N, 1, FT>& values, Matrix<N, N, FT>& vectors) {
+  vectors = Matrix<N, N, FT>::identity();
+  for (int sweep = 0; sweep < 50; ++sweep) {
+    FT off = 0;
+    for (int p = 0; p < N; ++p)
+      for (int q = p + 1; q < N; ++q)
+        off += a(p, q) * a(p, q);
+    if (off == 0)
+      break;
+    for (int p = 0; p < N; ++p) {
+      for (int q = p + 1; q < N; ++q) {
+        if (a(p, q) == 0)
+          continue;
+        FT theta = (a(q, q) - a(p, p)) / (2 * a(p, q));
+        FT t = (theta >= 0 ? 1 : -1) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+        FT c = 1 / std::sqrt(t * t + 1);
+        FT s = t * c;
+        for (int k = 0; k < N; ++k) {
+          FT akp = a(k, p), akq = a(k, q);
+          a(k, p) = c * akp - s * akq;
+          a(k, q) = s * akp + c * akq;
+        }
+        for (int k = 0; k < N; ++k) {
+          FT apk = a(p, k), aqk = a(q, k);
+          a(p, k) = c * apk - s * aqk;
+          a(q, k) = s * apk + c * aqk;
+        }
+        for (int k = 0; k < N; ++k) {
+          FT vkp = vectors(k, p), vkq = vectors(k, q);
+          vectors(k, p) = c * vkp - s * vkq;
+          vectors(k, q) = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < N; ++i)
+    values(i, 0) = a(i, i);
+}
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
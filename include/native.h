@@ -0,0 +1,188 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Small fixed layout vector, quaternion and affine types
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_NATIVE_H
+#define MRU_NATIVE_H
+
+#include <cmath>
+#include <ostream>
+#include <type_traits>
+
+#include <CGAL/Simple_cartesian.h>
+#include <CGAL/Vector_3.h>
+
+namespace mru {
+
+/**
+ * Three component vector padded to four
+ *
+ * Unlike the CGAL types, the storage is plain members with a known layout:
+ * trivially copyable, so buffers of them can be copied with memcpy, and
+ * aligned to a full vector register so loops over arrays of them can be
+ * vectorized. All arithmetic is constexpr. The accessors are those of the
+ * CGAL vector, and it converts to and from one, so samples can store Vec3
+ * while code that computes with CGAL vectors reads them unchanged.
+ */
+template<typename FT>
+struct alignas(4 * sizeof(FT)) Vec3 {
+  typedef typename CGAL::Simple_cartesian<FT>::Vector_3 Cgal_type;
+  FT c[3];
+  constexpr Vec3(): c{0, 0, 0} {}
+  constexpr Vec3(const FT x, const FT y, const FT z): c{x, y, z} {}
+  Vec3(const Cgal_type& v): c{v.x(), v.y(), v.z()} {}
+  operator Cgal_type() const { return Cgal_type(c[0], c[1], c[2]); }
+  constexpr FT x() const { return c[0]; }
+  constexpr FT y() const { return c[1]; }
+  constexpr FT z() const { return c[2]; }
+  constexpr FT operator[](const int i) const { return c[i]; }
+  constexpr Vec3 operator-() const { return Vec3(-c[0], -c[1], -c[2]); }
+  constexpr Vec3 operator+(const Vec3& v) const { return Vec3(c[0] + v.c[0], c[1] + v.c[1], c[2] + v.c[2]); }
+  constexpr Vec3 operator-(const Vec3& v) const { return Vec3(c[0] - v.c[0], c[1] - v.c[1], c[2] - v.c[2]); }
+  constexpr Vec3 operator*(const FT s) const { return Vec3(c[0] * s, c[1] * s, c[2] * s); }
+  constexpr Vec3 operator/(const FT s) const { return Vec3(c[0] / s, c[1] / s, c[2] / s); }
+  Vec3& operator+=(const Vec3& v) { c[0] += v.c[0]; c[1] += v.c[1]; c[2] += v.c[2]; return *this; }
+  Vec3& operator-=(const Vec3& v) { c[0] -= v.c[0]; c[1] -= v.c[1]; c[2] -= v.c[2]; return *this; }
+  Vec3& operator*=(const FT s) { c[0] *= s; c[1] *= s; c[2] *= s; return *this; }
+  constexpr FT squared_length() const { return c[0] * c[0] + c[1] * c[1] + c[2] * c[2]; }
+  FT length() const { return std::sqrt(squared_length()); }
+};
+
+template<typename FT>
+constexpr Vec3<FT> operator*(const FT s, const Vec3<FT>& v) { return v * s; }
+
+template<typename FT>
+constexpr FT dot(const Vec3<FT>& a, const Vec3<FT>& b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+template<typename FT>
+constexpr Vec3<FT> cross(const Vec3<FT>& a, const Vec3<FT>& b) {
+  return Vec3<FT>(a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]);
+}
+
+/// Written like a CGAL vector: the components separated by spaces
+template<typename FT>
+std::ostream& operator<<(std::ostream& os, const Vec3<FT>& v) {
+  return os << v[0] << ' ' << v[1] << ' ' << v[2];
+}
+
+/// Quaternion w + xi + yj + zk, same conventions as Quaternion in types.h
+template<typename FT>
+struct alignas(4 * sizeof(FT)) Quat {
+  FT w, x, y, z;
+  constexpr Quat(): w(1), x(0), y(0), z(0) {}
+  constexpr Quat(const FT w, const FT x, const FT y, const FT z): w(w), x(x), y(y), z(z) {}
+  constexpr Quat(const FT w, const Vec3<FT>& v): w(w), x(v[0]), y(v[1]), z(v[2]) {}
+  constexpr Vec3<FT> vector() const { return Vec3<FT>(x, y, z); }
+  constexpr Quat conjugate() const { return Quat(w, -x, -y, -z); }
+  constexpr FT squared_length() const { return w * w + x * x + y * y + z * z; }
+  constexpr Quat operator*(const Quat& r) const {
+    return Quat(w * r.w - x * r.x - y * r.y - z * r.z,
+                w * r.x + x * r.w + y * r.z - z * r.y,
+                w * r.y - x * r.z + y * r.w + z * r.x,
+                w * r.z + x * r.y - y * r.x + z * r.w);
+  }
+  constexpr Quat operator*(const FT s) const { return Quat(w * s, x * s, y * s, z * s); }
+  /// q v q* for a unit quaternion, without the zero terms of the full products
+  constexpr Vec3<FT> rotate(const Vec3<FT>& v) const {
+    return rotate_(v, cross(vector(), v) * FT(2));
+  }
+  Quat normalized() const { return *this * (1 / std::sqrt(squared_length())); }
+private:
+  constexpr Vec3<FT> rotate_(const Vec3<FT>& v, const Vec3<FT>& t) const {
+    return v + t * w + cross(vector(), t);
+  }
+};
+
+/// Affine transformation: 3x3 matrix and a translation in the last column
+template<typename FT>
+struct alignas(4 * sizeof(FT)) Mat3x4 {
+  FT m[3][4];
+  static constexpr Mat3x4 identity() {
+    return Mat3x4{{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+  }
+  constexpr FT operator()(const int row, const int col) const { return m[row][col]; }
+  /// Transform a point: matrix product plus translation
+  constexpr Vec3<FT> operator()(const Vec3<FT>& p) const {
+    return Vec3<FT>(
+        m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+        m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+        m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+  }
+  /// Transform a direction: matrix product only
+  constexpr Vec3<FT> linear(const Vec3<FT>& v) const {
+    return Vec3<FT>(
+        m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+        m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+        m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+  }
+  /// This transformation applied after t
+  constexpr Mat3x4 operator*(const Mat3x4& t) const {
+    return Mat3x4{{
+        {entry_(0, 0, t), entry_(0, 1, t), entry_(0, 2, t), entry_(0, 3, t)},
+        {entry_(1, 0, t), entry_(1, 1, t), entry_(1, 2, t), entry_(1, 3, t)},
+        {entry_(2, 0, t), entry_(2, 1, t), entry_(2, 2, t), entry_(2, 3, t)}}};
+  }
+private:
+  constexpr FT entry_(const int i, const int j, const Mat3x4& t) const {
+    return m[i][0] * t.m[0][j] + m[i][1] * t.m[1][j] + m[i][2] * t.m[2][j] + (j == 3 ? m[i][3] : 0);
+  }
+};
+
+static_assert(std::is_trivially_copyable<Vec3<float> >::value, "Vec3 should be trivially copyable");
+static_assert(std::is_trivially_copyable<Quat<float> >::value, "Quat should be trivially copyable");
+static_assert(std::is_trivially_copyable<Mat3x4<float> >::value, "Mat3x4 should be trivially copyable");
+static_assert(sizeof(Vec3<float>) == 16, "Vec3<float> should fill 16 bytes");
+static_assert(sizeof(Quat<float>) == 16, "Quat<float> should fill 16 bytes");
+static_assert(sizeof(Mat3x4<float>) == 48, "Mat3x4<float> should be three rows of 16 bytes");
+
+// Conversion to and from the CGAL transformation. The CGAL types are
+// aliases that don't deduce, so the conversions to native take an explicit FT.
+// Vectors convert implicitly; quaternions are in types.h
+
+template<typename FT>
+inline Vec3<FT> to_native(const typename CGAL::Simple_cartesian<FT>::Vector_3& v) {
+  return Vec3<FT>(v);
+}
+
+template<typename FT>
+inline typename CGAL::Simple_cartesian<FT>::Vector_3 to_cgal(const Vec3<FT>& v) {
+  return v;
+}
+
+template<typename FT>
+inline Mat3x4<FT> to_native(const typename CGAL::Simple_cartesian<FT>::Aff_transformation_3& t) {
+  Mat3x4<FT> result;
+  for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 4; ++j)
+      result.m[i][j] = t.m(i, j);
+  return result;
+}
+
+template<typename FT>
+inline typename CGAL::Simple_cartesian<FT>::Aff_transformation_3 to_cgal(const Mat3x4<FT>& t) {
+  return typename CGAL::Simple_cartesian<FT>::Aff_transformation_3(
+      t.m[0][0], t.m[0][1], t.m[0][2], t.m[0][3],
+      t.m[1][0], t.m[1][1], t.m[1][2], t.m[1][3],
+      t.m[2][0], t.m[2][1], t.m[2][2], t.m[2][3]);
+}
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,313 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Multi-threaded processing pipelines of sample batches
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_PIPELINE_H
+#define MRU_PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "errors.h"
+
+namespace mru {
+
+/**
+ * Bounded lock free queue for one producer and one consumer thread
+ *
+ * The capacity is rounded up to a power of two. Head and tail are free
+ * running counters on their own cache lines; each side keeps a copy of the
+ * other side's counter and only reloads it when the queue looks full or
+ * empty, so in steady state a push or pop touches no shared cache line but
+ * its own.
+ */
+template<typename T>
+struct Spsc_queue {
+  explicit Spsc_queue(const size_t capacity):
+      slots_(round_up_(capacity)), mask_(slots_.size() - 1),
+      head_(0), tail_cache_(0), tail_(0), head_cache_(0) {
+    if (capacity == 0)
+      throw Error("Queue capacity should be positive");
+  }
+  Spsc_queue(const Spsc_queue&) = delete;
+  Spsc_queue& operator=(const Spsc_queue&) = delete;
+  size_t capacity() const { return slots_.size(); }
+  /// Number of queued values. Exact only on the producer or consumer thread
+  /// while the other one is idle.
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+  bool empty() const { return size() == 0; }
+  /// Producer side. False when full; value is left untouched then.
+  bool try_push(T&& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == slots_.size()) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == slots_.size())
+        return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+  bool try_push(const T& value) {
+    T copy(value);
+    return try_push(std::move(copy));
+  }
+  /// Consumer side. False when empty.
+  bool try_pop(T& value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_)
+        return false;
+    }
+    value = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+private:
+  static constexpr size_t cache_line = 64;
+  std::vector<T> slots_;
+  size_t mask_;
+  // Consumer's line
+  alignas(cache_line) std::atomic<size_t> head_;
+  size_t tail_cache_;
+  // Producer's line
+  alignas(cache_line) std::atomic<size_t> tail_;
+  size_t head_cache_;
+
+  static size_t round_up_(const size_t capacity) {
+    size_t result = 1;
+    while (result < capacity)
+      result <<= 1;
+    return result;
+  }
+};
+
+/// What a producer does when the queue to the next stage is full
+enum class Backpressure {
+  /// Wait for room: nothing is lost, but a slow consumer stalls the producer
+  Block,
+  /// Drop the batch and count it: the producer keeps its timing
+  Drop,
+};
+
+/// Samples (or anything else) handed from stage to stage in one go
+template<typename T>
+using Batch = std::vector<T>;
+
+namespace detail {
+
+/// Waiting for a queue: a few yields first, then short sleeps
+struct Backoff {
+  Backoff(): count_(0) {}
+  void wait() {
+    if (count_ < 64) {
+      ++count_;
+      std::this_thread::yield();
+    }
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+private:
+  int count_;
+};
+
+struct Channel_base {
+  Channel_base(): closed_(false), cancelled_(false) {}
+  virtual ~Channel_base() {}
+  /// No more batches will be pushed. Consumers drain what is queued.
+  void close() { closed_.store(true, std::memory_order_release); }
+  /// Stop at once: blocked producers and consumers return without a batch
+  void cancel() { cancelled_.store(true, std::memory_order_release); }
+  bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+protected:
+  std::atomic<bool> closed_;
+  std::atomic<bool> cancelled_;
+};
+
+}  // namespace detail
+
+/**
+ * Connection between two pipeline stages
+ *
+ * A bounded SPSC queue of batches with a backpressure policy. Batches are
+ * moved through it, not copied.
+ */
+template<typename T>
+struct Channel: public detail::Channel_base {
+  typedef Batch<T> Batch_type;
+  Channel(const size_t capacity, const Backpressure backpressure):
+      queue_(capacity), backpressure_(backpressure), dropped_(0) {}
+  size_t capacity() const { return queue_.capacity(); }
+  Backpressure backpressure() const { return backpressure_; }
+  /// Number of batches queued
+  size_t size() const { return queue_.size(); }
+  /// Number of batches dropped because the queue was full
+  size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  /// Producer side. False when the batch was dropped or the channel cancelled.
+  bool push(Batch_type&& batch) {
+    detail::Backoff backoff;
+    while (!queue_.try_push(std::move(batch))) {
+      if (backpressure_ == Backpressure::Drop) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      if (cancelled())
+        return false;
+      backoff.wait();
+    }
+    return true;
+  }
+  /// Consumer side: waits for a batch. False once the channel is closed and
+  /// drained, or cancelled.
+  bool pop(Batch_type& batch) {
+    detail::Backoff backoff;
+    while (!queue_.try_pop(batch)) {
+      if (cancelled())
+        return false;
+      // Closed is only final when nothing was pushed before it
+      if (closed_.load(std::memory_order_acquire))
+        return queue_.try_pop(batch);
+      backoff.wait();
+    }
+    return true;
+  }
+private:
+  Spsc_queue<Batch_type> queue_;
+  Backpressure backpressure_;
+  std::atomic<size_t> dropped_;
+};
+
+/// Thread placement of a stage: the CPU to pin it to, or any CPU
+struct Placement {
+  Placement(const int cpu=-1): cpu(cpu) {}
+  int cpu;
+};
+
+/**
+ * Threads of processing stages connected by channels
+ *
+ * A source produces batches, for instance by polling chips; stages turn
+ * input batches into output batches (calibrate, filter, fuse); sinks
+ * consume batches (record, publish). Each runs on a thread of its own,
+ * optionally pinned to a CPU, so heavy stages like spectra or logging don't
+ * disturb the timing of acquisition. Channels are created by the pipeline
+ * and each one connects exactly one producer to one consumer.
+ *
+ * stop() asks the sources to finish; what was produced is then processed
+ * through to the sinks before the threads end. An exception in any stage
+ * cancels the whole pipeline and is rethrown by stop() or wait().
+ */
+struct Pipeline {
+  Pipeline();
+  ~Pipeline();
+  Pipeline(const Pipeline&) = delete;
+  Pipeline& operator=(const Pipeline&) = delete;
+
+  template<typename T>
+  Channel<T>& channel(const size_t capacity, const Backpressure backpressure=Backpressure::Block) {
+    Channel<T>* result = new Channel<T>(capacity, backpressure);
+    channels_.push_back(std::unique_ptr<detail::Channel_base>(result));
+    return *result;
+  }
+
+  /// produce(Batch<T>&) fills a batch and returns false when there is
+  /// nothing more to come. It is called until then or until stop(). Empty
+  /// batches are not passed on. The source does its own pacing.
+  template<typename T, class Produce>
+  void source(Channel<T>& out, Produce produce, const Placement& placement=Placement()) {
+    add_task_([this, &out, produce]() {
+      Batch<T> batch;
+      while (!stopping_.load(std::memory_order_acquire)) {
+        batch.clear();
+        bool more = produce(batch);
+        if (!batch.empty())
+          out.push(std::move(batch));
+        if (!more)
+          break;
+      }
+      out.close();
+    }, placement);
+  }
+
+  /// process(const Batch<In>&, Batch<Out>&) turns each input batch into an
+  /// output batch, which is passed on unless empty
+  template<typename In, typename Out, class Process>
+  void stage(Channel<In>& in, Channel<Out>& out, Process process,
+             const Placement& placement=Placement()) {
+    add_task_([&in, &out, process]() {
+      Batch<In> batch;
+      Batch<Out> result;
+      while (in.pop(batch)) {
+        result.clear();
+        process(batch, result);
+        if (!result.empty())
+          out.push(std::move(result));
+      }
+      out.close();
+    }, placement);
+  }
+
+  /// consume(const Batch<T>&) gets every batch that reaches the sink
+  template<typename T, class Consume>
+  void sink(Channel<T>& in, Consume consume, const Placement& placement=Placement()) {
+    add_task_([&in, consume]() {
+      Batch<T> batch;
+      while (in.pop(batch))
+        consume(batch);
+    }, placement);
+  }
+
+  /// Start the threads of all stages. A pipeline runs once: its channels
+  /// are closed when it stops.
+  void start();
+  /// Ask the sources to finish and wait until everything is processed
+  void stop();
+  /// Wait until the sources finished by themselves and everything is processed
+  void wait();
+  bool running() const { return !threads_.empty(); }
+private:
+  struct Task {
+    std::function<void()> body;
+    Placement placement;
+  };
+  std::vector<std::unique_ptr<detail::Channel_base> > channels_;
+  std::vector<Task> tasks_;
+  std::vector<std::thread> threads_;
+  bool started_;
+  std::atomic<bool> stopping_;
+  std::mutex mutex_;
+  std::exception_ptr error_;
+
+  void add_task_(const std::function<void()>& body, const Placement& placement);
+  void run_(const Task& task);
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,91 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Values replaced by one thread while others read them without locks
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_PUBLISHED_H
+#define MRU_PUBLISHED_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace mru {
+
+/**
+ * Immutable value that can be replaced while other threads read it
+ *
+ * A reader gets a pointer to the current value with one acquire load: no
+ * lock, no reference count and no copy, so it costs next to nothing in the
+ * sample path. A replacement publishes a new value with a release store.
+ * The value it replaces may still be in use by a reader, so it is retired
+ * instead of deleted: retired values live as long as the Published, unless
+ * reclaim() frees them at a moment no reader can hold one (e.g. while the
+ * chips are stopped). Pointers from get() stay valid until then.
+ *
+ * Meant for values that are replaced rarely, such as calibrations on a
+ * reload of their file, so the retired ones stay few. Writers are
+ * serialized among themselves.
+ */
+template<typename T>
+struct Published {
+  /// Nothing published: get() returns null
+  Published(): current_(nullptr), mutex_(), retired_() {}
+  explicit Published(const T& value): Published() { emplace(value); }
+  ~Published() { delete current_.load(std::memory_order_relaxed); }
+  Published(const Published&) = delete;
+  Published& operator=(const Published&) = delete;
+
+  /// Current value, or null
+  const T* get() const { return current_.load(std::memory_order_acquire); }
+  /// Publish a T constructed from args
+  template<typename... Args>
+  void emplace(Args&&... args) { publish_(new T(std::forward<Args>(args)...)); }
+  /// Publish nothing: readers get null from now on
+  void reset() { publish_(nullptr); }
+  /// Number of replaced values kept for readers
+  size_t retired() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return retired_.size();
+  }
+  /// Free the replaced values. Only when no reader can be using one
+  void reclaim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    retired_.clear();
+  }
+private:
+  std::atomic<const T*> current_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<const T> > retired_;
+
+  void publish_(const T* value) {
+    std::unique_ptr<const T> owned(value);
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Room first, so a failing push_back can't leave the old value unowned
+    retired_.reserve(retired_.size() + 1);
+    const T* old = current_.exchange(owned.release(), std::memory_order_acq_rel);
+    if (old)
+      retired_.push_back(std::unique_ptr<const T>(old));
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,137 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Shared calibrations that follow changes of the calibration file
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_REGISTRY_H
+#define MRU_REGISTRY_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <string>
+#include <exception>
+#include <functional>
+
+#include "types.h"
+#include "calibration.h"
+#include "published.h"
+
+namespace mru {
+
+/**
+ * Calls a handler from a background thread whenever a file is written
+ *
+ * The directory is watched rather than the file itself, so a file that is
+ * replaced by a rename, as many editors do, keeps being followed.
+ */
+struct File_watcher {
+  typedef std::function<void()> Change_handler;
+  File_watcher(const std::string& filename, const Change_handler& handler);
+  ~File_watcher();
+  File_watcher(const File_watcher&) = delete;
+  File_watcher& operator=(const File_watcher&) = delete;
+private:
+  std::string name_;
+  Change_handler handler_;
+  int inotify_;
+  int stop_[2];
+  std::thread thread_;
+  void run_();
+};
+
+/**
+ * Calibrations of a file parsed once and shared by all chips
+ *
+ * The parsed file is an immutable Calibration_set, published through an
+ * atomic pointer: a snapshot is one acquire load, without locks. A reload
+ * parses into a new set and swaps the pointer; the old set is kept until
+ * the registry goes or reclaim(), so snapshots taken before stay valid and
+ * nobody ever waits for a reload. Attached chips get their calibration
+ * pushed into them on every reload, which they pick up at the next poll.
+ *
+ * A file that fails to parse leaves the current set in place. Writers
+ * should replace the file by a rename, as save_calibration does, so a half
+ * written file is never seen. Attached chips should outlive the registry.
+ */
+template<typename FT=DefaultFT>
+struct Calibration_registry {
+  /// Valid until the registry goes or reclaim()
+  typedef const Calibration_set<FT>* Snapshot;
+  Calibration_registry(const std::string& filename, const bool watch=true):
+      filename_(filename), snapshot_(Calibration_set<FT>()),
+      generation_(0), mutex_(), subscribers_(), watcher_() {
+    reload();
+    if (watch)
+      watcher_.reset(new File_watcher(filename, [this]() { reload(); }));
+  }
+  const std::string& filename() const { return filename_; }
+  Snapshot snapshot() const { return snapshot_.get(); }
+  /// Number of successful loads so far
+  int generation() const { return generation_; }
+  Calibration<FT> calibration(const std::string& section) const {
+    return snapshot()->calibration(section);
+  }
+  Temperature_model<FT> temperature_model(const std::string& section) const {
+    return snapshot()->temperature_model(section);
+  }
+  /// Parse the file again and swap it in. False when it can't be parsed
+  bool reload() {
+    Calibration_set<FT> loaded;
+    try {
+      loaded = load_calibration_set<FT>(filename_);
+    }
+    catch (const std::exception&) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    snapshot_.emplace(std::move(loaded));
+    ++generation_;
+    for (auto& subscriber: subscribers_)
+      subscriber(*snapshot_.get());
+    return true;
+  }
+  /// Free the sets replaced by reloads. Only when no snapshot of them is in
+  /// use any more
+  void reclaim() { snapshot_.reclaim(); }
+  /// Keep the calibration and temperature model of a chip up to date
+  template<class Chip>
+  void attach(Chip& chip) {
+    std::string section = chip.chip_name();
+    auto apply = [&chip, section](const Calibration_set<FT>& set) {
+      chip.set_calibration(set.calibration(section));
+      chip.set_temperature_model(set.temperature_model(section));
+    };
+    std::lock_guard<std::mutex> lock(mutex_);
+    apply(*snapshot_.get());
+    subscribers_.push_back(apply);
+  }
+private:
+  std::string filename_;
+  Published<Calibration_set<FT> > snapshot_;
+  std::atomic<int> generation_;
+  std::mutex mutex_;
+  std::vector<std::function<void(const Calibration_set<FT>&)> > subscribers_;
+  std::unique_ptr<File_watcher> watcher_;
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
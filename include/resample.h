@@ -0,0 +1,285 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Resampling of several sensor streams onto a common time base
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_RESAMPLE_H
+#define MRU_RESAMPLE_H
+
+#include <cmath>
+#include <deque>
+#include <tuple>
+#include <type_traits>
+
+#include "types.h"
+#include "stream.h"
+#include "rotations.h"
+
+namespace mru {
+
+enum class Interpolation {
+  Linear,
+  Cubic,
+};
+
+namespace detail {
+
+template<int... Is>
+struct Indices {};
+template<int N, int... Is>
+struct Make_indices: Make_indices<N - 1, N - 1, Is...> {};
+template<int... Is>
+struct Make_indices<0, Is...> {
+  typedef Indices<Is...> type;
+};
+
+/// Interpolation of values that form a vector space: scalars and vectors
+template<typename T, typename FT>
+struct Interpolator {
+  static constexpr bool cubic = true;
+  static T linear(const T& a, const T& b, const FT u) {
+    return a + (b - a) * u;
+  }
+};
+
+/// Angles interpolate along the shorter way round
+template<int MinQ, int MaxQ, typename FT>
+struct Interpolator<RotScalar<MinQ, MaxQ, FT>, FT> {
+  static constexpr bool cubic = false;
+  typedef RotScalar<MinQ, MaxQ, FT> T;
+  static T linear(const T& a, const T& b, const FT u) {
+    return T(a.get_value() + (b - a).get_value() * u);
+  }
+};
+
+template<typename FT>
+struct Interpolator<UnitQuaternion<FT>, FT> {
+  static constexpr bool cubic = false;
+  typedef UnitQuaternion<FT> T;
+  static T linear(const T& a, const T& b, const FT u) {
+    return slerp(a, b, u);
+  }
+};
+
+/**
+ * Recent samples of one quantity
+ *
+ * Holds only what interpolation at the next output time needs: the last
+ * sample at or before it, one more before that for cubic tangents, and
+ * whatever arrived after it.
+ */
+template<typename T, typename FT>
+struct Resample_buffer {
+  typedef Interpolator<T, FT> Interpolator_type;
+  bool empty() const { return entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+  /// True when there is a sample at or before t
+  bool covers(const double t) const { return !entries_.empty() && entries_.front().t <= t; }
+  void push(const double t, const T& value) {
+    // Out of order samples would break the search below
+    if (!entries_.empty() && t <= entries_.back().t)
+      return;
+    entries_.push_back(Entry{t, value});
+  }
+  /// Drop samples no longer needed for output times from t on
+  void trim(const double t, const Interpolation interpolation) {
+    const size_t keep = interpolation == Interpolation::Cubic && Interpolator_type::cubic ? 2 : 1;
+    while (entries_.size() > keep && entries_[keep].t <= t)
+      entries_.pop_front();
+  }
+  /// Value at t. Outside the buffered samples the nearest one is held.
+  T at(const double t, const Interpolation interpolation) const {
+    size_t j = 0;
+    while (j < entries_.size() && entries_[j].t <= t)
+      ++j;
+    if (j == 0)
+      return entries_.front().value;
+    if (j == entries_.size())
+      return entries_.back().value;
+    const Entry& a = entries_[j - 1];
+    const Entry& b = entries_[j];
+    const FT u = (t - a.t) / (b.t - a.t);
+    if (interpolation == Interpolation::Cubic)
+      return cubic_(j, u, std::integral_constant<bool, Interpolator_type::cubic>());
+    return Interpolator_type::linear(a.value, b.value, u);
+  }
+private:
+  struct Entry {
+    double t;
+    T value;
+  };
+  std::deque<Entry> entries_;
+
+  T cubic_(const size_t j, const FT u, std::false_type) const {
+    return Interpolator_type::linear(entries_[j - 1].value, entries_[j].value, u);
+  }
+  /// Cubic Hermite between samples j - 1 and j with finite difference
+  /// tangents, one sided at the ends of the buffer
+  T cubic_(const size_t j, const FT u, std::true_type) const {
+    const Entry& a = entries_[j - 1];
+    const Entry& b = entries_[j];
+    const Entry& before = j >= 2 ? entries_[j - 2] : a;
+    const Entry& after = j + 1 < entries_.size() ? entries_[j + 1] : b;
+    const FT h = b.t - a.t;
+    // Tangents scaled by the interval
+    const T ma = (b.value - before.value) * FT(h / (b.t - before.t));
+    const T mb = (after.value - a.value) * FT(h / (after.t - a.t));
+    const FT u2 = u * u, u3 = u2 * u;
+    return a.value * (2 * u3 - 3 * u2 + 1) + ma * (u3 - 2 * u2 + u)
+        + b.value * (3 * u2 - 2 * u3) + mb * (u3 - u2);
+  }
+};
+
+}  // namespace detail
+
+/**
+ * Streams of several chips aligned on one output clock
+ *
+ * Chips sample on their own clocks and at their own rates. Their samples go
+ * in through add() or by attaching the chips, and every period a Sample with
+ * all quantities interpolated at the same time comes out. Output for time t
+ * is produced once the newest input is latency past t, so streams that lag
+ * by less than the latency (FIFO drains, slow conversions) still contribute
+ * real samples on both sides of t. A stream without a sample after t holds
+ * its last value.
+ *
+ * Output times are whole periods from the first input. Until every quantity
+ * has a sample at or before an output time, no output is produced.
+ *
+ * Vectors and scalars interpolate linearly or with cubic Hermite splines,
+ * rotations with slerp and angles linearly along the shorter way round.
+ */
+template<typename FT, Quantity... Qs>
+struct Sensor_group: public Sample_stream<FT, Qs...> {
+  typedef typename Sample_stream<FT, Qs...>::Sample_type Sample_type;
+  Sensor_group(const Duration& period, const Duration& latency,
+               const Interpolation interpolation=Interpolation::Linear):
+      period_(seconds_(period)), latency_(seconds_(latency)), interpolation_(interpolation),
+      buffers_(), origin_(), started_(false), frontier_(0), next_(0) {
+    if (!(period_ > 0))
+      throw Error("Resampling period should be positive");
+  }
+  Duration period() const { return to_duration_(period_); }
+  Duration latency() const { return to_duration_(latency_); }
+  /// Number of input samples held over all quantities
+  size_t buffered() const { return buffered_(typename detail::Make_indices<sizeof...(Qs)>::type()); }
+
+  /// Add one input sample of a quantity
+  template<Quantity Q>
+  void add(const Time& time, const typename Quantity_type<Q, FT>::type& value) {
+    push_<Q>(time, value);
+    advance_(time);
+  }
+  /// Add the quantities of a chip sample that are part of this group
+  template<Quantity... Ss>
+  void add_sample(const Sample<FT, Ss...>& sample) {
+    push_sample_(sample);
+    advance_(sample.time);
+  }
+  /// Feed every sample of a stream into the group. This takes the stream's
+  /// sample handler.
+  template<class Stream>
+  void attach(Stream& stream) {
+    stream.set_sample_handler([this](const typename Stream::Sample_type& sample) {
+      add_sample(sample);
+    });
+  }
+private:
+  typedef std::tuple<detail::Resample_buffer<typename Quantity_type<Qs, FT>::type, FT>...> Buffers;
+  double period_;
+  double latency_;
+  Interpolation interpolation_;
+  Buffers buffers_;
+  Time origin_;
+  bool started_;
+  /// Newest input time
+  double frontier_;
+  /// Index of the next output period
+  long next_;
+
+  static double seconds_(const Duration& duration) {
+    return to_seconds(duration);
+  }
+  static Duration to_duration_(const double seconds) {
+    return from_nanoseconds(std::llround(seconds * 1E9));
+  }
+  double offset_(const Time& time) {
+    if (!started_) {
+      origin_ = time;
+      started_ = true;
+    }
+    return seconds_(time - origin_);
+  }
+
+  template<Quantity Q>
+  typename std::enable_if<Has_quantity<Q, Qs...>::value>::type
+  push_(const Time& time, const typename Quantity_type<Q, FT>::type& value) {
+    std::get<Quantity_index<Q, Qs...>::value>(buffers_).push(offset_(time), value);
+  }
+  template<Quantity Q>
+  typename std::enable_if<!Has_quantity<Q, Qs...>::value>::type
+  push_(const Time&, const typename Quantity_type<Q, FT>::type&) {}
+
+  template<Quantity... Ss>
+  void push_sample_(const Sample<FT, Ss...>& sample) {
+    int dummy[] = { 0, (push_<Ss>(sample.time, get<FT, Ss>(sample)), 0)... };
+    (void)dummy;
+  }
+
+  void advance_(const Time& time) {
+    frontier_ = std::max(frontier_, offset_(time));
+    typename detail::Make_indices<sizeof...(Qs)>::type indices;
+    while (next_ * period_ + latency_ <= frontier_) {
+      const double t = next_ * period_;
+      if (covered_(t, indices))
+        this->push_sample(sample_(t, indices));
+      ++next_;
+      trim_(next_ * period_, indices);
+    }
+  }
+
+  template<int... Is>
+  size_t buffered_(detail::Indices<Is...>) const {
+    size_t sizes[] = { std::get<Is>(buffers_).size()... };
+    size_t result = 0;
+    for (auto s: sizes)
+      result += s;
+    return result;
+  }
+  template<int... Is>
+  bool covered_(const double t, detail::Indices<Is...>) const {
+    bool covered[] = { std::get<Is>(buffers_).covers(t)... };
+    for (auto c: covered)
+      if (!c)
+        return false;
+    return true;
+  }
+  template<int... Is>
+  void trim_(const double t, detail::Indices<Is...>) {
+    int dummy[] = { (std::get<Is>(buffers_).trim(t, interpolation_), 0)... };
+    (void)dummy;
+  }
+  template<int... Is>
+  Sample_type sample_(const double t, detail::Indices<Is...>) const {
+    const Time time = origin_ + to_duration_(t);
+    return Sample_type(time, std::get<Is>(buffers_).at(t, interpolation_)...);
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
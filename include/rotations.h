@@ -0,0 +1,296 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Quaternion operations on whole arrays
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_ROTATIONS_H
+#define MRU_ROTATIONS_H
+
+#include <cmath>
+#include <vector>
+
+#include "types.h"
+#include "native.h"
+
+namespace mru {
+
+/**
+ * Vectors stored as separate x, y and z arrays
+ *
+ * With one array per component the same operation on consecutive vectors
+ * touches consecutive memory, which is what the vectorizer needs.
+ */
+template<typename FT=DefaultFT>
+struct Vector_array {
+  Vector_array(const size_t size=0): x(size), y(size), z(size) {}
+  size_t size() const { return x.size(); }
+  void resize(const size_t size) {
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+  }
+  Vector<FT> get(const size_t i) const { return Vector<FT>(x[i], y[i], z[i]); }
+  void set(const size_t i, const Vector<FT>& v) {
+    x[i] = v.x();
+    y[i] = v.y();
+    z[i] = v.z();
+  }
+  void push_back(const Vector<FT>& v) {
+    x.push_back(v.x());
+    y.push_back(v.y());
+    z.push_back(v.z());
+  }
+  std::vector<FT> x;
+  std::vector<FT> y;
+  std::vector<FT> z;
+};
+
+/// Quaternions stored as separate w, x, y and z arrays
+template<typename FT=DefaultFT>
+struct Quaternion_array {
+  Quaternion_array(const size_t size=0): w(size, 1), x(size), y(size), z(size) {}
+  size_t size() const { return w.size(); }
+  void resize(const size_t size) {
+    w.resize(size, 1);
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+  }
+  UnitQuaternion<FT> get(const size_t i) const { return UnitQuaternion<FT>(w[i], x[i], y[i], z[i]); }
+  void set(const size_t i, const Quaternion<FT>& q) {
+    w[i] = q.qr();
+    x[i] = q.qi();
+    y[i] = q.qj();
+    z[i] = q.qk();
+  }
+  void push_back(const Quaternion<FT>& q) {
+    w.push_back(q.qr());
+    x.push_back(q.qi());
+    y.push_back(q.qj());
+    z.push_back(q.qk());
+  }
+  std::vector<FT> w;
+  std::vector<FT> x;
+  std::vector<FT> y;
+  std::vector<FT> z;
+};
+
+/// Rotation matrix of a unit quaternion, as an affine transformation without translation
+template<typename FT>
+constexpr Mat3x4<FT> rotation_matrix(const Quat<FT>& q) {
+  return Mat3x4<FT>{{
+      {1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y - q.z * q.w), 2 * (q.x * q.z + q.y * q.w), 0},
+      {2 * (q.x * q.y + q.z * q.w), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z - q.x * q.w), 0},
+      {2 * (q.x * q.z - q.y * q.w), 2 * (q.y * q.z + q.x * q.w), 1 - 2 * (q.x * q.x + q.y * q.y), 0}}};
+}
+
+namespace detail {
+
+template<typename FT>
+void rotate_by_matrix(const Mat3x4<FT>& r, const size_t n,
+                      const FT* __restrict x, const FT* __restrict y, const FT* __restrict z,
+                      FT* __restrict ox, FT* __restrict oy, FT* __restrict oz) {
+  const FT r00 = r.m[0][0], r01 = r.m[0][1], r02 = r.m[0][2];
+  const FT r10 = r.m[1][0], r11 = r.m[1][1], r12 = r.m[1][2];
+  const FT r20 = r.m[2][0], r21 = r.m[2][1], r22 = r.m[2][2];
+  for (size_t i = 0; i < n; ++i) {
+    const FT vx = x[i], vy = y[i], vz = z[i];
+    ox[i] = r00 * vx + r01 * vy + r02 * vz;
+    oy[i] = r10 * vx + r11 * vy + r12 * vz;
+    oz[i] = r20 * vx + r21 * vy + r22 * vz;
+  }
+}
+
+template<typename FT>
+void rotate_each(const size_t n,
+                 const FT* __restrict qw, const FT* __restrict qx,
+                 const FT* __restrict qy, const FT* __restrict qz,
+                 const FT* __restrict x, const FT* __restrict y, const FT* __restrict z,
+                 FT* __restrict ox, FT* __restrict oy, FT* __restrict oz) {
+  for (size_t i = 0; i < n; ++i) {
+    // v + w t + q x t with t = 2 q x v
+    const FT tx = 2 * (qy[i] * z[i] - qz[i] * y[i]);
+    const FT ty = 2 * (qz[i] * x[i] - qx[i] * z[i]);
+    const FT tz = 2 * (qx[i] * y[i] - qy[i] * x[i]);
+    ox[i] = x[i] + qw[i] * tx + (qy[i] * tz - qz[i] * ty);
+    oy[i] = y[i] + qw[i] * ty + (qz[i] * tx - qx[i] * tz);
+    oz[i] = z[i] + qw[i] * tz + (qx[i] * ty - qy[i] * tx);
+  }
+}
+
+template<typename FT>
+void compose(const size_t n,
+             const FT* __restrict aw, const FT* __restrict ax,
+             const FT* __restrict ay, const FT* __restrict az,
+             const FT* __restrict bw, const FT* __restrict bx,
+             const FT* __restrict by, const FT* __restrict bz,
+             FT* __restrict ow, FT* __restrict ox, FT* __restrict oy, FT* __restrict oz) {
+  for (size_t i = 0; i < n; ++i) {
+    ow[i] = aw[i] * bw[i] - ax[i] * bx[i] - ay[i] * by[i] - az[i] * bz[i];
+    ox[i] = aw[i] * bx[i] + ax[i] * bw[i] + ay[i] * bz[i] - az[i] * by[i];
+    oy[i] = aw[i] * by[i] - ax[i] * bz[i] + ay[i] * bw[i] + az[i] * bx[i];
+    oz[i] = aw[i] * bz[i] + ax[i] * by[i] - ay[i] * bx[i] + az[i] * bw[i];
+  }
+}
+
+template<typename FT>
+void normalize(const size_t n, FT* __restrict w, FT* __restrict x, FT* __restrict y, FT* __restrict z) {
+  for (size_t i = 0; i < n; ++i) {
+    const FT f = 1 / std::sqrt(w[i] * w[i] + x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+    w[i] *= f;
+    x[i] *= f;
+    y[i] *= f;
+    z[i] *= f;
+  }
+}
+
+}  // namespace detail
+
+/// Rotate all vectors by one unit quaternion, through its rotation matrix.
+/// out should be another array than in
+template<typename FT>
+void rotate(const UnitQuaternion<FT>& q, const Vector_array<FT>& in, Vector_array<FT>& out) {
+  if (&in == &out)
+    throw Error("Rotation can't be done in place");
+  out.resize(in.size());
+  detail::rotate_by_matrix(rotation_matrix(to_native<FT>(q)), in.size(),
+                           in.x.data(), in.y.data(), in.z.data(),
+                           out.x.data(), out.y.data(), out.z.data());
+}
+
+/// Rotate each vector by the unit quaternion at the same index. out
+/// should be another array than in
+template<typename FT>
+void rotate(const Quaternion_array<FT>& q, const Vector_array<FT>& in, Vector_array<FT>& out) {
+  if (q.size() != in.size())
+    throw Error("Quaternion and vector arrays differ in size", q.size());
+  if (&in == &out)
+    throw Error("Rotation can't be done in place");
+  out.resize(in.size());
+  detail::rotate_each(in.size(), q.w.data(), q.x.data(), q.y.data(), q.z.data(),
+                      in.x.data(), in.y.data(), in.z.data(),
+                      out.x.data(), out.y.data(), out.z.data());
+}
+
+/// Hamilton products a[i] * b[i]. out should be another array than a and b
+template<typename FT>
+void compose(const Quaternion_array<FT>& a, const Quaternion_array<FT>& b, Quaternion_array<FT>& out) {
+  if (a.size() != b.size())
+    throw Error("Quaternion arrays differ in size", a.size());
+  if (&a == &out || &b == &out)
+    throw Error("Composition can't be done in place");
+  out.resize(a.size());
+  detail::compose(a.size(), a.w.data(), a.x.data(), a.y.data(), a.z.data(),
+                  b.w.data(), b.x.data(), b.y.data(), b.z.data(),
+                  out.w.data(), out.x.data(), out.y.data(), out.z.data());
+}
+
+template<typename FT>
+void normalize(Quaternion_array<FT>& q) {
+  detail::normalize(q.size(), q.w.data(), q.x.data(), q.y.data(), q.z.data());
+}
+
+/**
+ * Interpolate from a[i] to b[i] by fraction t[i]
+ *
+ * Normalized linear interpolation along the shorter arc. Cheap and without
+ * branches, but not at constant angular rate; the error in angle is small
+ * for the short steps between consecutive samples. out should be another
+ * array than a and b.
+ */
+template<typename FT>
+void nlerp(const Quaternion_array<FT>& a, const Quaternion_array<FT>& b, const std::vector<FT>& t,
+           Quaternion_array<FT>& out) {
+  const size_t n = a.size();
+  if (b.size() != n || t.size() != n)
+    throw Error("Interpolation arrays differ in size", n);
+  if (&a == &out || &b == &out)
+    throw Error("Interpolation can't be done in place");
+  out.resize(n);
+  const FT* __restrict aw = a.w.data(); const FT* __restrict ax = a.x.data();
+  const FT* __restrict ay = a.y.data(); const FT* __restrict az = a.z.data();
+  const FT* __restrict bw = b.w.data(); const FT* __restrict bx = b.x.data();
+  const FT* __restrict by = b.y.data(); const FT* __restrict bz = b.z.data();
+  const FT* __restrict tt = t.data();
+  FT* __restrict ow = out.w.data(); FT* __restrict ox = out.x.data();
+  FT* __restrict oy = out.y.data(); FT* __restrict oz = out.z.data();
+  for (size_t i = 0; i < n; ++i) {
+    const FT d = aw[i] * bw[i] + ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+    const FT s = d < 0 ? -tt[i] : tt[i];
+    const FT r = 1 - tt[i];
+    ow[i] = r * aw[i] + s * bw[i];
+    ox[i] = r * ax[i] + s * bx[i];
+    oy[i] = r * ay[i] + s * by[i];
+    oz[i] = r * az[i] + s * bz[i];
+  }
+  normalize(out);
+}
+
+/**
+ * Spherical linear interpolation from a[i] to b[i] by fraction t[i]
+ *
+ * Constant angular rate along the shorter arc. Nearly equal quaternions
+ * fall back to linear weights to avoid dividing by a vanishing sine.
+ */
+template<typename FT>
+void slerp(const Quaternion_array<FT>& a, const Quaternion_array<FT>& b, const std::vector<FT>& t,
+           Quaternion_array<FT>& out) {
+  const size_t n = a.size();
+  if (b.size() != n || t.size() != n)
+    throw Error("Interpolation arrays differ in size", n);
+  out.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    FT d = a.w[i] * b.w[i] + a.x[i] * b.x[i] + a.y[i] * b.y[i] + a.z[i] * b.z[i];
+    const FT sign = d < 0 ? -1 : 1;
+    d = std::min<FT>(d * sign, 1);
+    const FT angle = std::acos(d);
+    const FT sine = std::sin(angle);
+    FT wa = 1 - t[i], wb = t[i];
+    if (sine > 1E-4) {
+      wa = std::sin(wa * angle) / sine;
+      wb = std::sin(wb * angle) / sine;
+    }
+    wb *= sign;
+    out.w[i] = wa * a.w[i] + wb * b.w[i];
+    out.x[i] = wa * a.x[i] + wb * b.x[i];
+    out.y[i] = wa * a.y[i] + wb * b.y[i];
+    out.z[i] = wa * a.z[i] + wb * b.z[i];
+  }
+  normalize(out);
+}
+
+/// Spherical linear interpolation from a to b by fraction t, as above for a single pair
+template<typename FT>
+UnitQuaternion<FT> slerp(const UnitQuaternion<FT>& a, const UnitQuaternion<FT>& b, const FT t) {
+  FT d = a.qr() * b.qr() + a.qi() * b.qi() + a.qj() * b.qj() + a.qk() * b.qk();
+  const FT sign = d < 0 ? -1 : 1;
+  d = std::min<FT>(d * sign, 1);
+  const FT angle = std::acos(d);
+  const FT sine = std::sin(angle);
+  FT wa = 1 - t, wb = t;
+  if (sine > 1E-4) {
+    wa = std::sin(wa * angle) / sine;
+    wb = std::sin(wb * angle) / sine;
+  }
+  wb *= sign;
+  return UnitQuaternion<FT>(wa * a.qr() + wb * b.qr(), wa * a.qi() + wb * b.qi(),
+                            wa * a.qj() + wb * b.qj(), wa * a.qk() + wb * b.qk());
+}
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,364 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Fusion of redundant identical sensors into one stream
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_SENSOR_ARRAY_H
+#define MRU_SENSOR_ARRAY_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "errors.h"
+#include "types.h"
+#include "stream.h"
+#include "resample.h"
+
+namespace mru {
+
+/// Counts and state of one unit of a Sensor_array
+struct Unit_health {
+  Unit_health(): samples(0), outliers(0), misses(0), errors(0), strikes(0), good(0), healthy(true) {}
+  /// Rounds with a sample from the unit
+  size_t samples;
+  /// Rounds in which the unit was too far from the median
+  size_t outliers;
+  /// Rounds without a sample from the unit
+  size_t misses;
+  /// Polls that threw
+  size_t errors;
+  /// Consecutive bad rounds
+  int strikes;
+  /// Consecutive good rounds
+  int good;
+  /// Whether the unit counts for the median and the mean
+  bool healthy;
+};
+
+namespace detail {
+
+/// Median of the first n values, which are reordered
+template<typename FT>
+inline FT median(FT* values, const int n) {
+  FT* middle = values + n / 2;
+  std::nth_element(values, middle, values + n);
+  if (n % 2 == 1)
+    return *middle;
+  // Lower middle is the largest of the lower half
+  return (*middle + *std::max_element(values, middle)) / 2;
+}
+
+}  // namespace detail
+
+/**
+ * One stream from N identical sensors
+ *
+ * Units are chips of the same type, each with its own calibration, sampled
+ * together by poll(). Their samples are aligned on one time: the earliest
+ * of the units' newest samples, at which every unit is interpolated from
+ * its last two samples. Per quantity the componentwise median over the
+ * healthy units is the reference. A unit further from it than sigmas times
+ * the robust spread of the units (1.4826 times the median distance), and
+ * further than the quantity's min_deviation, is an outlier in that round.
+ * The output is the mean of the healthy units that aren't outliers.
+ *
+ * The min_deviation of every quantity is required and should be at least
+ * one LSB of the chips: identical chips often read exactly the same, which
+ * leaves no spread, and a unit one step off would otherwise be an outlier
+ * in every round.
+ *
+ * A unit that is an outlier, has no new sample or fails to poll for
+ * max_strikes rounds in a row is taken out of the median and the mean until
+ * it has been good for recovery rounds in a row. When no unit is healthy,
+ * all units with a sample count, so the array keeps producing output.
+ *
+ * Units that drain a FIFO deliver several samples per poll. Those of one
+ * poll are combined round by round, lined up on the newest sample of each
+ * unit, as all were read at the same moment; a unit with fewer samples
+ * misses the earliest rounds. So the array has the rate of its units.
+ *
+ * The stream has the quantities of the units and one sample per round in
+ * which any unit has a new sample. Work is linear in N with fixed size
+ * storage: no allocation after construction, other than the samples of a
+ * poll growing to the largest FIFO drain once. Components are kept as
+ * arrays over the units, so the distance and mean loops vectorize. Only
+ * scalar and vector quantities can be combined.
+ */
+template<class Unit, int N, class S=typename Unit::Sample_type>
+struct Sensor_array;
+
+template<class Unit, int N, typename FT, Quantity... Qs>
+struct Sensor_array<Unit, N, Sample<FT, Qs...> >: public Sample_stream<FT, Qs...> {
+  static_assert(N > 0, "Sensor array needs units");
+  typedef Sample<FT, Qs...> Sample_type;
+  typedef std::array<Unit*, N> Units;
+  /// A value per quantity, in the order of the quantities
+  typedef std::array<FT, sizeof...(Qs)> Deviations;
+  static constexpr int units = N;
+
+  /// Takes the sample handlers of the units
+  Sensor_array(const Units& units, const Deviations& min_deviations, const FT sigmas=3,
+               const int max_strikes=5, const int recovery=50):
+      units_(units), sigmas_(sigmas), max_strikes_(max_strikes), recovery_(recovery) {
+    for (int q = 0; q < quantities; ++q)
+      set_min_deviation_(q, min_deviations[q]);
+    for (int i = 0; i < N; ++i) {
+      if (!units_[i])
+        throw Error("Sensor array unit missing", i);
+      states_[i].received = 0;
+      states_[i].fresh = false;
+      states_[i].polled.reserve(fifo_reserve);
+      units_[i]->set_sample_handler([this, i](const Sample_type& sample) {
+        states_[i].polled.push_back(sample);
+      });
+    }
+  }
+  Sensor_array(const Sensor_array&) = delete;
+  Sensor_array& operator=(const Sensor_array&) = delete;
+
+  /// Smallest distance from the median that makes a unit an outlier in Q
+  template<Quantity Q>
+  void set_min_deviation(const FT deviation) {
+    set_min_deviation_(Quantity_index<Q, Qs...>::value, deviation);
+  }
+  const Unit_health& health(const int unit) const { return states_[unit].health; }
+  int healthy_count() const {
+    int result = 0;
+    for (auto& state: states_)
+      result += state.health.healthy ? 1 : 0;
+    return result;
+  }
+
+  /// Poll every unit and publish their combined samples, one per round.
+  /// A unit that throws counts as failed for the poll.
+  void poll() {
+    size_t rounds = 0;
+    for (int i = 0; i < N; ++i) {
+      State_& state = states_[i];
+      try {
+        units_[i]->poll();
+      }
+      catch (const Error&) {
+        ++state.health.errors;
+        state.polled.clear();
+      }
+      rounds = std::max(rounds, state.polled.size());
+    }
+    // Without samples still one round, to count the misses
+    for (size_t round = 0; round < std::max(rounds, size_t(1)); ++round) {
+      for (auto& state: states_) {
+        const size_t skipped = rounds - state.polled.size();
+        if (state.polled.empty() || round < skipped)
+          continue;
+        state.previous = state.latest;
+        state.latest = state.polled[round - skipped];
+        ++state.received;
+        state.fresh = true;
+      }
+      combine_();
+    }
+    for (auto& state: states_)
+      state.polled.clear();
+  }
+  void finalize() {
+    for (auto unit: units_)
+      unit->finalize();
+  }
+private:
+  static constexpr int quantities = sizeof...(Qs);
+  static constexpr int components = detail::Component_layout<FT, Qs...>::count;
+  /// Samples of one poll made room for up front: a full FIFO of the chips
+  static constexpr size_t fifo_reserve = 32;
+  struct State_ {
+    /// Samples of the current poll
+    std::vector<Sample_type> polled;
+    Sample_type previous;
+    Sample_type latest;
+    size_t received;
+    bool fresh;
+    Unit_health health;
+  };
+  Units units_;
+  FT sigmas_;
+  int max_strikes_;
+  int recovery_;
+  FT min_deviation_[quantities];
+  std::array<State_, N> states_;
+  // Work arrays of one round, components over units
+  FT values_[components][N];
+  FT distance_[N];
+  FT weight_[N];
+  bool reference_[N];
+  bool outlier_[N];
+  FT scratch_[N];
+  FT result_[components];
+
+  void set_min_deviation_(const int q, const FT deviation) {
+    if (!(deviation > 0))
+      throw Error("Sensor array deviation floor should be positive", q);
+    min_deviation_[q] = deviation;
+  }
+
+  void combine_() {
+    // Reference units: the healthy ones with a sample, else all with a sample
+    int fresh = 0, healthy = 0;
+    for (int i = 0; i < N; ++i) {
+      fresh += states_[i].fresh ? 1 : 0;
+      healthy += states_[i].fresh && states_[i].health.healthy ? 1 : 0;
+    }
+    if (fresh == 0) {
+      for (auto& state: states_)
+        update_health_(state);
+      return;
+    }
+    Time time;
+    for (int i = 0; i < N; ++i) {
+      const State_& state = states_[i];
+      reference_[i] = state.fresh && (healthy == 0 || state.health.healthy);
+      if (reference_[i] && (!time.valid() || state.latest.time < time))
+        time = state.latest.time;
+      outlier_[i] = false;
+    }
+    for (int i = 0; i < N; ++i)
+      if (states_[i].fresh)
+        align_(i, time, typename detail::Make_indices<quantities>::type());
+      else
+        for (int c = 0; c < components; ++c)
+          values_[c][i] = 0;
+    int offset = 0;
+    for (int q = 0; q < quantities; ++q)
+      offset += test_(q, offset);
+    // Mean over the reference units that aren't outliers, median otherwise
+    int inliers = 0;
+    for (int i = 0; i < N; ++i) {
+      weight_[i] = reference_[i] && !outlier_[i] ? 1 : 0;
+      inliers += weight_[i] > 0 ? 1 : 0;
+    }
+    for (int c = 0; c < components; ++c) {
+      const FT* v = values_[c];
+      FT sum = 0;
+      for (int i = 0; i < N; ++i)
+        sum += weight_[i] * v[i];
+      if (inliers > 0)
+        result_[c] = sum / inliers;
+    }
+    for (int i = 0; i < N; ++i)
+      update_health_(states_[i]);
+    this->push_sample(sample_(time, typename detail::Make_indices<quantities>::type()));
+  }
+
+  /// Values of unit i at time, interpolated from its last two samples
+  template<int... Is>
+  void align_(const int i, const Time& time, detail::Indices<Is...>) {
+    State_& state = states_[i];
+    FT u = 1;
+    if (state.received >= 2 && state.previous.time < state.latest.time) {
+      u = FT(to_nanoseconds(time - state.previous.time))
+          / to_nanoseconds(state.latest.time - state.previous.time);
+      u = std::min(std::max(u, FT(0)), FT(1));
+    }
+    int dummy[] = { (split_<Qs, Is>(i, state, u), 0)... };
+    (void)dummy;
+  }
+  template<Quantity Q, int I>
+  void split_(const int i, const State_& state, const FT u) {
+    typedef typename Quantity_type<Q, FT>::type Value;
+    typedef detail::Components<Value, FT> Parts;
+    // Without an earlier sample the previous value isn't set
+    const Value value = u < 1 ? detail::Interpolator<Value, FT>::linear(
+        get<FT, Q>(state.previous), get<FT, Q>(state.latest), u) : get<FT, Q>(state.latest);
+    FT parts[Parts::count];
+    Parts::split(value, parts);
+    const int offset = offset_(I);
+    for (int c = 0; c < Parts::count; ++c)
+      values_[offset + c][i] = parts[c];
+  }
+  static int offset_(const int q) { return detail::component_offset<FT, Qs...>(q); }
+
+  /// Mark the outliers in quantity q, whose components start at offset.
+  /// Returns the number of components
+  int test_(const int q, const int offset) {
+    const int count = offset_(q + 1) - offset;
+    for (int i = 0; i < N; ++i)
+      distance_[i] = 0;
+    for (int c = offset; c < offset + count; ++c) {
+      int n = 0;
+      for (int i = 0; i < N; ++i)
+        if (reference_[i])
+          scratch_[n++] = values_[c][i];
+      const FT median = detail::median(scratch_, n);
+      result_[c] = median;
+      const FT* v = values_[c];
+      for (int i = 0; i < N; ++i)
+        distance_[i] += (v[i] - median) * (v[i] - median);
+    }
+    int n = 0;
+    for (int i = 0; i < N; ++i)
+      if (reference_[i])
+        scratch_[n++] = distance_[i];
+    // Squared distances: the median of their roots is the root of theirs
+    const FT spread = FT(1.4826) * std::sqrt(detail::median(scratch_, n));
+    const FT limit = std::max(sigmas_ * spread, min_deviation_[q]);
+    const FT limit2 = limit * limit;
+    // Written so a unit reading NaN is an outlier too
+    for (int i = 0; i < N; ++i)
+      if (states_[i].fresh && !(distance_[i] <= limit2))
+        outlier_[i] = true;
+    return count;
+  }
+
+  void strike_(Unit_health& health) {
+    health.good = 0;
+    if (++health.strikes >= max_strikes_)
+      health.healthy = false;
+  }
+  void update_health_(State_& state) {
+    Unit_health& health = state.health;
+    const int i = int(&state - &states_[0]);
+    if (!state.fresh) {
+      ++health.misses;
+      strike_(health);
+      return;
+    }
+    state.fresh = false;
+    ++health.samples;
+    if (outlier_[i]) {
+      ++health.outliers;
+      strike_(health);
+      return;
+    }
+    health.strikes = 0;
+    if (!health.healthy && ++health.good >= recovery_)
+      health.healthy = true;
+  }
+
+  template<int... Is>
+  Sample_type sample_(const Time& time, detail::Indices<Is...>) const {
+    return Sample_type(time, join_<Qs, Is>()...);
+  }
+  template<Quantity Q, int I>
+  typename Quantity_type<Q, FT>::type join_() const {
+    return detail::Components<typename Quantity_type<Q, FT>::type, FT>::join(result_ + offset_(I));
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
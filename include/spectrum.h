@@ -0,0 +1,257 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Streaming power spectral density estimates (Welch's method)
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_SPECTRUM_H
+#define MRU_SPECTRUM_H
+
+#include <cmath>
+#include <vector>
+#include <functional>
+
+#include "types.h"
+
+namespace mru {
+
+/**
+ * Radix 2 complex FFT of a fixed power of two size
+ *
+ * Twiddle factors and the bit reversal permutation are computed once. The
+ * twiddles are stored per stage, so the butterflies of a stage run over
+ * contiguous arrays and the compiler can vectorize them. Data is split into
+ * separate real and imaginary arrays for the same reason.
+ */
+template<typename FT=DefaultFT>
+struct FFT {
+  FFT(const size_t size): size_(size), reversed_(size), cos_(), sin_() {
+    if (size < 2 || (size & (size - 1)) != 0)
+      throw Error("FFT size should be a power of two", size);
+    int bits = 0;
+    while ((size_t(1) << bits) < size)
+      ++bits;
+    for (size_t i = 0; i < size; ++i) {
+      size_t r = 0;
+      for (int b = 0; b < bits; ++b)
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      reversed_[i] = r;
+    }
+    // Stage with half length h uses h twiddles, stored from offset h - 1
+    cos_.resize(size - 1);
+    sin_.resize(size - 1);
+    for (size_t h = 1; h < size; h <<= 1) {
+      for (size_t j = 0; j < h; ++j) {
+        double angle = -M_PI * j / h;
+        cos_[h - 1 + j] = std::cos(angle);
+        sin_[h - 1 + j] = std::sin(angle);
+      }
+    }
+  }
+  size_t size() const { return size_; }
+  /// In place forward transform: X[k] = sum x[n] exp(-2 pi i k n / N)
+  void transform(FT* re, FT* im) const {
+    for (size_t i = 0; i < size_; ++i) {
+      size_t r = reversed_[i];
+      if (r > i) {
+        std::swap(re[i], re[r]);
+        std::swap(im[i], im[r]);
+      }
+    }
+    for (size_t h = 1; h < size_; h <<= 1) {
+      const FT* wr = &cos_[h - 1];
+      const FT* wi = &sin_[h - 1];
+      for (size_t k = 0; k < size_; k += 2 * h) {
+        butterflies_(re + k, im + k, re + k + h, im + k + h, wr, wi, h);
+      }
+    }
+  }
+private:
+  size_t size_;
+  std::vector<size_t> reversed_;
+  std::vector<FT> cos_;
+  std::vector<FT> sin_;
+  static void butterflies_(FT* __restrict ar, FT* __restrict ai, FT* __restrict br, FT* __restrict bi,
+                           const FT* __restrict wr, const FT* __restrict wi, const size_t count) {
+    for (size_t j = 0; j < count; ++j) {
+      FT tr = br[j] * wr[j] - bi[j] * wi[j];
+      FT ti = br[j] * wi[j] + bi[j] * wr[j];
+      br[j] = ar[j] - tr;
+      bi[j] = ai[j] - ti;
+      ar[j] += tr;
+      ai[j] += ti;
+    }
+  }
+};
+
+enum class Window {
+  Rectangular,
+  Hann,
+  Hamming,
+  Blackman,
+};
+
+template<typename FT=DefaultFT>
+std::vector<FT> window_coefficients(const Window window, const size_t size) {
+  std::vector<FT> result(size, 1);
+  for (size_t i = 0; i < size; ++i) {
+    double phase = 2 * M_PI * i / size;
+    switch (window) {
+      case Window::Rectangular:
+        break;
+      case Window::Hann:
+        result[i] = 0.5 - 0.5 * std::cos(phase);
+        break;
+      case Window::Hamming:
+        result[i] = 0.54 - 0.46 * std::cos(phase);
+        break;
+      case Window::Blackman:
+        result[i] = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2 * phase);
+        break;
+    }
+  }
+  return result;
+}
+
+/**
+ * Running one sided power spectral density of a number of channels
+ *
+ * Samples are kept in a ring of one segment. Every step (segment size minus
+ * overlap, half a segment by default) samples, the last segment is windowed and transformed and its
+ * periodogram is averaged into the spectrum, so each refresh costs the same
+ * regardless of how long the stream runs. Up to averages segments count
+ * equally; after that the average is exponential with that length.
+ *
+ * Channels are real, so they are transformed in pairs: one as real and one
+ * as imaginary part of a single complex FFT.
+ *
+ * The spectrum is in units squared per Hz. Summed over the bins and
+ * multiplied by frequency_resolution() it gives the variance of a channel.
+ */
+template<typename FT=DefaultFT, int Channels=3>
+struct Welch {
+  typedef std::function<void(const Welch&)> Spectrum_handler;
+  /// Overlap of half a segment
+  static constexpr size_t half_overlap = size_t(-1);
+  Welch(const size_t segment_size, const FT sample_rate, const size_t overlap=half_overlap,
+        const Window window=Window::Hann, const size_t averages=16):
+      fft_(segment_size), sample_rate_(sample_rate),
+      step_(overlap == half_overlap ? segment_size - segment_size / 2 : segment_size - overlap),
+      averages_(averages), window_(window_coefficients<FT>(window, segment_size)),
+      ring_(segment_size * Channels, 0), re_(segment_size), im_(segment_size),
+      psd_((segment_size / 2 + 1) * Channels, 0),
+      position_(0), filled_(0), since_segment_(0), segments_(0), handler_() {
+    if (overlap != half_overlap && overlap >= segment_size)
+      throw Error("Overlap should be smaller than the segment size", overlap);
+    FT sum = 0;
+    for (auto w: window_)
+      sum += w * w;
+    scale_ = 1 / (sample_rate * sum);
+  }
+  size_t segment_size() const { return fft_.size(); }
+  size_t bins() const { return fft_.size() / 2 + 1; }
+  FT frequency_resolution() const { return sample_rate_ / fft_.size(); }
+  FT frequency(const size_t bin) const { return bin * frequency_resolution(); }
+  /// Number of segments averaged so far
+  size_t segments() const { return segments_; }
+  /// Spectrum of a channel: bins() values
+  const FT* psd(const int channel) const { return &psd_[channel * bins()]; }
+  void set_spectrum_handler(const Spectrum_handler& handler) { handler_ = handler; }
+
+  void add(const FT* values) {
+    const size_t n = fft_.size();
+    for (int c = 0; c < Channels; ++c)
+      ring_[c * n + position_] = values[c];
+    if (++position_ == n)
+      position_ = 0;
+    if (filled_ < n)
+      ++filled_;
+    if (++since_segment_ >= step_ && filled_ == n) {
+      since_segment_ = 0;
+      process_segment_();
+    }
+  }
+  template <int C = Channels>
+  typename std::enable_if<C == 3>::type add(const Vec3<FT>& vector) {
+    FT values[3] = { vector.x(), vector.y(), vector.z() };
+    add(values);
+  }
+  template <int C = Channels>
+  typename std::enable_if<C == 1>::type add(const Scalar<FT> value) {
+    add(&value);
+  }
+private:
+  FFT<FT> fft_;
+  FT sample_rate_;
+  size_t step_;
+  size_t averages_;
+  std::vector<FT> window_;
+  std::vector<FT> ring_;
+  std::vector<FT> re_;
+  std::vector<FT> im_;
+  std::vector<FT> psd_;
+  FT scale_;
+  size_t position_;
+  size_t filled_;
+  size_t since_segment_;
+  size_t segments_;
+  Spectrum_handler handler_;
+
+  /// Windowed copy of the segment in the ring, oldest sample first
+  void load_(FT* out, const int channel) const {
+    const size_t n = fft_.size();
+    const FT* in = &ring_[channel * n];
+    const size_t tail = n - position_;
+    for (size_t i = 0; i < tail; ++i)
+      out[i] = in[position_ + i] * window_[i];
+    for (size_t i = tail; i < n; ++i)
+      out[i] = in[i - tail] * window_[i];
+  }
+
+  void process_segment_() {
+    const size_t n = fft_.size();
+    const size_t half = n / 2;
+    ++segments_;
+    FT weight = FT(1) / std::min(segments_, averages_);
+    for (int c = 0; c < Channels; c += 2) {
+      bool pair = c + 1 < Channels;
+      load_(&re_[0], c);
+      if (pair)
+        load_(&im_[0], c + 1);
+      else
+        std::fill(im_.begin(), im_.end(), 0);
+      fft_.transform(&re_[0], &im_[0]);
+      FT* pa = &psd_[c * bins()];
+      FT* pb = pair ? &psd_[(c + 1) * bins()] : 0;
+      for (size_t k = 0; k <= half; ++k) {
+        // Separate the spectra of the two real channels
+        size_t m = (n - k) & (n - 1);
+        FT ar = (re_[k] + re_[m]) / 2, ai = (im_[k] - im_[m]) / 2;
+        FT br = (im_[k] + im_[m]) / 2, bi = (re_[m] - re_[k]) / 2;
+        FT factor = (k == 0 || k == half) ? scale_ : 2 * scale_;
+        pa[k] += ((ar * ar + ai * ai) * factor - pa[k]) * weight;
+        if (pair)
+          pb[k] += ((br * br + bi * bi) * factor - pb[k]) * weight;
+      }
+    }
+    if (handler_)
+      handler_(*this);
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
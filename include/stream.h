@@ -0,0 +1,70 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Streams of samples with their recent history
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_STREAM_H
+#define MRU_STREAM_H
+
+#include <functional>
+
+#include "types.h"
+
+#define history_item_count (100000)
+
+namespace mru {
+
+/**
+ * Source of samples: chips and anything computed from chip data
+ *
+ * Keeps the latest sample and a bounded history. An optional handler is
+ * called for every new sample, so consumers (e.g. sensor fusion) can
+ * process samples as they arrive.
+ */
+template<typename FT, Quantity... Qs>
+struct Sample_stream {
+  typedef Sample<FT, Qs...> Sample_type;
+  typedef Samples<FT, Qs...> Samples_type;
+  typedef std::function<void(const Sample_type&)> Sample_handler;
+  const Sample_type& data() const { return data_; }
+  const Samples_type& history() const { return history_; }
+  void set_sample_handler(const Sample_handler& handler) { sample_handler_ = handler; }
+  Sample_stream(): data_(), history_(), sample_handler_() {}
+  virtual ~Sample_stream() {}
+protected:
+  Sample_stream& push_sample(const Sample_type& sample) {
+    data_ = sample;
+    history_.push_back(data_);
+    trim_history();
+    if (sample_handler_)
+      sample_handler_(data_);
+    return *this;
+  }
+private:
+  Sample_type data_;
+  Samples_type history_;
+  Sample_handler sample_handler_;
+  void trim_history() {
+    while (history_.size() > history_item_count) {
+      history_.pop_front();
+    }
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
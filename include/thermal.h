@@ -0,0 +1,237 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Temperature compensation of bias and scale
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_THERMAL_H
+#define MRU_THERMAL_H
+
+#include <cmath>
+#include <vector>
+
+#include "types.h"
+#include "matrix.h"
+#include "calibration.h"
+
+namespace mru {
+
+/**
+ * Temperature model evaluated from a lookup table
+ *
+ * Bias and gain of each axis are tabulated at fixed temperature steps when
+ * the compensation is made, so correcting a reading is a table lookup and a
+ * linear interpolation instead of polynomial evaluations. Temperatures
+ * outside the table range use the nearest end.
+ */
+template<typename FT=DefaultFT>
+struct Temperature_compensation {
+  Temperature_compensation(const Temperature_model<FT>& model, const FT min_temperature=-20,
+                           const FT max_temperature=70, const FT step=0.5):
+      model_(model), min_temperature_(min_temperature), inverse_step_(1 / step),
+      table_() {
+    if (!(step > 0) || !(max_temperature > min_temperature))
+      throw Error("Invalid temperature compensation range", 0);
+    size_t size = static_cast<size_t>(std::ceil((max_temperature - min_temperature) / step)) + 1;
+    table_.resize(size);
+    for (size_t n = 0; n < size; ++n) {
+      FT t = min_temperature + n * step;
+      for (int i = 0; i < 3; ++i) {
+        table_[n].bias[i] = model.bias_at(i, t);
+        table_[n].gain[i] = 1 + model.scale_at(i, t);
+      }
+    }
+  }
+  const Temperature_model<FT>& model() const { return model_; }
+  FT min_temperature() const { return min_temperature_; }
+  FT max_temperature() const { return min_temperature_ + (table_.size() - 1) / inverse_step_; }
+  Vec3<FT> correct(const Vec3<FT>& value, const FT temperature) const {
+    FT position = (temperature - min_temperature_) * inverse_step_;
+    const FT last = table_.size() - 1;
+    position = position < 0 ? 0 : (position > last ? last : position);
+    size_t n = static_cast<size_t>(position);
+    if (n + 1 >= table_.size())
+      n = table_.size() - 2;
+    const FT f = position - n;
+    const Entry& a = table_[n];
+    const Entry& b = table_[n + 1];
+    FT v[3] = { value[0], value[1], value[2] };
+    for (int i = 0; i < 3; ++i) {
+      FT bias = a.bias[i] + (b.bias[i] - a.bias[i]) * f;
+      FT gain = a.gain[i] + (b.gain[i] - a.gain[i]) * f;
+      v[i] = (v[i] - bias) * gain;
+    }
+    return Vec3<FT>(v[0], v[1], v[2]);
+  }
+private:
+  struct Entry {
+    FT bias[3];
+    FT gain[3];
+  };
+  Temperature_model<FT> model_;
+  FT min_temperature_;
+  FT inverse_step_;
+  std::vector<Entry> table_;
+};
+
+/**
+ * Online fit of gyro bias against temperature
+ *
+ * Angular velocity is collected in blocks of window samples. A block in
+ * which every axis is quiet (standard deviation below max_deviation) and
+ * the mean rate is below max_rate counts as stationary: its mean is the
+ * bias at its mean temperature. Those points go into least squares normal
+ * equations of a polynomial per axis, so memory is constant.
+ *
+ * The degree of the solution is reduced when the temperatures seen don't
+ * span enough to determine the higher terms. Scale can't be observed while
+ * stationary, so solve() leaves the scale terms of the model alone. The
+ * model should have the same reference temperature as the fit.
+ *
+ * The fitted bias is what remains in the rates added, and solve() adds it
+ * to the bias of the model. So rates compensated with a model, as a chip
+ * publishes them, refine that model, while uncompensated rates go with a
+ * model without bias. The scale of the model makes the remaining bias of
+ * compensated rates slightly off; that is second order.
+ */
+template<typename FT=DefaultFT>
+struct Bias_temperature_fit {
+  static constexpr int max_degree = Temperature_model<FT>::max_degree;
+  Bias_temperature_fit(const int degree=2, const size_t window=100,
+                       const FT max_deviation=0.005, const FT max_rate=0.1,
+                       const FT reference=25):
+      degree_(checked_degree_(degree)), window_(window),
+      max_deviation_(max_deviation), max_rate_(max_rate), reference_(reference) {
+    reset();
+  }
+  void reset() {
+    normal_ = Matrix<max_degree + 1, max_degree + 1, double>();
+    right_ = Matrix<max_degree + 1, 3, double>();
+    observations_ = 0;
+    min_temperature_ = std::numeric_limits<double>::max();
+    max_temperature_ = -std::numeric_limits<double>::max();
+    clear_block_();
+  }
+  /// Number of stationary blocks in the fit
+  size_t observations() const { return observations_; }
+  FT temperature_span() const {
+    return observations_ > 0 ? max_temperature_ - min_temperature_ : 0;
+  }
+  void add(const Vector<FT>& angular_velocity, const FT temperature) {
+    double v[3] = { angular_velocity.x(), angular_velocity.y(), angular_velocity.z() };
+    for (int i = 0; i < 3; ++i) {
+      sum_[i] += v[i];
+      squares_[i] += v[i] * v[i];
+    }
+    temperature_sum_ += temperature;
+    if (++count_ >= window_)
+      close_block_();
+  }
+  /// Add the fitted bias to model. False when there is too little data
+  bool solve(Temperature_model<FT>& model) const {
+    if (observations_ == 0 || model.reference != reference_)
+      return false;
+    // Each extra term needs a wider temperature range to be meaningful
+    const double span = max_temperature_ - min_temperature_;
+    int degree = 0;
+    while (degree < degree_ && span >= 5 * (degree + 1) &&
+           observations_ > size_t(degree + 1))
+      ++degree;
+    switch (degree) {
+      case 0: return solve_<1>(model);
+      case 1: return solve_<2>(model);
+      case 2: return solve_<3>(model);
+      default: return solve_<4>(model);
+    }
+  }
+private:
+  int degree_;
+  size_t window_;
+  FT max_deviation_;
+  FT max_rate_;
+  FT reference_;
+  Matrix<max_degree + 1, max_degree + 1, double> normal_;
+  Matrix<max_degree + 1, 3, double> right_;
+  size_t observations_;
+  double min_temperature_;
+  double max_temperature_;
+  size_t count_;
+  double sum_[3];
+  double squares_[3];
+  double temperature_sum_;
+
+  static int checked_degree_(const int degree) {
+    if (degree < 0 || degree > max_degree)
+      throw Error("Temperature model degree out of range", degree);
+    return degree;
+  }
+
+  void clear_block_() {
+    count_ = 0;
+    for (int i = 0; i < 3; ++i)
+      sum_[i] = squares_[i] = 0;
+    temperature_sum_ = 0;
+  }
+
+  void close_block_() {
+    double mean[3];
+    bool stationary = true;
+    for (int i = 0; i < 3; ++i) {
+      mean[i] = sum_[i] / count_;
+      double variance = squares_[i] / count_ - mean[i] * mean[i];
+      if (variance > sqr(double(max_deviation_)) || std::fabs(mean[i]) > max_rate_)
+        stationary = false;
+    }
+    double temperature = temperature_sum_ / count_;
+    clear_block_();
+    if (!stationary)
+      return;
+    double powers[max_degree + 1];
+    powers[0] = 1;
+    for (int k = 1; k <= max_degree; ++k)
+      powers[k] = powers[k - 1] * (temperature - reference_);
+    for (int j = 0; j <= max_degree; ++j) {
+      for (int k = 0; k <= max_degree; ++k)
+        normal_(j, k) += powers[j] * powers[k];
+      for (int i = 0; i < 3; ++i)
+        right_(j, i) += powers[j] * mean[i];
+    }
+    min_temperature_ = std::min(min_temperature_, temperature);
+    max_temperature_ = std::max(max_temperature_, temperature);
+    ++observations_;
+  }
+
+  template<int N>
+  bool solve_(Temperature_model<FT>& model) const {
+    Matrix<N, N, double> normal = normal_.template block<N, N>(0, 0);
+    double bias[3][N];
+    for (int i = 0; i < 3; ++i) {
+      Matrix<N, 1, double> coefficients;
+      if (!mru::solve(normal, right_.template block<N, 1>(0, i), coefficients))
+        return false;
+      for (int k = 0; k < N; ++k)
+        bias[i][k] = coefficients(k, 0);
+    }
+    for (int i = 0; i < 3; ++i)
+      for (int k = 0; k < N; ++k)
+        model.bias[i][k] += bias[i][k];
+    return true;
+  }
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -20,27 +20,30 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstddef>
+#include <type_traits>
 #include <utility>
 #include <deque>
 #include <set>
 #include <stdexcept>
-
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <limits>
+#include <algorithm>
 
 #include <CGAL/Simple_cartesian.h>
 #include <CGAL/Vector_3.h>
 
 #include "utils.h"
 #include "errors.h"
+#include "clock.h"
+#include "native.h"
 
 namespace mru {
  
 // Default floating point type
 using DefaultFT = float;
-using Time = boost::posix_time::ptime;
-inline Time utc_now() {
-  return boost::posix_time::microsec_clock::universal_time();
-}
+
+/// Standard acceleration of gravity in m/s2
+constexpr double standard_gravity = 9.80665;
 
 template<typename FT=DefaultFT>
 using Scalar = FT;
@@ -54,64 +57,76 @@ using Transformation = typename CGAL::Simple_cartesian<FT>::Aff_transformation_3
 
 template <typename> struct UnitQuaternion;
 
+/// Quaternion qr + qi i + qj j + qk k, stored as a native Quat
 template <typename FT=DefaultFT>
 struct Quaternion
 {
-  Quaternion() : real_(0), vector_(0, 0, 0) {}
-  Quaternion(const Scalar<FT> real, const Vector<FT>& vector) : real_(real_), vector_(vector) {}
-  Quaternion(const Quaternion<FT>& quaternion): 
-      real_(quaternion.real_), vector_(quaternion.vector_) {}
-
-  Quaternion conjugate() {
-    return Quaternion(real_, -vector_);
+  Quaternion() : q_(0, 0, 0, 0) {}
+  Quaternion(const Scalar<FT> real, const Vector<FT>& vector) : q_(real, vector.x(), vector.y(), vector.z()) {}
+  Quaternion(const Scalar<FT> qr, const Scalar<FT> qi, const Scalar<FT> qj, const Scalar<FT> qk):
+      q_(qr, qi, qj, qk) {}
+  explicit Quaternion(const Quat<FT>& q): q_(q) {}
+  Quaternion(const Quaternion<FT>& quaternion) = default;
+  Quaternion& operator=(const Quaternion<FT>& quaternion) = default;
+
+  Quaternion conjugate() const {
+    return Quaternion(q_.conjugate());
   }
 
   Scalar<FT> squared_length() const {
-    return real_ * real_ + vector_ * vector_;
+    return q_.squared_length();
   }
 
-  template <typename> friend Quaternion operator*(const Quaternion&, const Quaternion&);
+  template <typename QFT> friend Quaternion<QFT> operator*(const Quaternion<QFT>&, const Quaternion<QFT>&);
   friend UnitQuaternion<FT>;
-  FT qr() { 
-    return real_;
+  FT qr() const { 
+    return q_.w;
+  }
+  FT qi() const { 
+    return q_.x;
   }
-  FT qi() { 
-    return vector_[0];
+  FT qj() const { 
+    return q_.y;
   }
-  FT qj() { 
-    return vector_[1];
+  FT qk() const { 
+    return q_.z;
   }
-  FT qk() { 
-    return vector_[2];
+  const Quat<FT>& native() const {
+    return q_;
   }
 private:
-  Scalar<FT> real_;
-  Vector<FT> vector_;
+  Quat<FT> q_;
 };
 
 template <typename FT>
 Quaternion<FT> operator*(const Quaternion<FT>& q, const Quaternion<FT>& r)
 {
-  return Quaternion<FT>(q.real_ * r.real_ - q.vector_ * r.vector_,
-      q.real_ * r.vector_ + r.scalar_ * q.vector_ +
-      CGAL::cross_product(q.vector_, r.vector_));
+  return Quaternion<FT>(q.q_ * r.q_);
 }
 
+template <int MinQ, int MaxQ, typename FT> struct RotScalar;
+
 template <typename FT=DefaultFT>
 struct UnitQuaternion: public Quaternion<FT> {
-  UnitQuaternion() : Quaternion<FT>(0, Vector<FT>(1, 0, 0)) {}
+  UnitQuaternion() : Quaternion<FT>(1, Vector<FT>(0, 0, 0)) {}
   UnitQuaternion(const Quaternion<FT>& quaterion): Quaternion<FT>(quaterion) {
     normalize_();
   }
   UnitQuaternion(const Scalar<FT> real, const Vector<FT>& vector): Quaternion<FT>(real, vector) {
     normalize_();
   }
+  UnitQuaternion(const Scalar<FT> qr, const Scalar<FT> qi, const Scalar<FT> qj, const Scalar<FT> qk):
+      Quaternion<FT>(qr, qi, qj, qk) {
+    normalize_();
+  }
 
-  Vector<FT> rotate(const Vector<FT>& vector) {
-    // This can be optimized: there are quite a few zeroes in there
-    return (*this * Quaternion<FT>(0, vector) * this->conjugate()).vector_;
+  Vec3<FT> rotate(const Vec3<FT>& vector) const {
+    return this->q_.rotate(vector);
   }
-  Transformation<FT> transformation() {
+  Vector<FT> rotate(const Vector<FT>& vector) const {
+    return this->q_.rotate(Vec3<FT>(vector));
+  }
+  Transformation<FT> transformation() const {
     FT qii = sqr(this->qi());
     FT qjj = sqr(this->qj());
     FT qkk = sqr(this->qk());
@@ -127,13 +142,25 @@ struct UnitQuaternion: public Quaternion<FT> {
         2 * (qij + qkr), 1 - 2 * (qii + qkk), 2 * (qjk - qir),
         2 * (qik - qjr), 2 * (qjk + qir), 1 - 2 * (qii + qjj));
   }
+  // Tait-Bryan angles of the rotation: heading about z, then pitch about the
+  // new y and roll about the resulting x axis
+  RotScalar<0, 4, FT> heading() const {
+    return std::atan2(2 * (this->qr() * this->qk() + this->qi() * this->qj()),
+                      1 - 2 * (sqr(this->qj()) + sqr(this->qk())));
+  }
+  RotScalar<-1, 1, FT> pitch() const {
+    FT s = 2 * (this->qr() * this->qj() - this->qk() * this->qi());
+    return std::asin(std::max<FT>(-1, std::min<FT>(1, s)));
+  }
+  RotScalar<-2, 2, FT> roll() const {
+    return std::atan2(2 * (this->qr() * this->qi() + this->qj() * this->qk()),
+                      1 - 2 * (sqr(this->qi()) + sqr(this->qj())));
+  }
 private:
   void normalize_() {
-    Scalar<FT> sql = this->squared_lenght();
-    if (std::fabs(sql) < std::numeric_limits<FT>::epsilon()) {
-      Scalar<FT> invl = 1 / sqrt(sql);
-      this->real_ *= invl;
-      this->vector_ *= invl;
+    Scalar<FT> sql = this->squared_length();
+    if (std::fabs(sql) > std::numeric_limits<FT>::epsilon()) {
+      this->q_ = this->q_ * (1 / std::sqrt(sql));
     }
     else {
       throw Error("Can't normalize 0 quaterion");
@@ -141,7 +168,15 @@ private:
   }
 };
 
+template<typename FT>
+inline Quat<FT> to_native(const Quaternion<FT>& q) {
+  return q.native();
+}
 
+template<typename FT>
+inline UnitQuaternion<FT> to_cgal(const Quat<FT>& q) {
+  return UnitQuaternion<FT>(q.w, q.x, q.y, q.z);
+}
 
 template <int MinQ=0, int MaxQ=4, typename FT=DefaultFT>
 struct RotScalar {
@@ -162,42 +197,32 @@ struct RotScalar {
     else
       set_value(s);
   }
-  RotScalar(const RotScalar& rs) {
-    set_value(rs.get_value());
-  }
   Scalar<FT> get_value() const {
     return value_;
   }
   Scalar<FT> to_degrees() const {
     return r2d(value_);
   }
+  /// Value wrapped into [min, max): one floor instead of fmod and branches.
+  /// Values already in range come out unchanged
   template <int Quarters = Quarters>
-  typename std::enable_if<Quarters == 4, Scalar<FT> >::type set_value(Scalar<FT> value) {
-    if (value >= max || value < min) {
-      Scalar<FT> r = std::fmod(value - min, range);
-      if (r < 0)
-        value_ = r + max;
-      else
-        value_ = r + min;
-    }
-    else
-      value_ = value;
-    return value_;
+  static typename std::enable_if<Quarters == 4, Scalar<FT> >::type wrap(const Scalar<FT> value) {
+    Scalar<FT> r = value - range * std::floor((value - min) / range);
+    // Rounding may land just on max
+    return r >= max ? r - range : r;
   }
+  /// Value folded back into [min, max], as the angle moves back after
+  /// reaching either end (pitch)
   template <int Quarters = Quarters>
-  typename std::enable_if<Quarters == 2 || Quarters == 1, Scalar<FT> >::type set_value(Scalar<FT> value) {
-    if (value > max || value < min) {
-      Scalar<FT> d = (value - min) / range;
-      Scalar<FT> i, r = std::fabs(std::modf(d, &i));
-      if ((static_cast<int>(i) % 2 == 0)) {
-        value_ = r * range + min;
-      }
-      else {
-        value_ = max - r * range;
-      }
-    }
-    else
-      value_ = value;
+  static typename std::enable_if<Quarters == 2 || Quarters == 1, Scalar<FT> >::type wrap(const Scalar<FT> value) {
+    // Triangle wave with period 2 range
+    Scalar<FT> d = value - min;
+    d -= 2 * range * std::floor(d / (2 * range));
+    Scalar<FT> folded = max - std::fabs(d - range);
+    return value >= min && value <= max ? value : folded;
+  }
+  Scalar<FT> set_value(const Scalar<FT> value) {
+    value_ = wrap(value);
     return value_;
   }
   Scalar<FT> operator[](int index) const {
@@ -305,6 +330,10 @@ enum class Quantity {
   Pitch,
   Roll,
   Rotation,
+  LinearAcceleration,
+  Gravity,
+  Velocity,
+  Displacement,
 };
 
 static constexpr Quantity Pressure = Quantity::Pressure;
@@ -316,6 +345,10 @@ static constexpr Quantity Heading = Quantity::Heading;
 static constexpr Quantity Pitch = Quantity::Pitch;
 static constexpr Quantity Roll = Quantity::Roll;
 static constexpr Quantity Rotation = Quantity::Rotation;
+static constexpr Quantity LinearAcceleration = Quantity::LinearAcceleration;
+static constexpr Quantity Gravity = Quantity::Gravity;
+static constexpr Quantity Velocity = Quantity::Velocity;
+static constexpr Quantity Displacement = Quantity::Displacement;
 
 
 template<Quantity Q, typename FT=DefaultFT>
@@ -330,15 +363,15 @@ struct Quantity_type<Temperature, FT> {
 };
 template<typename FT>
 struct Quantity_type<Acceleration, FT> {
-  typedef Vector<FT> type;
+  typedef Vec3<FT> type;
 };
 template<typename FT>
 struct Quantity_type<AngularVelocity, FT> {
-  typedef Vector<FT> type;
+  typedef Vec3<FT> type;
 };
 template<typename FT>
 struct Quantity_type<MagneticFlux, FT> {
-  typedef Vector<FT> type;
+  typedef Vec3<FT> type;
 };
 template<typename FT>
 struct Quantity_type<Heading, FT> {
@@ -356,29 +389,182 @@ template<typename FT>
 struct Quantity_type<Rotation, FT> {
   typedef UnitQuaternion<FT> type;
 };
+template<typename FT>
+struct Quantity_type<LinearAcceleration, FT> {
+  typedef Vec3<FT> type;
+};
+template<typename FT>
+struct Quantity_type<Gravity, FT> {
+  typedef Vec3<FT> type;
+};
+template<typename FT>
+struct Quantity_type<Velocity, FT> {
+  typedef Vec3<FT> type;
+};
+template<typename FT>
+struct Quantity_type<Displacement, FT> {
+  typedef Vec3<FT> type;
+};
+
+
+template<Quantity Q, Quantity... Qs>
+struct Has_quantity: std::false_type {};
+template<Quantity Q, Quantity R, Quantity... Qs>
+struct Has_quantity<Q, R, Qs...>:
+    std::integral_constant<bool, Q == R || Has_quantity<Q, Qs...>::value> {};
+
+/// Position of Q in Qs
+template<Quantity Q, Quantity... Qs>
+struct Quantity_index;
+template<Quantity Q, Quantity... Qs>
+struct Quantity_index<Q, Q, Qs...>: std::integral_constant<int, 0> {};
+template<Quantity Q, Quantity R, Quantity... Qs>
+struct Quantity_index<Q, R, Qs...>: std::integral_constant<int, 1 + Quantity_index<Q, Qs...>::value> {};
+
+/**
+ * Values of a sample, one member per quantity
+ *
+ * Nested members rather than base classes: the whole stays a standard
+ * layout aggregate, so every value has a fixed offset known at compile time.
+ */
+template <typename FT, Quantity... Qs>
+struct Sample_values {};
+template <typename FT, Quantity Q>
+struct Sample_values<FT, Q> {
+  typename Quantity_type<Q, FT>::type value;
+};
+template <typename FT, Quantity Q, Quantity R, Quantity... Qs>
+struct Sample_values<FT, Q, R, Qs...> {
+  typename Quantity_type<Q, FT>::type value;
+  Sample_values<FT, R, Qs...> rest;
+};
+
+template <typename FT, Quantity Q>
+inline Sample_values<FT, Q> make_sample_values(const typename Quantity_type<Q, FT>::type& q) {
+  return Sample_values<FT, Q>{q};
+}
+
+template <typename FT, Quantity Q, Quantity R, Quantity... Qs>
+inline Sample_values<FT, Q, R, Qs...> make_sample_values(const typename Quantity_type<Q, FT>::type& q,
+    const typename Quantity_type<R, FT>::type& r, const typename Quantity_type<Qs, FT>::type&... qs) {
+  return Sample_values<FT, Q, R, Qs...>{q, make_sample_values<FT, R, Qs...>(r, qs...)};
+}
 
+namespace detail {
+
+/// Value of quantity GQ in Sample_values<FT, Qs...>, resolved at compile time
+template <Quantity GQ, typename FT, Quantity... Qs>
+struct Value_access;
+
+template <Quantity GQ, typename FT, Quantity... Qs>
+struct Value_access<GQ, FT, GQ, Qs...> {
+  typedef Sample_values<FT, GQ, Qs...> Values;
+  typedef typename Quantity_type<GQ, FT>::type Value_type;
+  static Value_type& get(Values& values) { return values.value; }
+  static const Value_type& get(const Values& values) { return values.value; }
+  static constexpr size_t offset() { return offsetof(Values, value); }
+};
+
+template <Quantity GQ, typename FT, Quantity Q, Quantity... Qs>
+struct Value_access<GQ, FT, Q, Qs...> {
+  typedef Sample_values<FT, Q, Qs...> Values;
+  typedef Value_access<GQ, FT, Qs...> Next;
+  typedef typename Quantity_type<GQ, FT>::type Value_type;
+  static Value_type& get(Values& values) { return Next::get(values.rest); }
+  static const Value_type& get(const Values& values) { return Next::get(values.rest); }
+  static constexpr size_t offset() { return offsetof(Values, rest) + Next::offset(); }
+};
+
+/// Value types as arrays of FT: scalars and vectors, for filters and averages
+template<typename T, typename FT>
+struct Components;
+
+template<typename FT>
+struct Components<FT, FT> {
+  static constexpr int count = 1;
+  static void split(const FT& value, FT* c) { c[0] = value; }
+  static FT join(const FT* c) { return c[0]; }
+};
 
+template<typename FT>
+struct Components<Vec3<FT>, FT> {
+  static constexpr int count = 3;
+  static void split(const Vec3<FT>& value, FT* c) {
+    c[0] = value[0];
+    c[1] = value[1];
+    c[2] = value[2];
+  }
+  static Vec3<FT> join(const FT* c) { return Vec3<FT>(c[0], c[1], c[2]); }
+};
+
+/// Total number of components of the quantities
+template<typename FT, Quantity... Qs>
+struct Component_layout {
+  static constexpr int count = 0;
+};
+template<typename FT, Quantity Q, Quantity... Qs>
+struct Component_layout<FT, Q, Qs...> {
+  static constexpr int count =
+      Components<typename Quantity_type<Q, FT>::type, FT>::count + Component_layout<FT, Qs...>::count;
+};
+
+/// Offset of the components of the q-th quantity
+template<typename FT, Quantity... Qs>
+inline int component_offset(const int q) {
+  static const int counts[] = { 0, Components<typename Quantity_type<Qs, FT>::type, FT>::count... };
+  int result = 0;
+  for (int j = 1; j <= q; ++j)
+    result += counts[j];
+  return result;
+}
+
+}  // namespace detail
+
+/**
+ * Time and values of a number of quantities
+ *
+ * A flat struct: standard layout and trivially copyable as long as the
+ * quantity types are, so samples can be copied with memcpy into rings,
+ * shared memory or files. get() returns a reference to the value in place;
+ * offset<Q>() gives its byte offset for readers of such copies.
+ */
 template <typename FT, Quantity... Qs>
-struct Sample {};
+struct Sample {
+  Sample(): time(now()), values() {}
+  Sample(const Time& t): time(t), values() {}
+  Time time;
+  Sample_values<FT> values;
+};
 
 template <typename FT, Quantity Q, Quantity... Qs>
-struct Sample<FT, Q, Qs...>: Sample<FT, Qs...> {
-  Sample<FT, Q, Qs...>(typename Quantity_type<Q>::type q, typename Quantity_type<Qs>::type... qs):
-    Sample<FT, Qs...>(qs...), value(q) {}
-  typename Quantity_type<Q, FT>::type value;
+struct Sample<FT, Q, Qs...> {
+  typedef Sample_values<FT, Q, Qs...> Values;
+  Sample(): time(now()), values() {}
+  Sample(const Time& t): time(t), values() {}
+  Sample(const typename Quantity_type<Q, FT>::type& q, const typename Quantity_type<Qs, FT>::type&... qs):
+    time(now()), values(make_sample_values<FT, Q, Qs...>(q, qs...)) {}
+  Sample(const Time& t, const typename Quantity_type<Q, FT>::type& q,
+         const typename Quantity_type<Qs, FT>::type&... qs):
+    time(t), values(make_sample_values<FT, Q, Qs...>(q, qs...)) {}
+  /// Byte offset of the value of GQ from the start of the sample
+  template <Quantity GQ>
+  static constexpr size_t offset() {
+    return offsetof(Sample, values) + detail::Value_access<GQ, FT, Q, Qs...>::offset();
+  }
+  Time time;
+  Values values;
 };
 
-template <typename FT, Quantity GQ, Quantity Q, Quantity... Qs>
-inline typename std::enable_if<GQ == Q, typename Quantity_type<GQ>::type>::type
-get(const Sample<FT, Q, Qs...>& sample) {
-  typename Quantity_type<GQ>::type value = sample.value;
-  return value;
+template <typename FT, Quantity GQ, Quantity... Qs>
+inline const typename Quantity_type<GQ, FT>::type& get(const Sample<FT, Qs...>& sample) {
+  static_assert(Has_quantity<GQ, Qs...>::value, "Sample doesn't have the quantity");
+  return detail::Value_access<GQ, FT, Qs...>::get(sample.values);
 }
 
-template <typename FT, Quantity GQ, Quantity Q, Quantity... Qs>
-inline typename std::enable_if<GQ != Q, typename Quantity_type<GQ>::type>::type
-get(const Sample<FT, Q, Qs...>& sample) {
-  return get<FT, GQ>(static_cast<Sample<FT, Qs...> >(sample));
+template <typename FT, Quantity GQ, Quantity... Qs>
+inline typename Quantity_type<GQ, FT>::type& get(Sample<FT, Qs...>& sample) {
+  static_assert(Has_quantity<GQ, Qs...>::value, "Sample doesn't have the quantity");
+  return detail::Value_access<GQ, FT, Qs...>::get(sample.values);
 }
 
 /*
@@ -0,0 +1,113 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Work stealing thread pool for sample processing
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MRU_WORK_POOL_H
+#define MRU_WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mru {
+
+/**
+ * Threads running tasks from a deque each, stealing when theirs is empty
+ *
+ * Tasks submitted from outside the pool are dealt round robin over the
+ * workers; tasks submitted by a task go to the deque of its own worker.
+ * A worker takes the newest task of its own deque, which is most likely
+ * still in its cache, and otherwise the oldest task of another worker. So
+ * an unequal load, such as one bus delivering more samples than the
+ * others, spreads over all cores.
+ *
+ * A task that throws doesn't stop the pool: the first exception is kept and
+ * rethrown by wait().
+ */
+struct Work_pool {
+  typedef std::function<void()> Task;
+  /// A pool of threads workers, or one per core for 0
+  explicit Work_pool(const int threads=0);
+  /// Runs what is queued before the threads end
+  ~Work_pool();
+  Work_pool(const Work_pool&) = delete;
+  Work_pool& operator=(const Work_pool&) = delete;
+  int size() const { return int(workers_.size()); }
+  void submit(Task task);
+  /// Wait until every task submitted so far has run
+  void wait();
+  /// Number of tasks run
+  size_t executed() const { return executed_.load(std::memory_order_relaxed); }
+  /// Number of tasks run by another worker than the one they were queued on
+  size_t stolen() const { return stolen_.load(std::memory_order_relaxed); }
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+  std::vector<std::unique_ptr<Worker> > workers_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  /// Tasks in the deques and tasks not finished, under mutex_
+  size_t queued_;
+  size_t pending_;
+  bool quit_;
+  std::atomic<size_t> next_;
+  std::atomic<size_t> executed_;
+  std::atomic<size_t> stolen_;
+  std::exception_ptr error_;
+
+  bool take_(const int index, Task& task);
+  void run_(const int index);
+};
+
+/**
+ * Tasks run on a pool one at a time, in the order submitted
+ *
+ * Consecutive batches of one sensor unit go through a strand, so the
+ * unit's filters see them in order and are never entered by two threads,
+ * while the batches of other units run in parallel.
+ */
+struct Strand {
+  typedef Work_pool::Task Task;
+  explicit Strand(Work_pool& pool): pool_(pool), mutex_(), tasks_(), scheduled_(false) {}
+  Strand(const Strand&) = delete;
+  Strand& operator=(const Strand&) = delete;
+  void submit(Task task);
+private:
+  Work_pool& pool_;
+  std::mutex mutex_;
+  std::deque<Task> tasks_;
+  bool scheduled_;
+  void drain_();
+  void reschedule_();
+};
+
+}  // namespace mru
+
+#endif
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
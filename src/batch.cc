@@ -0,0 +1,82 @@
+/** 
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Vectorized calibration kernels
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. 
+ */
+
+#include "../include/batch.h"
+
+// The kernels are plain loops written for the auto vectorizer. On x86_64
+// GCC builds an AVX2 clone next to the baseline SSE2 one and picks between
+// them when the library is loaded. NEON is used on AArch64 as its baseline,
+// and on 32 bit ARM when the library is built with -mfpu=neon.
+#if defined(__GNUC__) && !defined(__clang__)
+#  if defined(__x86_64__)
+#    define MRU_KERNEL __attribute__((target_clones("avx2", "default"), \
+                                      optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#  else
+#    define MRU_KERNEL __attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic")))
+#  endif
+#else
+#  define MRU_KERNEL
+#endif
+
+namespace mru {
+
+MRU_KERNEL
+static void calibrate_triples_kernel(const int16_t* __restrict raw, const size_t count,
+                                     const float (&m)[3][4],
+                                     float* __restrict x, float* __restrict y, float* __restrict z)
+{
+  // Local copies: the compiler can't otherwise tell they don't alias the output
+  const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2], m03 = m[0][3];
+  const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2], m13 = m[1][3];
+  const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2], m23 = m[2][3];
+  for (size_t i = 0; i < count; ++i) {
+    const float a = raw[3 * i];
+    const float b = raw[3 * i + 1];
+    const float c = raw[3 * i + 2];
+    x[i] = m00 * a + m01 * b + m02 * c + m03;
+    y[i] = m10 * a + m11 * b + m12 * c + m13;
+    z[i] = m20 * a + m21 * b + m22 * c + m23;
+  }
+}
+
+MRU_KERNEL
+static void calibrate_values_kernel(const int16_t* __restrict raw, const size_t count,
+                                    const float factor, const float offset,
+                                    float* __restrict values)
+{
+  for (size_t i = 0; i < count; ++i)
+    values[i] = raw[i] * factor + offset;
+}
+
+void calibrate_triples(const int16_t* raw, const size_t count,
+                       const Batch_calibration& calibration,
+                       float* x, float* y, float* z)
+{
+  calibrate_triples_kernel(raw, count, calibration.correction.m, x, y, z);
+}
+
+void calibrate_values(const int16_t* raw, const size_t count,
+                      const Batch_calibration& calibration, float* values)
+{
+  calibrate_values_kernel(raw, count, calibration.value_factor, calibration.value_offset, values);
+}
+
+}  // namespace mru
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
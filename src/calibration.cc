@@ -18,6 +18,7 @@
  */
 
 #include <fstream>
+#include <string>
 #include <utility>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
@@ -26,8 +27,7 @@
 
 namespace mru {
 
-template<typename FT=DefaultFT>
-Calibration<FT> load_calibration(const std::string& filename, const std::string& section)
+static boost::property_tree::ptree read_tree(const std::string& filename)
 {
    using namespace boost::property_tree;
 
@@ -38,7 +38,21 @@ Calibration<FT> load_calibration(const std::string& filename, const std::string&
      ini_parser::read_ini(i_file, pt);
      i_file.close();
    }
+   return pt;
+}
+
+// Written next to the file and renamed over it, so readers (and file
+// watchers) never see a partially written file
+static void write_tree(const std::string& filename, const boost::property_tree::ptree& pt)
+{
+   std::string temporary = filename + ".tmp";
+   boost::property_tree::ini_parser::write_ini(temporary, pt);
+   boost::filesystem::rename(temporary, filename);
+}
 
+template<typename FT>
+static Calibration<FT> calibration_from_tree(const boost::property_tree::ptree& pt, const std::string& section)
+{
    Calibration<FT> result;
 
    if (pt.get(section + ".x_factor", static_cast<Scalar<FT> >(0)) == 0 &&
@@ -84,46 +98,128 @@ Calibration<FT> load_calibration(const std::string& filename, const std::string&
    return result;
 }
 
-template<typename FT=DefaultFT>
+template<typename FT>
+Calibration<FT> load_calibration(const std::string& filename, const std::string& section)
+{
+  return calibration_from_tree<FT>(read_tree(filename), section);
+}
+
+template<typename FT>
 Calibration<FT> load_calibration(const boost::filesystem::path& filename, const std::string& section)
 {
   return load_calibration<FT>(filename.string(), section);
 }
 
-template<typename FT=DefaultFT>
+template<typename FT>
 void save_calibration(const std::string& filename, const std::string& section, 
                       const Calibration<FT>& calibration)
 {
    using namespace boost::property_tree;
 
-   ptree pt;
+   ptree pt = read_tree(filename);
 
-   std::ifstream i_file(filename);
-   if (i_file.good()) {
-     ini_parser::read_ini(i_file, pt);
-     i_file.close();
+   static const char* axes = "xyz";
+   const Correction<FT>& correction = calibration.correction;
+   // The short diagonal form is only read back when no factor is zero
+   bool diagonal = true;
+   for (int i = 0; i < 3; ++i) {
+     for (int j = 0; j < 3; ++j) {
+       if ((i == j) != (correction(i, j) != 0))
+         diagonal = false;
+     }
+   }
+   // Remove keys of the other form, they would take precedence or confuse
+   ptree& section_tree = pt.put_child(section, pt.get_child(section, ptree()));
+   for (int i = 0; i < 3; ++i) {
+     section_tree.erase(std::string(1, axes[i]) + "_factor");
+     for (int j = 0; j < 3; ++j) {
+       section_tree.erase(std::string(1, axes[i]) + axes[j] + "_factor");
+     }
+   }
+   for (int i = 0; i < 3; ++i) {
+     std::string axis(1, axes[i]);
+     if (diagonal) {
+       pt.put(section + "." + axis + "_factor", correction(i, i));
+     }
+     else {
+       for (int j = 0; j < 3; ++j) {
+         pt.put(section + "." + axis + axes[j] + "_factor", correction(i, j));
+       }
+     }
+     pt.put(section + "." + axis + "_offset", correction(i, 3));
    }
-   
-   pt.put(section + ".x_factor", calibration.x_factor());
-   pt.put(section + ".x_offset", calibration.x_offset());
-   pt.put(section + ".y_factor", calibration.y_factor());
-   pt.put(section + ".y_offset", calibration.y_offset());
-   pt.put(section + ".z_factor", calibration.z_factor());
-   pt.put(section + ".z_offset", calibration.z_offset());
    pt.put(section + ".v_factor", calibration.value_factor);
    pt.put(section + ".v_offset", calibration.value_offset);
 
-   std::ofstream o_file(filename);
-   ini_parser::write_ini(filename, pt);
+   write_tree(filename, pt);
 }
 
-template<typename FT=DefaultFT>
+template<typename FT>
 void save_calibration(const boost::filesystem::path& filename, const std::string& section,
                       const Calibration<FT>& calibration)
 {
   save_calibration<FT>(filename.string(), section, calibration);
 }
 
+template<typename FT>
+static Temperature_model<FT> temperature_model_from_tree(const boost::property_tree::ptree& pt,
+                                                         const std::string& section)
+{
+   static const char* axes = "xyz";
+   Temperature_model<FT> result(pt.get(section + ".t_reference", static_cast<Scalar<FT> >(25.0)));
+   for (int i = 0; i < 3; ++i) {
+     std::string prefix = section + "." + axes[i];
+     for (int k = 0; k <= Temperature_model<FT>::max_degree; ++k) {
+       std::string power = std::to_string(k);
+       result.bias[i][k] = pt.get(prefix + "_bias_" + power, static_cast<Scalar<FT> >(0.0));
+       result.scale[i][k] = pt.get(prefix + "_scale_" + power, static_cast<Scalar<FT> >(0.0));
+     }
+   }
+   return result;
+}
+
+template<typename FT>
+Temperature_model<FT> load_temperature_model(const std::string& filename, const std::string& section)
+{
+  return temperature_model_from_tree<FT>(read_tree(filename), section);
+}
+
+template<typename FT>
+Calibration_set<FT> load_calibration_set(const std::string& filename)
+{
+  boost::property_tree::ptree pt = read_tree(filename);
+  Calibration_set<FT> result;
+  for (auto& section: pt) {
+    result.calibrations[section.first] = calibration_from_tree<FT>(pt, section.first);
+    Temperature_model<FT> model = temperature_model_from_tree<FT>(pt, section.first);
+    if (!model.empty())
+      result.temperature_models[section.first] = model;
+  }
+  return result;
+}
+
+template<typename FT>
+void save_temperature_model(const std::string& filename, const std::string& section,
+                            const Temperature_model<FT>& model)
+{
+   using namespace boost::property_tree;
+
+   ptree pt = read_tree(filename);
+
+   static const char* axes = "xyz";
+   pt.put(section + ".t_reference", model.reference);
+   for (int i = 0; i < 3; ++i) {
+     std::string prefix = section + "." + axes[i];
+     for (int k = 0; k <= Temperature_model<FT>::max_degree; ++k) {
+       std::string power = std::to_string(k);
+       pt.put(prefix + "_bias_" + power, model.bias[i][k]);
+       pt.put(prefix + "_scale_" + power, model.scale[i][k]);
+     }
+   }
+
+   write_tree(filename, pt);
+}
+
 // Explicit instantiations
 template Calibration<float> load_calibration(const std::string& filename, const std::string& section);
 template Calibration<float> load_calibration(const boost::filesystem::path& filename, const std::string& section);
@@ -131,6 +227,10 @@ template void save_calibration(const std::string& filename, const std::string& s
                                const Calibration<float>& calibration);
 template void save_calibration(const boost::filesystem::path& filename, const std::string& section,
                                const Calibration<float>& calibration);
+template Temperature_model<float> load_temperature_model(const std::string& filename, const std::string& section);
+template Calibration_set<float> load_calibration_set(const std::string& filename);
+template void save_temperature_model(const std::string& filename, const std::string& section,
+                                     const Temperature_model<float>& model);
 
 template Calibration<double> load_calibration(const std::string& filename, const std::string& section);
 template Calibration<double> load_calibration(const boost::filesystem::path& filename, const std::string& section);
@@ -138,6 +238,10 @@ template void save_calibration(const std::string& filename, const std::string& s
                                const Calibration<double>& calibration);
 template void save_calibration(const boost::filesystem::path& filename, const std::string& section,
                                const Calibration<double>& calibration);
+template Temperature_model<double> load_temperature_model(const std::string& filename, const std::string& section);
+template Calibration_set<double> load_calibration_set(const std::string& filename);
+template void save_temperature_model(const std::string& filename, const std::string& section,
+                                     const Temperature_model<double>& model);
 
 template Calibration<long double> load_calibration(const std::string& filename, const std::string& section);
 template Calibration<long double> load_calibration(const boost::filesystem::path& filename, const std::string& section);
@@ -145,6 +249,10 @@ template void save_calibration(const std::string& filename, const std::string& s
                                const Calibration<long double>& calibration);
 template void save_calibration(const boost::filesystem::path& filename, const std::string& section,
                                const Calibration<long double>& calibration);
+template Temperature_model<long double> load_temperature_model(const std::string& filename, const std::string& section);
+template Calibration_set<long double> load_calibration_set(const std::string& filename);
+template void save_temperature_model(const std::string& filename, const std::string& section,
+                                     const Temperature_model<long double>& model);
 }  // namespace mru
 
 // vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
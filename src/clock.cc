@@ -0,0 +1,127 @@
+/** 
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Implementation of time mapping and sample time filtering
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. 
+ */
+
+#include <cmath>
+
+#include "../include/errors.h"
+#include "../include/clock.h"
+
+namespace mru {
+
+void Utc_mapping::synchronize()
+{
+  // The wall clock reading closest in time to a monotonic one
+  int64_t best = std::numeric_limits<int64_t>::max();
+  for (int i = 0; i < 5; ++i) {
+    Time before = now();
+    boost::posix_time::ptime utc = utc_now();
+    Time after = now();
+    int64_t spread = after.nanoseconds() - before.nanoseconds();
+    if (spread < best) {
+      best = spread;
+      reference_ = Time::from_nanoseconds(before.nanoseconds() + spread / 2);
+      utc_reference_ = utc;
+    }
+  }
+}
+
+boost::posix_time::ptime Utc_mapping::utc(const Time& time) const
+{
+  // UTC has microsecond ticks
+  return utc_reference_ + boost::posix_time::microseconds(to_nanoseconds(time - reference_) / 1000);
+}
+
+Time Utc_mapping::time(const boost::posix_time::ptime& utc) const
+{
+  return reference_ + mru::from_nanoseconds((utc - utc_reference_).total_nanoseconds());
+}
+
+boost::posix_time::ptime to_utc(const Time& time)
+{
+  static const Utc_mapping mapping;
+  return mapping.utc(time);
+}
+
+Timestamp_filter::Timestamp_filter(const Duration& period, const int window, const Duration& max_error):
+    nominal_(0), lambda_(0), prior_(0), max_error_(to_nanoseconds(max_error)),
+    synchronized_(false), reference_(),
+    s0_(0), sn_(0), snn_(0), st_(0), snt_(0), weight_(0), offset_(0), slope_(0)
+{
+  if (window < 2)
+    throw Error("Timestamp filter window should be at least 2", window);
+  lambda_ = 1 - 1.0 / window;
+  // The slope follows the data once the spread of the sample indices
+  // (weighted sum of squares) exceeds this. The prior is forgotten like
+  // the captures, so it doesn't bias the slope in the long run
+  prior_ = double(window) * window;
+  set_nominal_period(period);
+}
+
+void Timestamp_filter::set_nominal_period(const Duration& period)
+{
+  if (to_nanoseconds(period) <= 0)
+    throw Error("Sample period should be positive");
+  nominal_ = to_nanoseconds(period);
+  synchronized_ = false;
+}
+
+Duration Timestamp_filter::period() const
+{
+  return mru::from_nanoseconds(std::llround(period_nanoseconds()));
+}
+
+Time Timestamp_filter::add(const Time& capture, const int count)
+{
+  // Sums are relative to the last capture: index 0 and time 0 there
+  const double dn = count;
+  // Without a sync the reference isn't set, so dt isn't either
+  const double dt = synchronized_ ? capture.nanoseconds() - reference_.nanoseconds() : 0;
+  const double max_error = max_error_ > 0 ? max_error_ : nominal_;
+  if (synchronized_ && std::fabs(dt - (offset_ + slope_ * dn)) < max_error) {
+    snn_ = lambda_ * (snn_ - 2 * dn * sn_ + dn * dn * s0_);
+    snt_ = lambda_ * (snt_ - dn * st_ - dt * sn_ + dn * dt * s0_);
+    sn_ = lambda_ * (sn_ - dn * s0_);
+    st_ = lambda_ * (st_ - dt * s0_);
+    s0_ = lambda_ * s0_;
+    weight_ = lambda_ * weight_;
+  }
+  else {
+    s0_ = sn_ = snn_ = st_ = snt_ = 0;
+    weight_ = prior_;
+    synchronized_ = true;
+  }
+  s0_ += 1;
+  reference_ = capture;
+  solve_();
+  return Time::from_nanoseconds(capture.nanoseconds() + std::llround(offset_));
+}
+
+void Timestamp_filter::solve_()
+{
+  // Least squares t = offset + slope n with a prior pulling slope to nominal
+  const double snn = snn_ + weight_;
+  const double snt = snt_ + weight_ * nominal_;
+  const double det = s0_ * snn - sn_ * sn_;
+  offset_ = (st_ * snn - sn_ * snt) / det;
+  slope_ = (s0_ * snt - sn_ * st_) / det;
+}
+
+}  // namespace mru
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
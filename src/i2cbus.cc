@@ -20,6 +20,7 @@
 extern "C" {
   #include <stddef.h>
   #include <sys/ioctl.h>
+  #include <linux/i2c.h>
   #include <linux/i2c-dev.h>
   #include <i2c/smbus.h>
   #include <byteswap.h>
@@ -62,6 +63,24 @@ typedef BusRefs::iterator BusRef_i;
 
 static BusRefs busrefs;
 
+// SMBus block reads are limited to 32 bytes. Longer reads (e.g. FIFO drains)
+// are done as a single combined transaction: register write, repeated start
+// and a read of arbitrary length.
+static __s32 read_long_block(const int file, const int address, const int offset, 
+                             const int count, Byte* data)
+{
+  Byte reg = offset & 0xFF;
+  struct i2c_msg msgs[2] = {
+    {static_cast<__u16>(address), 0, 1, &reg},
+    {static_cast<__u16>(address), I2C_M_RD, static_cast<__u16>(count), data}
+  };
+  struct i2c_rdwr_ioctl_data transaction = {msgs, 2};
+  if (ioctl(file, I2C_RDWR, &transaction) < 0) {
+    return -1;
+  }
+  return count;
+}
+
 void I2C_bus::open_bus_()
 {
   BusRef_i i = busrefs.find(busno_);
@@ -164,7 +183,9 @@ Bytes I2C_device::read_bytes(const int offset, const int count) const
 {
   select_();
   Bytes bytes(count);
-  __s32 result = i2c_smbus_read_i2c_block_data(bus_.get_file(), offset & 0xFF, count & 0xFF, bytes.data());
+  __s32 result = count > I2C_SMBUS_BLOCK_MAX ?
+    read_long_block(bus_.get_file(), address_, offset, count, bytes.data()) :
+    i2c_smbus_read_i2c_block_data(bus_.get_file(), offset & 0xFF, count & 0xFF, bytes.data());
   if (result < count) {
     throw Error("Failed to read I2C data.", errno);
   }
@@ -219,8 +240,10 @@ Words I2C_device::read_words(const int offset, const int count) const
 {
   select_();
   Words words(count);
-  __s32 result = i2c_smbus_read_i2c_block_data(bus_.get_file(), offset, count * 2, 
-    reinterpret_cast<Byte*>(words.data()));
+  __s32 result = count * 2 > I2C_SMBUS_BLOCK_MAX ?
+    read_long_block(bus_.get_file(), address_, offset, count * 2, reinterpret_cast<Byte*>(words.data())) :
+    i2c_smbus_read_i2c_block_data(bus_.get_file(), offset, count * 2, 
+      reinterpret_cast<Byte*>(words.data()));
   if (result < (count * 2)) {
     throw Error("Failed to read I2C data.", errno);
   }
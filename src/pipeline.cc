@@ -0,0 +1,106 @@
+/** 
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Implementation of pipeline threads
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. 
+ */
+
+extern "C" {
+  #include <pthread.h>
+  #include <sched.h>
+}
+
+#include "../include/errors.h"
+#include "../include/pipeline.h"
+
+namespace mru {
+
+Pipeline::Pipeline(): channels_(), tasks_(), threads_(), started_(false), stopping_(false), mutex_(), error_() {}
+
+Pipeline::~Pipeline()
+{
+  // Errors can't be reported from here
+  if (running()) {
+    try {
+      stop();
+    }
+    catch (...) {
+    }
+  }
+}
+
+void Pipeline::add_task_(const std::function<void()>& body, const Placement& placement)
+{
+  if (started_)
+    throw Error("Can't add stages to a started pipeline");
+  tasks_.push_back(Task{body, placement});
+}
+
+void Pipeline::start()
+{
+  if (started_)
+    throw Error("Pipeline already started");
+  started_ = true;
+  for (auto& task: tasks_)
+    threads_.push_back(std::thread(&Pipeline::run_, this, std::cref(task)));
+}
+
+void Pipeline::stop()
+{
+  stopping_ = true;
+  wait();
+}
+
+void Pipeline::wait()
+{
+  for (auto& thread: threads_)
+    thread.join();
+  threads_.clear();
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(error, error_);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void Pipeline::run_(const Task& task)
+{
+  try {
+    if (task.placement.cpu >= 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(task.placement.cpu, &cpus);
+      int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      if (result != 0)
+        throw Error("Failed to pin pipeline stage to CPU", result);
+    }
+    task.body();
+  }
+  catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+    // Don't leave the other stages waiting for this one
+    stopping_ = true;
+    for (auto& channel: channels_)
+      channel->cancel();
+  }
+}
+
+}  // namespace mru
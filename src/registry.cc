@@ -0,0 +1,103 @@
+/** 
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Implementation of calibration file watching
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>. 
+ */
+
+extern "C" {
+  #include <sys/inotify.h>
+  #include <poll.h>
+  #include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+
+#include <boost/filesystem.hpp>
+
+#include "../include/errors.h"
+#include "../include/registry.h"
+
+namespace mru {
+
+File_watcher::File_watcher(const std::string& filename, const Change_handler& handler):
+    name_(), handler_(handler), inotify_(-1), stop_{-1, -1}, thread_()
+{
+  boost::filesystem::path path(filename);
+  name_ = path.filename().string();
+  std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+  inotify_ = inotify_init1(IN_CLOEXEC);
+  if (inotify_ < 0) {
+    throw Error("Failed to initialize inotify", errno);
+  }
+  if (inotify_add_watch(inotify_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    int error = errno;
+    close(inotify_);
+    throw Error("Failed to watch calibration directory: " + directory, error);
+  }
+  if (pipe(stop_) < 0) {
+    int error = errno;
+    close(inotify_);
+    throw Error("Failed to create watcher pipe", error);
+  }
+  thread_ = std::thread(&File_watcher::run_, this);
+}
+
+File_watcher::~File_watcher()
+{
+  char quit = 0;
+  if (write(stop_[1], &quit, 1) < 0) {
+    // Nothing sensible left to do: the thread would never stop
+  }
+  thread_.join();
+  close(stop_[0]);
+  close(stop_[1]);
+  close(inotify_);
+}
+
+void File_watcher::run_()
+{
+  alignas(struct inotify_event) char buffer[4096];
+  struct pollfd fds[2] = {
+    {inotify_, POLLIN, 0},
+    {stop_[0], POLLIN, 0}
+  };
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    if (fds[1].revents != 0)
+      return;
+    ssize_t length = read(inotify_, buffer, sizeof(buffer));
+    if (length <= 0)
+      continue;
+    bool changed = false;
+    for (char* p = buffer; p < buffer + length; ) {
+      struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+      if (event->len > 0 && name_ == event->name)
+        changed = true;
+      p += sizeof(struct inotify_event) + event->len;
+    }
+    if (changed)
+      handler_();
+  }
+}
+
+}  // namespace mru
+
+// vim: syntax=cpp : shiftwidth=2 : tabstop=2 : expandtab :
@@ -0,0 +1,131 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+
+#include "../../include/types.h"
+#include "../../include/ahrs.h"
+
+
+using namespace mru;
+using namespace std;
+
+// Earth magnetic field, north east down, micro tesla
+static const Vector<double> earth_field(20, 0, 45);
+static const Vector<double> earth_gravity(0, 0, 9.81);
+
+// Sensor readings at rest for the orientation given by heading, pitch and roll
+static void readings(double heading, double pitch, double roll,
+                     Vector<double>& acceleration, Vector<double>& magnetic_flux) {
+  UnitQuaternion<double> q = 
+      UnitQuaternion<double>(cos(heading / 2), 0, 0, sin(heading / 2)) *
+      UnitQuaternion<double>(cos(pitch / 2), 0, sin(pitch / 2), 0) *
+      UnitQuaternion<double>(cos(roll / 2), sin(roll / 2), 0, 0);
+  UnitQuaternion<double> inverse = q.conjugate();
+  acceleration = -inverse.rotate(earth_gravity);
+  magnetic_flux = inverse.rotate(earth_field);
+}
+
+class AHRSTest: public CppUnit::TestFixture {
+  void testAlign() {
+    Vector<double> acc, mag;
+    readings(d2r(90.0), d2r(10.0), d2r(-20.0), acc, mag);
+    UnitQuaternion<double> q = align_quaternion<double>(acc, mag);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, q.heading().to_degrees(), 1E-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, q.pitch().to_degrees(), 1E-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-20.0, q.roll().to_degrees(), 1E-9);
+  }
+  template <class Filter>
+  void converge(Filter& filter, const int steps) {
+    Vector<double> acc, mag;
+    readings(d2r(60.0), d2r(10.0), d2r(20.0), acc, mag);
+    for (int i = 0; i < steps; ++i) {
+      filter.update(Vector<double>(0, 0, 0), acc, mag, 0.01);
+    }
+  }
+  template <class Filter>
+  void check_converged(Filter& filter) {
+    UnitQuaternion<double> q = filter.rotation();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(60.0, q.heading().to_degrees(), 0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, q.pitch().to_degrees(), 0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, q.roll().to_degrees(), 0.1);
+  }
+  void testMadgwickConvergence() {
+    // Gradient steps have fixed size beta * dt, so the final gain sets the jitter
+    Madgwick<double> filter(0.5);
+    converge(filter, 3000);
+    filter.set_beta(0.02);
+    converge(filter, 1000);
+    check_converged(filter);
+  }
+  void testMahonyConvergence() {
+    // Heading error feedback is scaled by the horizontal field fraction: slow
+    Mahony<double> filter(2.0, 0.0);
+    converge(filter, 6000);
+    check_converged(filter);
+  }
+  void testGyroIntegration() {
+    Mahony<double> filter(0.0, 0.0);
+    for (int i = 0; i < 1000; ++i) {
+      filter.update(Vector<double>(0, 0, M_PI / 2), Vector<double>(0, 0, 0), 0.001);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, filter.rotation().heading().to_degrees(), 1E-3);
+  }
+  void testMahonyBias() {
+    Mahony<double> filter(2.0, 0.5);
+    Vector<double> acc, mag;
+    readings(0, 0, 0, acc, mag);
+    Vector<double> bias(0.01, -0.02, 0.03);
+    for (int i = 0; i < 20000; ++i) {
+      filter.update(bias, acc, mag, 0.01);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.01, filter.integral().x(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02, filter.integral().y(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.03, filter.integral().z(), 1E-4);
+  }
+  void testEngine() {
+    AHRS<Madgwick<double>, double> ahrs;
+    int published = 0;
+    ahrs.set_sample_handler([&](const AHRS<Madgwick<double>, double>::Sample_type&) { ++published; });
+    Vector<double> acc, mag;
+    readings(d2r(200.0), d2r(-5.0), d2r(15.0), acc, mag);
+    Time time = now();
+    ahrs.add_acceleration(Sample<double, Acceleration>(time, acc));
+    ahrs.add_magnetic_flux(Sample<double, MagneticFlux>(time, mag));
+    for (int i = 0; i < 100; ++i) {
+      time += std::chrono::milliseconds(10);
+      ahrs.add_angular_velocity(Sample<double, AngularVelocity, Temperature>(
+          time, Vector<double>(0, 0, 0), 20.0));
+    }
+    // First gyroscope sample only starts the clock
+    CPPUNIT_ASSERT_EQUAL(99, published);
+    CPPUNIT_ASSERT_EQUAL((size_t)99, ahrs.history().size());
+    CPPUNIT_ASSERT(ahrs.data().time == time);
+    // Aligned on the first update: only gradient step jitter left
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(200.0, (get<double, Heading>(ahrs.data()).to_degrees()), 0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-5.0, (get<double, Pitch>(ahrs.data()).to_degrees()), 0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(15.0, (get<double, Roll>(ahrs.data()).to_degrees()), 0.1);
+  }
+public:
+  CPPUNIT_TEST_SUITE(AHRSTest);
+  CPPUNIT_TEST(testAlign);
+  CPPUNIT_TEST(testMadgwickConvergence);
+  CPPUNIT_TEST(testMahonyConvergence);
+  CPPUNIT_TEST(testGyroIntegration);
+  CPPUNIT_TEST(testMahonyBias);
+  CPPUNIT_TEST(testEngine);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(AHRSTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+} 
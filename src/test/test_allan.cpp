@@ -0,0 +1,82 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <random>
+
+#include "../../include/types.h"
+#include "../../include/allan.h"
+
+
+using namespace mru;
+using namespace std;
+
+class AllanTest: public CppUnit::TestFixture {
+  void testRamp() {
+    // A rate ramp of r per sample has Allan variance (r m)^2 / 2
+    Allan<double, 1> allan(0.01, 8);
+    const double r = 0.001;
+    for (int i = 0; i < 10000; ++i) {
+      allan.add(r * i + 5.0);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)10000, allan.samples());
+    vector<Allan_point<double> > curve = allan.curve(0);
+    CPPUNIT_ASSERT_EQUAL((size_t)9, curve.size());
+    for (size_t l = 0; l < curve.size(); ++l) {
+      double m = 1 << l;
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01 * m, curve[l].tau, 1E-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(sqr(r * m) / 2, curve[l].variance, 1E-12);
+    }
+    // Clusters of 2^l samples overlap by half
+    CPPUNIT_ASSERT_EQUAL((size_t)9999, curve[0].count);
+    CPPUNIT_ASSERT_EQUAL((size_t)9997, curve[1].count);
+    CPPUNIT_ASSERT_EQUAL((size_t)2497, curve[3].count);
+  }
+  void testWhiteNoise() {
+    // White noise: variance falls with the cluster size
+    Allan<double, 3> allan(0.005);
+    mt19937 generator(7);
+    normal_distribution<double> noise(0.0, 0.1);
+    for (int i = 0; i < 200000; ++i) {
+      allan.add(Vector<double>(noise(generator), noise(generator) + 1.0, 0.0));
+    }
+    vector<Allan_point<double> > x = allan.curve(0);
+    vector<Allan_point<double> > y = allan.curve(1);
+    vector<Allan_point<double> > z = allan.curve(2);
+    for (size_t l = 0; l < 8; ++l) {
+      double expected = 0.01 / (1 << l);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, x[l].variance, expected * 0.1);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, y[l].variance, expected * 0.1);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, z[l].variance, 1E-20);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.1, x[0].deviation(), 0.005);
+  }
+  void testLevels() {
+    CPPUNIT_ASSERT_THROW((Allan<double, 1>(0.01, 0)), Error);
+    Allan<float, 1> allan(1, 2);
+    for (int i = 0; i < 100; ++i) {
+      allan.add(float(i % 3));
+    }
+    // Cluster sizes 1, 2 and 4 only
+    CPPUNIT_ASSERT_EQUAL((size_t)3, allan.curve(0).size());
+  }
+public:
+  CPPUNIT_TEST_SUITE(AllanTest);
+  CPPUNIT_TEST(testRamp);
+  CPPUNIT_TEST(testWhiteNoise);
+  CPPUNIT_TEST(testLevels);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(AllanTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
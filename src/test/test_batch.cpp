@@ -0,0 +1,65 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+
+#include "../../include/types.h"
+#include "../../include/calibration.h"
+#include "../../include/batch.h"
+
+
+using namespace mru;
+using namespace std;
+
+class BatchTest: public CppUnit::TestFixture {
+  void testTriples() {
+    Calibration<double> calibration(
+        0.0039, 0.0001, -0.0002, 0.05,
+        -0.0001, 0.0041, 0.0003, -0.12,
+        0.0002, 0.0, 0.0038, 0.3,
+        0.5, 21);
+    // Odd count to run the remainder after the vector loop
+    const size_t count = 1003;
+    vector<int16_t> raw(3 * count);
+    srand(7);
+    for (auto& r: raw)
+      r = static_cast<int16_t>(rand() % 65536 - 32768);
+    vector<float> x(count), y(count), z(count);
+    calibrate_triples(&raw[0], count, batch_calibration(calibration), &x[0], &y[0], &z[0]);
+    for (size_t i = 0; i < count; ++i) {
+      Vector<double> expected = calibration.correct(Point<double>(raw[3 * i], raw[3 * i + 1], raw[3 * i + 2]));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.x(), x[i], 1E-3);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.y(), y[i], 1E-3);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z(), z[i], 1E-3);
+    }
+    vector<float> values(count);
+    calibrate_values(&raw[0], count, batch_calibration(calibration), &values[0]);
+    for (size_t i = 0; i < count; ++i)
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(calibration.correct(double(raw[i])), values[i], 2E-3);
+  }
+  void testEmpty() {
+    float x = 1, y = 2, z = 3;
+    calibrate_triples(0, 0, batch_calibration(Calibration<float>()), &x, &y, &z);
+    CPPUNIT_ASSERT_EQUAL(1.0f, x);
+  }
+public:
+  CPPUNIT_TEST_SUITE(BatchTest);
+  CPPUNIT_TEST(testTriples);
+  CPPUNIT_TEST(testEmpty);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(BatchTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,223 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../include/bus_manager.h"
+#include "../../include/stream.h"
+#include "../../include/types.h"
+#include "../../include/errors.h"
+
+
+using namespace mru;
+using namespace std;
+using std::chrono::milliseconds;
+
+struct Fake_bus {
+  Fake_bus(const int busno): busno_(busno) {}
+  int get_bus() const { return busno_; }
+private:
+  int busno_;
+};
+
+/// Chip whose poll holds the bus for a while and yields one counted sample
+struct Counting_chip: public Sample_stream<float, Temperature> {
+  Counting_chip(Fake_bus&, const int transfer_us, const int fail_after=-1):
+      transfer_us_(transfer_us), fail_after_(fail_after), count_(0) {}
+  void poll() {
+    if (count_ == fail_after_)
+      throw Error("Bus error");
+    this_thread::sleep_for(chrono::microseconds(transfer_us_));
+    push_sample(Sample_type(now(), float(count_++)));
+  }
+private:
+  int transfer_us_;
+  int fail_after_;
+  int count_;
+};
+
+/// Processor checking that the batches of a chip come in order
+struct Order_check {
+  Order_check(): next(0), ordered(true) {}
+  void operator()(const Batch<Counting_chip::Sample_type>& batch) {
+    for (auto& sample: batch) {
+      ordered = ordered && get<float, Temperature>(sample) == next;
+      ++next;
+    }
+  }
+  int next;
+  bool ordered;
+};
+
+/// Task counting how often it is copied
+struct Copy_count {
+  explicit Copy_count(atomic<int>& copies): copies(&copies) {}
+  Copy_count(const Copy_count& other): copies(other.copies) { ++*copies; }
+  Copy_count(Copy_count&&) = default;
+  void operator()() const {}
+  atomic<int>* copies;
+};
+
+class BusManagerTest: public CppUnit::TestFixture {
+  void testPool() {
+    Work_pool pool(4);
+    CPPUNIT_ASSERT_EQUAL(4, pool.size());
+    atomic<int> sum(0);
+    for (int i = 1; i <= 1000; ++i)
+      pool.submit([&sum, i]() { sum += i; });
+    pool.wait();
+    CPPUNIT_ASSERT_EQUAL(500500, sum.load());
+    CPPUNIT_ASSERT_EQUAL((size_t)1000, pool.executed());
+    pool.submit([]() { throw Error("Task failed"); });
+    CPPUNIT_ASSERT_THROW(pool.wait(), Error);
+    pool.wait();
+  }
+  void testStealing() {
+    // Tasks spawned by one task land on its worker; idle workers take them
+    Work_pool pool(4);
+    atomic<int> done(0);
+    pool.submit([&pool, &done]() {
+      for (int i = 0; i < 40; ++i)
+        pool.submit([&done]() {
+          this_thread::sleep_for(chrono::milliseconds(1));
+          ++done;
+        });
+    });
+    pool.wait();
+    CPPUNIT_ASSERT_EQUAL(40, done.load());
+    CPPUNIT_ASSERT(pool.stolen() > 0);
+  }
+  void testStrand() {
+    Work_pool pool(4);
+    Strand strand(pool);
+    vector<int> order;
+    atomic<int> inside(0);
+    bool exclusive = true;
+    for (int i = 0; i < 1000; ++i)
+      strand.submit([&order, &inside, &exclusive, i]() {
+        exclusive = exclusive && ++inside == 1;
+        order.push_back(i);
+        --inside;
+      });
+    pool.wait();
+    CPPUNIT_ASSERT(exclusive);
+    CPPUNIT_ASSERT_EQUAL((size_t)1000, order.size());
+    bool ordered = true;
+    for (int i = 0; i < 1000; ++i)
+      ordered = ordered && order[i] == i;
+    CPPUNIT_ASSERT(ordered);
+    // Tasks, and the batches they hold, are moved all the way
+    atomic<int> copies(0);
+    for (int i = 0; i < 100; ++i) {
+      strand.submit(Copy_count(copies));
+      pool.submit(Copy_count(copies));
+    }
+    pool.wait();
+    CPPUNIT_ASSERT_EQUAL(0, copies.load());
+  }
+  void testManager() {
+    Bus_manager<Fake_bus> manager(2);
+    Order_check checks[4];
+    for (int b = 0; b < 2; ++b) {
+      Fake_bus& bus = manager.add_bus(b, milliseconds(2));
+      manager.add_chip<Counting_chip>(bus, [&checks, b](const Batch<Counting_chip::Sample_type>& batch) {
+        checks[2 * b](batch);
+      }, 100);
+      manager.add_chip<Counting_chip>(bus, [&checks, b](const Batch<Counting_chip::Sample_type>& batch) {
+        checks[2 * b + 1](batch);
+      }, 100);
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)2, manager.bus_count());
+    manager.start();
+    CPPUNIT_ASSERT(manager.running());
+    this_thread::sleep_for(chrono::milliseconds(50));
+    manager.stop();
+    CPPUNIT_ASSERT(!manager.running());
+    Bus_statistics total = manager.statistics();
+    Bus_statistics first = manager.statistics(0), second = manager.statistics(1);
+    CPPUNIT_ASSERT(first.polls > 5 && second.polls > 5);
+    CPPUNIT_ASSERT_EQUAL(first.samples + second.samples, total.samples);
+    CPPUNIT_ASSERT_EQUAL(2 * first.polls, first.samples);
+    // Everything read was processed, per chip in order
+    CPPUNIT_ASSERT_EQUAL(total.samples, total.processed);
+    size_t processed = 0;
+    for (auto& check: checks) {
+      CPPUNIT_ASSERT(check.ordered);
+      processed += check.next;
+    }
+    CPPUNIT_ASSERT_EQUAL(total.samples, processed);
+    CPPUNIT_ASSERT(total.busy > milliseconds(1));
+    CPPUNIT_ASSERT(manager.throughput() > 0);
+    CPPUNIT_ASSERT_THROW(manager.statistics(7), Error);
+  }
+  void testScaling() {
+    // Polls that wait on the bus don't hold up the other buses
+    size_t samples[2];
+    const int counts[2] = {1, 4};
+    for (int i = 0; i < 2; ++i) {
+      Bus_manager<Fake_bus> manager(2);
+      for (int b = 0; b < counts[i]; ++b) {
+        Fake_bus& bus = manager.add_bus(b, Duration());
+        manager.add_chip<Counting_chip>(bus, [](const Batch<Counting_chip::Sample_type>&) {}, 1000);
+      }
+      manager.start();
+      this_thread::sleep_for(chrono::milliseconds(100));
+      manager.stop();
+      samples[i] = manager.statistics().samples;
+    }
+    // Polled in turn, four buses would give no more than one; the margin
+    // is for loaded test machines
+    CPPUNIT_ASSERT(samples[1] > 2 * samples[0]);
+  }
+  void testError() {
+    Bus_manager<Fake_bus> manager(1);
+    Fake_bus& bus = manager.add_bus(3, milliseconds(1));
+    manager.add_chip<Counting_chip>(bus, [](const Batch<Counting_chip::Sample_type>&) {}, 0, 5);
+    manager.start();
+    CPPUNIT_ASSERT_THROW(manager.add_bus(4, milliseconds(1)), Error);
+    this_thread::sleep_for(chrono::milliseconds(20));
+    CPPUNIT_ASSERT_THROW(manager.stop(), Error);
+    CPPUNIT_ASSERT_EQUAL((size_t)5, manager.statistics(3).samples);
+    // With a failing processor too, the bus error is the one reported
+    Bus_manager<Fake_bus> failing(1);
+    Fake_bus& other = failing.add_bus(4, milliseconds(1));
+    failing.add_chip<Counting_chip>(other, [](const Batch<Counting_chip::Sample_type>&) {
+      throw Error("Processor error", 1);
+    }, 0, 5);
+    failing.start();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    string message;
+    try {
+      failing.stop();
+    }
+    catch (const Error& error) {
+      message = error.get_message();
+    }
+    CPPUNIT_ASSERT_EQUAL(string("Bus error Error: 0"), message);
+  }
+public:
+  CPPUNIT_TEST_SUITE(BusManagerTest);
+  CPPUNIT_TEST(testPool);
+  CPPUNIT_TEST(testStealing);
+  CPPUNIT_TEST(testStrand);
+  CPPUNIT_TEST(testManager);
+  CPPUNIT_TEST(testScaling);
+  CPPUNIT_TEST(testError);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(BusManagerTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -49,6 +49,26 @@ class CalibrationTest: public CppUnit::TestFixture {
     calibration = mru::load_calibration(app_path/"calibration/copy.ini", "test_copy");
     CPPUNIT_ASSERT_EQUAL((Scalar)2.2, calibration.x_factor());
   }
+  void testSaveFull() {
+    Calibration calibration(
+        0.5, 0.01, -0.02, 1.5,
+        0.03, 0.6, 0.04, -2.5,
+        -0.05, 0.06, 0.7, 3.5,
+        1, 0);
+    mru::save_calibration(app_path / "calibration/temp.ini", "test", calibration);
+    Calibration loaded = mru::load_calibration(app_path/"calibration/temp.ini", "test");
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(calibration.correction(i, j), loaded.correction(i, j), 1E-6);
+      }
+    }
+    // Back to diagonal: the cross terms must not linger
+    mru::save_calibration(app_path / "calibration/temp.ini", "test", Calibration(2, 1, 3, 1, 4, 1, 1, 0));
+    loaded = mru::load_calibration(app_path/"calibration/temp.ini", "test");
+    CPPUNIT_ASSERT_EQUAL((Scalar)2, loaded.x_factor());
+    CPPUNIT_ASSERT_EQUAL((Scalar)0, loaded.correction(0, 1));
+    CPPUNIT_ASSERT_EQUAL((Scalar)4, loaded.z_factor());
+  }
 public:
   virtual void setUp() {
     boost::filesystem::remove(app_path/"calibration/copy.ini");
@@ -62,6 +82,7 @@ public:
   CPPUNIT_TEST(testLoadNonExisting);
   CPPUNIT_TEST(testSave);
   CPPUNIT_TEST(testSaveExisting);
+  CPPUNIT_TEST(testSaveFull);
   CPPUNIT_TEST_SUITE_END();
 };
 
@@ -72,6 +72,44 @@ public:
   CPPUNIT_TEST_SUITE_END();
 };
 
+class ITG3200ForTest: public ITG3200T<I2CDeviceMock, float> {
+public:
+  using ITG3200T<I2CDeviceMock, float>::ITG3200T;
+  using ITG3200T<I2CDeviceMock, float>::device;
+};
+
+class ITG3200Test: public CppUnit::TestFixture {
+  I2CDeviceMock::Bus_type bus;
+  void test_compensation() {
+    ITG3200ForTest chip(bus);
+    CPPUNIT_ASSERT(!chip.compensation());
+    Words words = {0, 10, 20, 30};
+    chip.device().write_words(0x1B, words);
+    Temperature_model<float> model;
+    model.bias[0][0] = 1;
+    chip.set_temperature_model(model);
+    const Temperature_compensation<float>* first = chip.compensation();
+    CPPUNIT_ASSERT(first);
+    chip.poll();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(9.0, (get<float, AngularVelocity>(chip.data()).x()), 1E-6);
+    // A replaced compensation stays valid for whoever still reads it
+    model.bias[0][0] = 2;
+    chip.set_temperature_model(model);
+    CPPUNIT_ASSERT_EQUAL(1.0f, first->model().bias[0][0]);
+    chip.poll();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(8.0, (get<float, AngularVelocity>(chip.data()).x()), 1E-6);
+    chip.set_temperature_model(Temperature_model<float>());
+    CPPUNIT_ASSERT(!chip.compensation());
+    chip.poll();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, (get<float, AngularVelocity>(chip.data()).x()), 1E-6);
+    chip.reclaim();
+  }
+public:
+  CPPUNIT_TEST_SUITE(ITG3200Test);
+  CPPUNIT_TEST(test_compensation);
+  CPPUNIT_TEST_SUITE_END();
+};
+
 class BMP085ForTest: public BMP085T<I2CDeviceMock, float> {
 public:
   using BMP085T<I2CDeviceMock, float>::BMP085T;
@@ -91,6 +129,34 @@ class BMP085Test : public CppUnit::TestFixture {
     CPPUNIT_ASSERT_EQUAL(150, temp);
     CPPUNIT_ASSERT_EQUAL(69964, pressure);
   }
+  void test_pipeline() {
+    ps->initialize();
+    ps->set_temperature_interval(2);
+    ps->device().words[0xF6 >> 1] = 27898;
+    Bytes raw_pressure = {0x5D, 0x23, 0x00};
+    ps->device().write_bytes(0xF6, raw_pressure);
+    // Starts temperature conversion
+    ps->poll();
+    CPPUNIT_ASSERT_EQUAL(0x2E, (int)ps->device().bytes[0xF4]);
+    // Not done yet: no bus traffic
+    ps->device().bytes[0xF4] = 0;
+    ps->poll();
+    CPPUNIT_ASSERT_EQUAL(0, (int)ps->device().bytes[0xF4]);
+    for (int i = 0; i < 2; ++i) {
+      std::this_thread::sleep_until(ps->ready_time());
+      ps->poll();
+      CPPUNIT_ASSERT_EQUAL(0x34, (int)ps->device().bytes[0xF4]);
+    }
+    // Temperature gets refreshed after two pressure readings
+    std::this_thread::sleep_until(ps->ready_time());
+    ps->poll();
+    CPPUNIT_ASSERT_EQUAL(0x2E, (int)ps->device().bytes[0xF4]);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, ps->history().size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(69964.0, (get<float, Pressure>(ps->data())), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(150.0, (get<float, Temperature>(ps->data())), 1E-6);
+    Duration spacing = ps->history()[1].time - ps->history()[0].time;
+    CPPUNIT_ASSERT(spacing >= BMP085ForTest::conversion_time(0));
+  }
 public:
   virtual void setUp() {
     bus = new I2CDeviceMock::Bus_type;
@@ -115,6 +181,175 @@ public:
 public:
   CPPUNIT_TEST_SUITE(BMP085Test);
   CPPUNIT_TEST(test_evaluation);
+  CPPUNIT_TEST(test_pipeline);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+class FXOS8700ForTest: public FXOS8700T<I2CDeviceMock, float> {
+public:
+  using FXOS8700T<I2CDeviceMock, float>::FXOS8700T;
+  using FXOS8700T<I2CDeviceMock, float>::device;
+};
+
+class FXOS8700Test: public CppUnit::TestFixture {
+  I2CDeviceMock::Bus_type bus;
+  void test_burst() {
+    FXOS8700ForTest chip(bus);
+    chip.initialize();
+    CPPUNIT_ASSERT_EQUAL(0x03, (int)chip.device().bytes[FXOS8700ForTest::reg_m_ctrl_1] & 0x03);
+    CPPUNIT_ASSERT_EQUAL(0x20, (int)chip.device().bytes[FXOS8700ForTest::reg_m_ctrl_2]);
+    // No new data: nothing published
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, chip.history().size());
+    Bytes burst = {0x08, 0x01, 0x00, 0xFF, 0xFC, 0x00, 0x08, 0x00, 0x10, 0xFF, 0xF0, 0x00, 0x01};
+    chip.device().write_bytes(0, burst);
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)1, chip.history().size());
+    auto acc = get<float, Acceleration>(chip.data());
+    auto mag = get<float, MagneticFlux>(chip.data());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(64.0, acc.x(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-1.0, acc.y(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, acc.z(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(16.0, mag.x(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-16.0, mag.y(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, mag.z(), 1E-6);
+  }
+public:
+  CPPUNIT_TEST_SUITE(FXOS8700Test);
+  CPPUNIT_TEST(test_burst);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+class FXAS21002ForTest: public FXAS21002T<I2CDeviceMock, float> {
+public:
+  using FXAS21002T<I2CDeviceMock, float>::FXAS21002T;
+  using FXAS21002T<I2CDeviceMock, float>::device;
+};
+
+class FXAS21002Test: public CppUnit::TestFixture {
+  I2CDeviceMock::Bus_type bus;
+  void test_drain() {
+    FXAS21002ForTest chip(bus);
+    chip.initialize();
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, chip.history().size());
+    Bytes data = {0x00, 0x10, 0xFF, 0xF0, 0x01, 0x00};
+    chip.device().write_bytes(0x01, data);
+    chip.device().bytes[0x08] = 1;
+    chip.device().bytes[0x12] = 0xFE;
+    chip.poll();
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)2, chip.history().size());
+    auto gyr = get<float, AngularVelocity>(chip.data());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(16.0, gyr.x(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-16.0, gyr.y(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(256.0, gyr.z(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2.0, (get<float, Temperature>(chip.data())), 1E-6);
+  }
+  void test_fifo_clock() {
+    Duration period = std::chrono::milliseconds(5);
+    Fifo_clock clock(period);
+    Time t = now();
+    Time first = clock.first(t, 4);
+    CPPUNIT_ASSERT(first < t - period * 3);
+    // Next drain half a period late: time line continues
+    Time second = clock.first(t + period * 9 / 2, 4);
+    CPPUNIT_ASSERT(second > first + period * 4);
+    CPPUNIT_ASSERT(second - (first + period * 4) < period / 2);
+    // Drain way off: resynchronize
+    Time third = clock.first(t + period * 100, 2);
+    CPPUNIT_ASSERT(third == t + period * 98 + period / 2);
+    // 3200 Hz: a period of 312.5 us must not be truncated over a full FIFO
+    Fifo_clock fast(std::chrono::nanoseconds(312500));
+    Time start = fast.first(t, 32);
+    CPPUNIT_ASSERT(fast.at(start, 31) - start == std::chrono::nanoseconds(9687500));
+    CPPUNIT_ASSERT(fast.at(start, 1) - start == std::chrono::nanoseconds(312500));
+  }
+public:
+  CPPUNIT_TEST_SUITE(FXAS21002Test);
+  CPPUNIT_TEST(test_drain);
+  CPPUNIT_TEST(test_fifo_clock);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+class BNO055ForTest: public BNO055T<I2CDeviceMock, float> {
+public:
+  using BNO055T<I2CDeviceMock, float>::BNO055T;
+  using BNO055T<I2CDeviceMock, float>::device;
+};
+
+class BNO055Test: public CppUnit::TestFixture {
+  I2CDeviceMock::Bus_type bus;
+  void test_poll() {
+    BNO055ForTest chip(bus);
+    chip.initialize();
+    // 1g down, 90 degrees heading: quaternion (cos 45, 0, 0, sin 45)
+    Bytes acc = {0x00, 0x00, 0x00, 0x00, 0xAB, 0x03};
+    Bytes qua = {0x82, 0x2D, 0x00, 0x00, 0x00, 0x00, 0x82, 0x2D};
+    chip.device().write_bytes(0x08, acc);
+    chip.device().write_bytes(0x20, qua);
+    chip.device().bytes[0x34] = 23;
+    chip.device().bytes[0x35] = 0xFF;
+    chip.device().bytes[0x39] = 0x05;
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL(0, chip.status());
+    CPPUNIT_ASSERT_EQUAL(0xFF, chip.calibration_status());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, chip.history().size());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(9.39, (get<float, Acceleration>(chip.data()).z()), 1E-5);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(23.0, (get<float, Temperature>(chip.data())), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, (get<float, Heading>(chip.data()).to_degrees()), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, (get<float, Pitch>(chip.data()).to_degrees()), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, (get<float, Roll>(chip.data()).to_degrees()), 1E-3);
+    chip.device().bytes[0x3A] = 0x01;
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL(0x0100, chip.status());
+  }
+public:
+  CPPUNIT_TEST_SUITE(BNO055Test);
+  CPPUNIT_TEST(test_poll);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+class LSM303DLHCForTest: public LSM303DLHCT<I2CDeviceMock, float> {
+public:
+  using LSM303DLHCT<I2CDeviceMock, float>::LSM303DLHCT;
+  using LSM303DLHCT<I2CDeviceMock, float>::device;
+  using LSM303DLHCT<I2CDeviceMock, float>::magnetometer;
+};
+
+class LSM303DLHCTest: public CppUnit::TestFixture {
+  I2CDeviceMock::Bus_type bus;
+  void test_drain() {
+    LSM303DLHCForTest chip(bus);
+    chip.initialize();
+    CPPUNIT_ASSERT_EQUAL(0x80, (int)chip.device().bytes[LSM303DLHCForTest::reg_fifo_ctrl_a]);
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, chip.history().size());
+    // Two samples in the FIFO, read from the auto incremented address
+    Bytes data = {0x10, 0x00, 0xF0, 0xFF, 0x00, 0x40, 0x20, 0x00, 0xE0, 0xFF, 0x00, 0x80};
+    chip.device().write_bytes(0x28 | 0x80, data);
+    chip.device().bytes[0x2F] = 2;
+    Bytes mag = {0x00, 0x01, 0x00, 0x03, 0xFF, 0xFE};
+    chip.magnetometer().write_bytes(0x03, mag);
+    chip.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)2, chip.history().size());
+    auto acc = get<float, Acceleration>(chip.history()[0]);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, acc.x(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-1.0, acc.y(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1024.0, acc.z(), 1E-6);
+    acc = get<float, Acceleration>(chip.data());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, acc.x(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2048.0, acc.z(), 1E-6);
+    auto flux = get<float, MagneticFlux>(chip.data());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, flux.x(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2.0, flux.y(), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(3.0, flux.z(), 1E-6);
+    CPPUNIT_ASSERT(chip.history()[1].time - chip.history()[0].time == 
+                   LSM303DLHCForTest::rate_period(LSM303DLHCForTest::reg_ctrl_1_a_400hz));
+  }
+public:
+  CPPUNIT_TEST_SUITE(LSM303DLHCTest);
+  CPPUNIT_TEST(test_drain);
   CPPUNIT_TEST_SUITE_END();
 };
 
@@ -122,7 +357,12 @@ int main()
 {
   CppUnit::TextUi::TestRunner runner;
   runner.addTest(ADXL345Test::suite());
+  runner.addTest(ITG3200Test::suite());
   runner.addTest(BMP085Test::suite());
+  runner.addTest(FXOS8700Test::suite());
+  runner.addTest(FXAS21002Test::suite());
+  runner.addTest(BNO055Test::suite());
+  runner.addTest(LSM303DLHCTest::suite());
   if (runner.run())
     return 0;
   else
@@ -0,0 +1,118 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+#include "../../include/clock.h"
+#include "../../include/errors.h"
+
+
+using namespace mru;
+using namespace std;
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+
+static double uniform() {
+  return rand() / double(RAND_MAX);
+}
+
+class ClockTest: public CppUnit::TestFixture {
+  void testTime() {
+    CPPUNIT_ASSERT(!Time().valid());
+    Time t = Time::from_nanoseconds(1000000005);
+    CPPUNIT_ASSERT(t.valid());
+    CPPUNIT_ASSERT_EQUAL(sizeof(int64_t), sizeof(Time));
+    Time u = t + milliseconds(3);
+    CPPUNIT_ASSERT_EQUAL((int64_t)1003000005, u.nanoseconds());
+    CPPUNIT_ASSERT(u - t == milliseconds(3));
+    CPPUNIT_ASSERT(t < u && u > t && t != u && t == u - milliseconds(3));
+    ostringstream s;
+    s << t;
+    CPPUNIT_ASSERT_EQUAL(string("1.000000005"), s.str());
+  }
+  void testNow() {
+    Time a = now();
+    Time b = now();
+    CPPUNIT_ASSERT(b >= a);
+    boost::posix_time::time_duration difference = to_utc(now()) - utc_now();
+    CPPUNIT_ASSERT(difference.abs() < boost::posix_time::milliseconds(10));
+    Utc_mapping mapping;
+    // UTC has microsecond resolution
+    CPPUNIT_ASSERT(std::abs(to_nanoseconds(mapping.time(mapping.utc(a)) - a)) < 1000);
+  }
+  void testFilter() {
+    // Chip running 1% slow on a nominal 10 ms, captured 100 to 300 us late
+    srand(11);
+    Timestamp_filter filter(milliseconds(10));
+    const Time start = Time::from_nanoseconds(5000000000);
+    const double period = 10.1E-3, latency = 200E-6;
+    double raw_error = 0, filtered_error = 0;
+    for (int i = 0; i < 1000; ++i) {
+      double sampled = i * period;
+      double captured = sampled + latency + (uniform() - 0.5) * 200E-6;
+      Time time = filter.add(start + microseconds(llround(captured * 1E6)));
+      if (i >= 200) {
+        double t = to_seconds(time - start);
+        filtered_error = max(filtered_error, fabs(t - sampled - latency));
+        raw_error = max(raw_error, fabs(captured - sampled - latency));
+      }
+    }
+    CPPUNIT_ASSERT(raw_error > 80E-6);
+    CPPUNIT_ASSERT(filtered_error < 30E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(period, to_nanoseconds(filter.period()) * 1E-9, 2E-6);
+    CPPUNIT_ASSERT(filter.nominal_period() == milliseconds(10));
+  }
+  void testFifoCaptures() {
+    // Eight samples per capture at 1 kHz
+    srand(13);
+    Timestamp_filter filter(milliseconds(1));
+    const Time start = Time::from_nanoseconds(0);
+    double raw = 0, worst = 0;
+    for (int i = 1; i <= 500; ++i) {
+      double newest = (8 * i - 1) * 1E-3;
+      double captured = newest + 400E-6 + (uniform() - 0.5) * 400E-6;
+      Time time = filter.add(start + microseconds(llround(captured * 1E6)), 8);
+      if (i >= 100) {
+        raw = max(raw, fabs(captured - newest - 400E-6));
+        worst = max(worst, fabs(to_seconds(time - start) - newest - 400E-6));
+      }
+    }
+    CPPUNIT_ASSERT(raw > 190E-6);
+    CPPUNIT_ASSERT(worst < 60E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1E-3, to_nanoseconds(filter.period()) * 1E-9, 1E-6);
+  }
+  void testRestart() {
+    Timestamp_filter filter(milliseconds(10));
+    Time t = Time::from_nanoseconds(1000000000);
+    for (int i = 0; i < 10; ++i)
+      filter.add(t + milliseconds(10 * i));
+    // Two seconds without samples: the fit starts over at the capture
+    Time late = t + milliseconds(2000) + microseconds(333);
+    CPPUNIT_ASSERT(filter.add(late) == late);
+    CPPUNIT_ASSERT(filter.period() == milliseconds(10));
+    CPPUNIT_ASSERT_THROW(Timestamp_filter(milliseconds(0)), Error);
+  }
+public:
+  CPPUNIT_TEST_SUITE(ClockTest);
+  CPPUNIT_TEST(testTime);
+  CPPUNIT_TEST(testNow);
+  CPPUNIT_TEST(testFilter);
+  CPPUNIT_TEST(testFifoCaptures);
+  CPPUNIT_TEST(testRestart);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(ClockTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
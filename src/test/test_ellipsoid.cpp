@@ -0,0 +1,134 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../../include/types.h"
+#include "../../include/matrix.h"
+#include "../../include/ellipsoid.h"
+
+
+using namespace mru;
+using namespace std;
+
+// Readings of a 50 uT field in all directions with soft and hard iron
+static vector<Vector<double> > distorted_readings(const int count) {
+  vector<Vector<double> > result;
+  for (int i = 0; i < count; ++i) {
+    // Fibonacci sphere: evenly spread directions
+    double z = 1 - (2.0 * i + 1) / count;
+    double r = sqrt(1 - z * z);
+    double phi = i * M_PI * (3 - sqrt(5.0));
+    double x = 50 * r * cos(phi), y = 50 * r * sin(phi);
+    z *= 50;
+    result.push_back(Vector<double>(
+        1.1 * x + 0.05 * y - 0.02 * z + 12,
+        0.05 * x + 0.9 * y + 0.03 * z - 7,
+        -0.02 * x + 0.03 * y + 1.0 * z + 20));
+  }
+  return result;
+}
+
+struct Fake_magnetometer {
+  Calibration<double> calibration_;
+  string chip_name() { return "fake"; }
+  Calibration<double> calibration() const { return calibration_; }
+  void set_calibration(const Calibration<double>& calibration) { calibration_ = calibration; }
+};
+
+class EllipsoidTest: public CppUnit::TestFixture {
+  void testEigen() {
+    Matrix<3, 3, double> a;
+    a(0, 0) = 4; a(1, 1) = 3; a(2, 2) = 2;
+    a(0, 1) = a(1, 0) = 1;
+    a(1, 2) = a(2, 1) = -0.5;
+    Matrix<3, 1, double> values;
+    Matrix<3, 3, double> vectors;
+    symmetric_eigen(a, values, vectors);
+    for (int l = 0; l < 3; ++l) {
+      for (int i = 0; i < 3; ++i) {
+        double av = 0;
+        for (int j = 0; j < 3; ++j)
+          av += a(i, j) * vectors(j, l);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(values(l, 0) * vectors(i, l), av, 1E-12);
+      }
+    }
+    Matrix<3, 1, double> b, x;
+    b(0, 0) = 1; b(1, 0) = 2; b(2, 0) = 3;
+    CPPUNIT_ASSERT(solve(a, b, x));
+    Matrix<3, 1, double> ax = a * x;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, ax(1, 0), 1E-12);
+    CPPUNIT_ASSERT(!solve(Matrix<3, 3, double>(), b, x));
+  }
+  void testFit() {
+    Ellipsoid_fit<double> fit;
+    vector<Vector<double> > readings = distorted_readings(600);
+    for (auto& reading: readings)
+      fit.add(reading);
+    CPPUNIT_ASSERT(fit.coverage() > 0.9);
+    Correction<double> correction(1, 0, 1, 0, 1, 0);
+    CPPUNIT_ASSERT(fit.solve(correction));
+    // All on a sphere of about the original radius
+    for (auto& reading: readings) {
+      Vector<double> corrected = correction(Vec3<double>(reading.x(), reading.y(), reading.z()));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(50.0, sqrt(corrected.squared_length()), 1.0);
+    }
+    Vector<double> first = correction(Vec3<double>(readings[0].x(), readings[0].y(), readings[0].z()));
+    double radius = sqrt(first.squared_length());
+    for (auto& reading: readings) {
+      Vector<double> corrected = correction(Vec3<double>(reading.x(), reading.y(), reading.z()));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(radius, sqrt(corrected.squared_length()), 1E-6);
+    }
+  }
+  void testCoverage() {
+    // Turning in heading only: a ring, not enough to fit an ellipsoid
+    Ellipsoid_fit<double> fit;
+    for (int i = 0; i < 360; ++i) {
+      double h = d2r(double(i));
+      fit.add(Vector<double>(20 * cos(h), -20 * sin(h), 45));
+    }
+    CPPUNIT_ASSERT(fit.coverage() < 0.5);
+  }
+  void testCalibrator() {
+    Fake_magnetometer magnetometer;
+    {
+      Magnetic_calibrator<Fake_magnetometer, double> calibrator(magnetometer, "", 500);
+      for (auto& reading: distorted_readings(600))
+        calibrator.add_sample(Sample<double, MagneticFlux>(reading));
+      for (int i = 0; i < 200 && calibrator.updates() == 0; ++i)
+        this_thread::sleep_for(chrono::milliseconds(10));
+      CPPUNIT_ASSERT_EQUAL(1, calibrator.updates());
+    }
+    Calibration<double> calibration = magnetometer.calibration();
+    CPPUNIT_ASSERT(calibration.correction(0, 1) != 0);
+    vector<Vector<double> > readings = distorted_readings(100);
+    Vector<double> first = calibration.correct(Point<double>(readings[0].x(), readings[0].y(), readings[0].z()));
+    for (auto& reading: readings) {
+      Vector<double> corrected = calibration.correct(Point<double>(reading.x(), reading.y(), reading.z()));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(sqrt(first.squared_length()), sqrt(corrected.squared_length()), 1E-6);
+    }
+  }
+public:
+  CPPUNIT_TEST_SUITE(EllipsoidTest);
+  CPPUNIT_TEST(testEigen);
+  CPPUNIT_TEST(testFit);
+  CPPUNIT_TEST(testCoverage);
+  CPPUNIT_TEST(testCalibrator);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(EllipsoidTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,89 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "../../include/types.h"
+#include "../../include/euler.h"
+
+
+using namespace mru;
+using namespace std;
+
+class EulerTest: public CppUnit::TestFixture {
+  void testAtan2() {
+    srand(5);
+    for (int i = 0; i < 10000; ++i) {
+      double y = rand() / double(RAND_MAX) * 2 - 1;
+      double x = rand() / double(RAND_MAX) * 2 - 1;
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(atan2(y, x), fast_atan2(y, x), 4E-8);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(atan2(float(y), float(x)), fast_atan2(float(y), float(x)), 1E-6);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(M_PI, fast_atan2(0.0, -1.0), 1E-15);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-M_PI / 2, fast_atan2(-2.0, 0.0), 1E-15);
+    CPPUNIT_ASSERT_EQUAL(0.0, fast_atan2(0.0, 0.0));
+  }
+  void testAsin() {
+    for (int i = -1000; i <= 1000; ++i) {
+      double s = i / 1000.0;
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(asin(s), fast_asin(s), 3E-8);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(M_PI / 2, fast_asin(1.0000001), 1E-15);
+  }
+  void testWrap() {
+    for (int i = -2000; i <= 2000; ++i) {
+      double value = i * 0.01;
+      RotScalar<0, 4, double> heading(value);
+      CPPUNIT_ASSERT(heading.get_value() >= 0 && heading.get_value() < 2 * M_PI);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, sin(heading - value), 1E-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, cos(heading - value), 1E-12);
+      RotScalar<-1, 1, double> pitch(value);
+      CPPUNIT_ASSERT(pitch.get_value() >= -M_PI / 2 && pitch.get_value() <= M_PI / 2);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(sin(value), sin(pitch), 1E-12);
+    }
+    // Just below the lower end rounds onto the upper end in float
+    CPPUNIT_ASSERT(RotScalar<>(-1E-9f).get_value() < RotScalar<>::max);
+    CPPUNIT_ASSERT_EQUAL(0.3, (RotScalar<-1, 1, double>::wrap(0.3)));
+  }
+  void testEulerAngles() {
+    srand(7);
+    Quaternion_array<double> q;
+    for (int i = 0; i < 1000; ++i) {
+      double w = rand() / double(RAND_MAX) * 2 - 1;
+      double x = rand() / double(RAND_MAX) * 2 - 1;
+      double y = rand() / double(RAND_MAX) * 2 - 1;
+      double z = rand() / double(RAND_MAX) * 2 - 1;
+      q.push_back(UnitQuaternion<double>(w, x, y, z));
+    }
+    vector<double> heading, pitch, roll;
+    euler_angles(q, heading, pitch, roll);
+    CPPUNIT_ASSERT_EQUAL(q.size(), heading.size());
+    for (size_t i = 0; i < q.size(); ++i) {
+      UnitQuaternion<double> u = q.get(i);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(u.heading().get_value(), heading[i], 1E-7);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(u.pitch().get_value(), pitch[i], 1E-7);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(u.roll().get_value(), roll[i], 1E-7);
+    }
+  }
+public:
+  CPPUNIT_TEST_SUITE(EulerTest);
+  CPPUNIT_TEST(testAtan2);
+  CPPUNIT_TEST(testAsin);
+  CPPUNIT_TEST(testWrap);
+  CPPUNIT_TEST(testEulerAngles);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(EulerTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,168 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <vector>
+
+#include "../../include/filters.h"
+#include "../../include/stream.h"
+#include "../../include/types.h"
+#include "../../include/errors.h"
+
+
+using namespace mru;
+using namespace std;
+using std::chrono::milliseconds;
+
+/// Amplitude of the last period of a sine of frequency through a filter,
+/// on every channel with its own phase
+template<class Filter>
+static double amplitude(Filter& filter, const double frequency, const double rate) {
+  const int channels = Filter::channels;
+  const int frames = int(rate * 4);
+  vector<float> data(frames * channels);
+  for (int f = 0; f < frames; ++f)
+    for (int c = 0; c < channels; ++c)
+      data[f * channels + c] = sin(2 * M_PI * frequency * f / rate + c);
+  filter.process(data.data(), data.data(), frames);
+  double result = 0;
+  for (int f = frames - int(rate / frequency) - 1; f < frames; ++f)
+    for (int c = 0; c < channels; ++c)
+      result = max<double>(result, fabs(data[f * channels + c]));
+  return result;
+}
+
+struct Fake_accelerometer: public Sample_stream<float, Acceleration, Temperature> {
+  void add(const Time& time, const Vector<float>& acceleration) {
+    push_sample(Sample_type(time, acceleration, 20.0f));
+  }
+};
+
+class FiltersTest: public CppUnit::TestFixture {
+  void testButterworth() {
+    const double rate = 100;
+    for (int order = 1; order <= 5; ++order) {
+      Biquad_cascade<float, 3> lowpass(butterworth_lowpass(order, 10, rate));
+      CPPUNIT_ASSERT_EQUAL(size_t((order + 1) / 2), lowpass.size());
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, lowpass.gain(0.001, rate), 1E-5);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(M_SQRT1_2, lowpass.gain(10, rate), 1E-4);
+      // Maximally flat: no peaking in the pass band
+      for (double f = 0.5; f < 10; f += 0.5)
+        CPPUNIT_ASSERT(lowpass.gain(f, rate) <= 1 + 1E-5);
+      Biquad_cascade<float, 3> highpass(butterworth_highpass(order, 10, rate));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(M_SQRT1_2, highpass.gain(10, rate), 1E-4);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, highpass.gain(49.99, rate), 1E-4);
+    }
+    // Order 4 at two octaves up: 24 dB per octave
+    Biquad_cascade<float, 3> lowpass(butterworth_lowpass(4, 10, rate));
+    CPPUNIT_ASSERT(lowpass.gain(40, rate) < 0.005);
+    CPPUNIT_ASSERT_THROW(butterworth_lowpass(2, 60, rate), Error);
+    CPPUNIT_ASSERT_THROW(butterworth_lowpass(0, 10, rate), Error);
+  }
+  void testSignals() {
+    const double rate = 200;
+    Biquad_cascade<float, 6> lowpass(butterworth_lowpass(4, 5, rate));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, amplitude(lowpass, 1, rate), 0.01);
+    lowpass.reset();
+    CPPUNIT_ASSERT(amplitude(lowpass, 40, rate) < 1E-3);
+    // Engine at 1500 rpm: 25 Hz and harmonics go, 10 Hz stays
+    Biquad_cascade<float, 3> notches(rpm_notches(1500, 5, rate, 10));
+    CPPUNIT_ASSERT_EQUAL((size_t)3, notches.size());
+    CPPUNIT_ASSERT(amplitude(notches, 25, rate) < 0.01);
+    notches.reset();
+    CPPUNIT_ASSERT(amplitude(notches, 50, rate) < 0.01);
+    notches.reset();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, amplitude(notches, 10, rate), 0.05);
+    // Retuned to 1800 rpm without losing state
+    Biquads retuned = rpm_notches(1800, 5, rate, 10);
+    for (size_t s = 0; s < retuned.size(); ++s)
+      notches.set_section(s, retuned[s]);
+    CPPUNIT_ASSERT(amplitude(notches, 30, rate) < 0.01);
+  }
+  void testFir() {
+    const double rate = 100;
+    vector<double> taps = fir_lowpass(51, 10, rate);
+    double sum = 0;
+    for (int i = 0; i < 51; ++i) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(taps[i], taps[50 - i], 1E-12);
+      sum += taps[i];
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, sum, 1E-12);
+    Fir<float, 3> fir(taps);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, fir.gain(0, rate), 1E-6);
+    CPPUNIT_ASSERT(fir.gain(30, rate) < 0.01);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, amplitude(fir, 2, rate), 0.01);
+    fir.reset();
+    CPPUNIT_ASSERT(amplitude(fir, 30, rate) < 0.01);
+    // Impulse response is the taps
+    fir.reset();
+    float frame[3] = {1, 2, 0};
+    fir.process(frame);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(taps[0], frame[0], 1E-7);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2 * taps[0], frame[1], 1E-7);
+    for (int k = 1; k < 51; ++k) {
+      float zero[3] = {0, 0, 0};
+      fir.process(zero);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(taps[k], zero[0], 1E-7);
+    }
+  }
+  void testBlocks() {
+    // A block gives the same as frame by frame
+    Biquad_cascade<float, 3> a(butterworth_lowpass(3, 7, 100)), b(a);
+    Fir<float, 3> c(fir_lowpass(9, 7, 100)), d(c);
+    vector<float> block(300), frames(300), fir_block(300), fir_frames(300);
+    for (int i = 0; i < 300; ++i)
+      block[i] = frames[i] = fir_block[i] = fir_frames[i] = sin(i * 0.37) + (i % 3);
+    a.process(block.data(), block.data(), 100);
+    c.process(fir_block.data(), fir_block.data(), 100);
+    for (int f = 0; f < 100; ++f) {
+      b.process(&frames[3 * f]);
+      d.process(&fir_frames[3 * f]);
+    }
+    for (int i = 0; i < 300; ++i) {
+      CPPUNIT_ASSERT_EQUAL(block[i], frames[i]);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(fir_block[i], fir_frames[i], 1E-6);
+    }
+  }
+  void testStream() {
+    Fake_accelerometer chip;
+    Iir_stream<float, Acceleration> filtered(Biquad_cascade<float, 3>(butterworth_lowpass(2, 1, 100)));
+    filtered.attach(chip);
+    Time t = Time::from_nanoseconds(1000000000);
+    for (int i = 0; i < 1000; ++i)
+      chip.add(t + milliseconds(10 * i), Vector<float>(1, -2, (i % 2) ? 10.0f : -10.0f));
+    CPPUNIT_ASSERT_EQUAL((size_t)1000, filtered.history().size());
+    CPPUNIT_ASSERT(filtered.data().time == t + milliseconds(9990));
+    const Vector<float>& a = get<float, Acceleration>(filtered.data());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, a.x(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2.0, a.y(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, a.z(), 0.01);
+    // Scalars and vectors together
+    Fir_stream<float, Acceleration, Temperature> both(Fir<float, 4>(fir_lowpass(5, 10, 100)));
+    both.add_sample(chip.data());
+    const Fir_stream<float, Acceleration, Temperature>::Sample_type& sample = both.data();
+    CPPUNIT_ASSERT(sample.time == chip.data().time);
+    CPPUNIT_ASSERT((get<float, Temperature>(sample) < 20));
+  }
+public:
+  CPPUNIT_TEST_SUITE(FiltersTest);
+  CPPUNIT_TEST(testButterworth);
+  CPPUNIT_TEST(testSignals);
+  CPPUNIT_TEST(testFir);
+  CPPUNIT_TEST(testBlocks);
+  CPPUNIT_TEST(testStream);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(FiltersTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,128 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "../../include/types.h"
+#include "../../include/calibration.h"
+#include "../../include/fixed.h"
+
+
+using namespace mru;
+using namespace std;
+
+class FixedTest: public CppUnit::TestFixture {
+  void testArithmetic() {
+    Q15 a = Q15::from_double(0.75), b = Q15::from_double(-0.5);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.25, (a + b).to_double(), 1E-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.375, (a * b).to_double(), 1E-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.5 / 0.75, (b / a).to_double(), 1.0 / 32768);
+    // Saturation instead of wrap around
+    CPPUNIT_ASSERT(Q15::max() == a + a);
+    CPPUNIT_ASSERT(Q15::min() == b - a);
+    CPPUNIT_ASSERT(Q15::max() == -Q15::min());
+    CPPUNIT_ASSERT(Q15::max() == Q15::from_double(3));
+    CPPUNIT_ASSERT(Q15::min() == b / Q15());
+    Q31 c = Q31::from_double(0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01, (c * c).to_double(), 1E-9);
+    Q16_16 d = Q16_16::from_double(-300.25);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-600.5, (d * Q16_16::from_double(2)).to_double(), 1E-9);
+    CPPUNIT_ASSERT(Q16_16::min() == d * Q16_16::from_double(200));
+  }
+  void testCalibration() {
+    Calibration<double> calibration(
+        0.0039, 0.0001, -0.0002, 0.05,
+        -0.0001, 0.0041, 0.0003, -0.12,
+        0.0002, 0.0, 0.0038, 0.3,
+        0.0625, 21);
+    Fixed_calibration fixed(calibration);
+    srand(3);
+    for (int n = 0; n < 1000; ++n) {
+      int16_t raw[3];
+      for (auto& r: raw)
+        r = static_cast<int16_t>(rand() % 65536 - 32768);
+      Q16_16 result[3];
+      fixed.correct(raw, result);
+      Vector<double> expected = calibration.correct(Point<double>(raw[0], raw[1], raw[2]));
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.x(), result[0].to_double(), 3E-5);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.y(), result[1].to_double(), 3E-5);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z(), result[2].to_double(), 3E-5);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(calibration.correct(double(raw[0])), fixed.correct(raw[0]).to_double(), 3E-5);
+    }
+  }
+  void testQuaternion() {
+    UnitQuaternion<double> a(0.3, -0.5, 0.2, 0.7), b(-0.1, 0.4, 0.8, 0.2);
+    Fixed_quaternion fa = Fixed_quaternion::from_quaternion(a), fb = Fixed_quaternion::from_quaternion(b);
+    Quaternion<double> product = a * b;
+    Fixed_quaternion fixed_product = fa * fb;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(product.qr(), fixed_product.w.to_double(), 1E-8);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(product.qk(), fixed_product.z.to_double(), 1E-8);
+
+    Q16_16 v[3] = { Q16_16::from_double(9.81), Q16_16::from_double(-1.5), Q16_16::from_double(0.25) };
+    Q16_16 rotated[3];
+    fa.rotate(v, rotated);
+    Vector<double> expected = a.rotate(Vector<double>(9.81, -1.5, 0.25));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.x(), rotated[0].to_double(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.y(), rotated[1].to_double(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z(), rotated[2].to_double(), 1E-4);
+  }
+  void testIntegrate() {
+    // Same gyro integration in float and fixed point for 10 s at 100 Hz
+    const double dt = 0.01;
+    UnitQuaternion<double> q;
+    Fixed_quaternion fq;
+    Q31 fdt = Q31::from_double(dt);
+    for (int n = 0; n < 1000; ++n) {
+      double rate[3] = { 0.3 * sin(n * 0.01), -0.2, 0.5 * cos(n * 0.02) };
+      Q16_16 frate[3];
+      for (int i = 0; i < 3; ++i)
+        frate[i] = Q16_16::from_double(rate[i]);
+      q = UnitQuaternion<double>(q * Quaternion<double>(1, rate[0] * dt / 2, rate[1] * dt / 2, rate[2] * dt / 2));
+      fq.integrate(frate, fdt);
+    }
+    UnitQuaternion<double> result = fq.to_quaternion<double>();
+    double norm = sqr(fq.w.to_double()) + sqr(fq.x.to_double()) + sqr(fq.y.to_double()) + sqr(fq.z.to_double());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, norm, 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL((double)q.heading(), (double)result.heading(), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL((double)q.pitch(), (double)result.pitch(), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL((double)q.roll(), (double)result.roll(), 1E-3);
+  }
+  void testAngles() {
+    typedef Binary_angle<0, 4> Full;
+    typedef Binary_angle<-2, 2> Centered;
+    typedef Binary_angle<-1, 1> Half;
+    for (double a = -20; a < 20; a += 0.37) {
+      double full = RotScalar<0, 4, double>(a);
+      double centered = RotScalar<-2, 2, double>(a);
+      double half = RotScalar<-1, 1, double>(a);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(full, Full::from_double(a).to_double(), 1E-8);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(centered, Centered::from_double(a).to_double(), 1E-8);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(half, Half::from_double(a).to_double(), 1E-8);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(centered, Centered::from_radians(Q16_16::from_double(a)).to_double(), 1E-4);
+    }
+    Binary_angle<0, 4> heading = Binary_angle<0, 4>::from_double(6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(6.5 - 2 * M_PI, (heading + Binary_angle<0, 4>::from_double(0.5)).to_double(), 1E-8);
+  }
+public:
+  CPPUNIT_TEST_SUITE(FixedTest);
+  CPPUNIT_TEST(testArithmetic);
+  CPPUNIT_TEST(testCalibration);
+  CPPUNIT_TEST(testQuaternion);
+  CPPUNIT_TEST(testIntegrate);
+  CPPUNIT_TEST(testAngles);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(FixedTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,121 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "../../include/types.h"
+#include "../../include/matrix.h"
+#include "../../include/gravity_fit.h"
+
+
+using namespace mru;
+using namespace std;
+
+// Symmetric scale and cross axis terms and an offset, in counts per m/s2
+static const double true_m[3][3] = {
+  { 25.6, 0.3, -0.2 },
+  { 0.3, 26.1, 0.15 },
+  { -0.2, 0.15, 24.8 }};
+static const double true_offset[3] = { 12, -30, 45 };
+
+// Raw readings of a unit held in positions positions, with turns in between
+static vector<Vector<double> > recording(const int positions, const int per_position) {
+  vector<Vector<double> > result;
+  srand(11);
+  for (int p = 0; p < positions; ++p) {
+    double z = 1 - (2.0 * p + 1) / positions;
+    double r = sqrt(1 - z * z);
+    double phi = p * M_PI * (3 - sqrt(5.0));
+    double g[3] = { standard_gravity * r * cos(phi), standard_gravity * r * sin(phi),
+                    standard_gravity * z };
+    for (int i = 0; i < per_position; ++i) {
+      double raw[3];
+      for (int j = 0; j < 3; ++j) {
+        raw[j] = true_offset[j] + 0.5 * (rand() / double(RAND_MAX) - 0.5);
+        for (int k = 0; k < 3; ++k)
+          raw[j] += true_m[j][k] * g[k];
+      }
+      result.push_back(Vector<double>(raw[0], raw[1], raw[2]));
+    }
+    // Turning: large swings
+    for (int i = 0; i < 50; ++i)
+      result.push_back(Vector<double>(200 * sin(i * 0.3), 150 * cos(i * 0.2), 250));
+  }
+  return result;
+}
+
+class GravityFitTest: public CppUnit::TestFixture {
+  void testStationary() {
+    vector<Vector<double> > readings = recording(6, 200);
+    vector<Vector<double> > stationary = stationary_readings<double>(readings);
+    // Turns of 50 readings straddle blocks: every fourth block is lost
+    CPPUNIT_ASSERT(stationary.size() >= 6 * 150);
+    CPPUNIT_ASSERT(stationary.size() <= 6 * 200);
+    for (auto& v: stationary)
+      CPPUNIT_ASSERT(std::fabs(std::sqrt(v.squared_length()) - 250) < 60);
+  }
+  void testFit() {
+    vector<Vector<double> > stationary = stationary_readings<double>(recording(12, 1000));
+    Gravity_fit<double> fit(standard_gravity, 100, 4);
+    Correction<double> correction(1, 0, 1, 0, 1, 0);
+    CPPUNIT_ASSERT(fit.solve(stationary, correction));
+    CPPUNIT_ASSERT(fit.rms() < 0.01);
+    // The correction is the inverse of the simulated sensor
+    Matrix<3, 3, double> m, c;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j) {
+        m(i, j) = true_m[i][j];
+        c(i, j) = correction(i, j);
+      }
+    Matrix<3, 3, double> product = c * m;
+    for (int i = 0; i < 3; ++i) {
+      double offset = correction(i, 3);
+      for (int j = 0; j < 3; ++j) {
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(i == j ? 1.0 : 0.0, product(i, j), 1E-4);
+        offset += c(i, j) * true_offset[j];
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, offset, 1E-3);
+    }
+  }
+  void testSingleThread() {
+    vector<Vector<double> > stationary = stationary_readings<double>(recording(10, 1200));
+    Correction<double> parallel(1, 0, 1, 0, 1, 0), serial(1, 0, 1, 0, 1, 0);
+    Gravity_fit<double> parallel_fit(standard_gravity, 100, 4), serial_fit(standard_gravity, 100, 1);
+    CPPUNIT_ASSERT(parallel_fit.solve(stationary, parallel));
+    CPPUNIT_ASSERT(serial_fit.solve(stationary, serial));
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 4; ++j)
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(serial(i, j), parallel(i, j), 1E-6);
+  }
+  void testDegenerate() {
+    // Fewer orientations than degrees of freedom can't determine a correction
+    Gravity_fit<double> fit;
+    Correction<double> correction(1, 0, 1, 0, 1, 0);
+    CPPUNIT_ASSERT(!fit.solve(stationary_readings<double>(recording(1, 500)), correction));
+    CPPUNIT_ASSERT(!fit.solve(stationary_readings<double>(recording(8, 500)), correction));
+    CPPUNIT_ASSERT(!fit.solve(vector<Vector<double> >(), correction));
+    CPPUNIT_ASSERT_THROW(stationary_readings<double>(recording(9, 50), 0), Error);
+  }
+public:
+  CPPUNIT_TEST_SUITE(GravityFitTest);
+  CPPUNIT_TEST(testStationary);
+  CPPUNIT_TEST(testFit);
+  CPPUNIT_TEST(testSingleThread);
+  CPPUNIT_TEST(testDegenerate);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(GravityFitTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
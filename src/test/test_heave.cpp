@@ -0,0 +1,96 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+
+#include "../../include/types.h"
+#include "../../include/heave.h"
+
+
+using namespace mru;
+using namespace std;
+
+class HeaveTest: public CppUnit::TestFixture {
+  void testIntegrator() {
+    // 1 m amplitude, 10 s period, with an accelerometer offset; 10 minutes at 50 Hz
+    Drift_free_integrator<double> integrator;
+    const double omega = 2 * M_PI / 10;
+    const double dt = 0.02;
+    double max_displacement = 0, max_velocity = 0;
+    for (int i = 0; i < 30000; ++i) {
+      double t = i * dt;
+      integrator.update(-omega * omega * sin(omega * t) + 0.05, dt);
+      if (t > 590) {
+        max_displacement = max(max_displacement, fabs(integrator.displacement()));
+        max_velocity = max(max_velocity, fabs(integrator.velocity()));
+      }
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, integrator.period(), 0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01, integrator.cutoff(), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, max_displacement, 0.03);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(omega, max_velocity, 0.03);
+  }
+  void testDrift() {
+    // Offset and noise only: displacement must stay put
+    Drift_free_integrator<double> integrator;
+    double noise = 0.1;
+    for (int i = 0; i < 30000; ++i) {
+      noise = -noise;
+      integrator.update(0.05 + noise, 0.02);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, integrator.displacement(), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, integrator.velocity(), 1E-3);
+  }
+  void testEngine() {
+    Heave<double> heave;
+    int published = 0;
+    heave.set_sample_handler([&](const Heave<double>::Sample_type&) { ++published; });
+    UnitQuaternion<double> rotation =
+        UnitQuaternion<double>(cos(M_PI / 8), 0, 0, sin(M_PI / 8)) *
+        UnitQuaternion<double>(cos(d2r(5.0)), 0, sin(d2r(5.0)), 0);
+    Time time = now();
+    // Nothing published before an orientation is known
+    heave.add_acceleration(Sample<double, Acceleration>(time, Vector<double>(0, 0, -9.81)));
+    CPPUNIT_ASSERT_EQUAL(0, published);
+    heave.add_rotation(Sample<double, Rotation>(time, rotation));
+    UnitQuaternion<double> inverse = rotation.conjugate();
+    const double omega = 2 * M_PI / 8;
+    double max_heave = 0, max_horizontal = 0;
+    for (int i = 0; i < 25000; ++i) {
+      double t = i * 0.02;
+      time += std::chrono::milliseconds(20);
+      // Vertical wave motion, positive down, in the earth frame
+      Vector<double> earth(0, 0, -standard_gravity - 0.5 * omega * omega * sin(omega * t));
+      heave.add_acceleration(Sample<double, Acceleration>(time, inverse.rotate(earth)));
+      if (t > 490) {
+        Vector<double> displacement = get<double, Displacement>(heave.data());
+        max_heave = max(max_heave, fabs(displacement.z()));
+        max_horizontal = max(max_horizontal, fabs(displacement.x()));
+        max_horizontal = max(max_horizontal, fabs(displacement.y()));
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL(24999, published);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(8.0, heave.heave().period(), 0.1);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.5, max_heave, 0.02);
+    CPPUNIT_ASSERT(max_horizontal < 1E-6);
+  }
+public:
+  CPPUNIT_TEST_SUITE(HeaveTest);
+  CPPUNIT_TEST(testIntegrator);
+  CPPUNIT_TEST(testDrift);
+  CPPUNIT_TEST(testEngine);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(HeaveTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
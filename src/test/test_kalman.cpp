@@ -0,0 +1,163 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+
+#include "../../include/types.h"
+#include "../../include/matrix.h"
+#include "../../include/kalman.h"
+
+
+using namespace mru;
+using namespace std;
+
+// Earth magnetic field, north east down, micro tesla
+static const Vector<double> earth_field(20, 0, 45);
+static const Vector<double> earth_gravity(0, 0, 9.81);
+
+static UnitQuaternion<double> orientation(double heading, double pitch, double roll) {
+  return
+      UnitQuaternion<double>(cos(heading / 2), 0, 0, sin(heading / 2)) *
+      UnitQuaternion<double>(cos(pitch / 2), 0, sin(pitch / 2), 0) *
+      UnitQuaternion<double>(cos(roll / 2), sin(roll / 2), 0, 0);
+}
+
+static void readings(const UnitQuaternion<double>& q,
+                     Vector<double>& acceleration, Vector<double>& magnetic_flux) {
+  UnitQuaternion<double> inverse = q.conjugate();
+  acceleration = -inverse.rotate(earth_gravity);
+  magnetic_flux = inverse.rotate(earth_field);
+}
+
+class MatrixTest: public CppUnit::TestFixture {
+  void testProduct() {
+    Matrix<2, 3, double> a;
+    Matrix<3, 2, double> b;
+    for (int i = 0; i < 2; ++i)
+      for (int j = 0; j < 3; ++j) {
+        a(i, j) = i + j;
+        b(j, i) = i * j + 1;
+      }
+    Matrix<2, 2, double> c = a * b;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(3.0, c(0, 0), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(8.0, c(0, 1), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(6.0, c(1, 0), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(14.0, c(1, 1), 1E-12);
+    Matrix<3, 2, double> t = a.transposed();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(a(1, 2), t(2, 1), 1E-12);
+    Matrix<2, 3, double> i = Matrix<2, 2, double>::identity() * a;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(a(1, 2), i(1, 2), 1E-12);
+  }
+  void testSkew() {
+    Vector<double> v(1, 2, 3), w(-2, 0.5, 4);
+    Matrix<3, 1, double> wm;
+    wm(0, 0) = w.x();
+    wm(1, 0) = w.y();
+    wm(2, 0) = w.z();
+    Matrix<3, 1, double> r = skew<double>(v) * wm;
+    Vector<double> c = CGAL::cross_product(v, w);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(c.x(), r(0, 0), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(c.y(), r(1, 0), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(c.z(), r(2, 0), 1E-12);
+  }
+public:
+  CPPUNIT_TEST_SUITE(MatrixTest);
+  CPPUNIT_TEST(testProduct);
+  CPPUNIT_TEST(testSkew);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+class KalmanTest: public CppUnit::TestFixture {
+  void testConvergence() {
+    Kalman<double> filter;
+    Vector<double> acc, mag;
+    readings(orientation(d2r(15.0), d2r(-5.0), d2r(10.0)), acc, mag);
+    for (int i = 0; i < 2000; ++i) {
+      filter.update(Vector<double>(0, 0, 0), acc, mag, 0.005);
+    }
+    UnitQuaternion<double> q = filter.rotation();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(15.0, q.heading().to_degrees(), 0.05);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-5.0, q.pitch().to_degrees(), 0.05);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, q.roll().to_degrees(), 0.05);
+  }
+  void testBias() {
+    // Two minutes at 200 Hz, at rest with a biased gyroscope
+    UnitQuaternion<double> q = orientation(d2r(30.0), d2r(5.0), d2r(-10.0));
+    Vector<double> acc, mag;
+    readings(q, acc, mag);
+    Vector<double> bias(0.01, -0.02, 0.015);
+    Kalman<double> filter;
+    filter.set_rotation(q);
+    UnitQuaternion<double> open_loop = q;
+    for (int i = 0; i < 24000; ++i) {
+      filter.update(bias, acc, mag, 0.005);
+      open_loop = open_loop * UnitQuaternion<double>(1, bias * 0.0025);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(bias.x(), filter.bias().x(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(bias.y(), filter.bias().y(), 1E-4);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(bias.z(), filter.bias().z(), 1E-4);
+    double heading_error = fabs(filter.rotation().heading().to_degrees() - 30.0);
+    double open_loop_error = fabs(open_loop.heading().to_degrees() - 30.0);
+    CPPUNIT_ASSERT(heading_error < 0.05);
+    CPPUNIT_ASSERT(open_loop_error > 10.0);
+  }
+  void testDriftingBias() {
+    // Bias ramping up as the gyroscope warms, while slowly turning
+    Kalman<double> filter;
+    Vector<double> acc, mag;
+    double heading = 0;
+    double rate = d2r(3.0);
+    for (int i = 0; i < 60000; ++i) {
+      heading += rate * 0.005;
+      readings(orientation(heading, d2r(2.0), d2r(-3.0)), acc, mag);
+      Vector<double> bias(0, 0, 0.02 * i / 60000);
+      filter.update(Vector<double>(0, 0, rate) + bias, acc, mag, 0.005);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02, filter.bias().z(), 1E-3);
+    RotScalar<0, 4, double> expected(heading);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.to_degrees(), filter.rotation().heading().to_degrees(), 0.5);
+  }
+  void testAccelerationGate() {
+    UnitQuaternion<double> q = orientation(0, d2r(10.0), 0);
+    Vector<double> acc, mag;
+    readings(q, acc, mag);
+    Kalman<double> filter;
+    filter.set_rotation(q);
+    // Sustained 0.5 g of surge: rejected instead of tilting the estimate
+    for (int i = 0; i < 200; ++i) {
+      filter.update(Vector<double>(0, 0, 0), acc + Vector<double>(4.9, 0, 0), mag, 0.005);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(10.0, filter.rotation().pitch().to_degrees(), 1E-6);
+  }
+  void testFloat() {
+    Kalman<float> filter;
+    Vector<float> acc(0, 0, -9.81f), mag(20, 0, 45);
+    for (int i = 0; i < 2000; ++i) {
+      filter.update(Vector<float>(0.01f, 0, 0), acc, mag, 0.005f);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01, filter.bias().x(), 1E-3);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, filter.rotation().roll().to_degrees(), 0.1);
+  }
+public:
+  CPPUNIT_TEST_SUITE(KalmanTest);
+  CPPUNIT_TEST(testConvergence);
+  CPPUNIT_TEST(testBias);
+  CPPUNIT_TEST(testDriftingBias);
+  CPPUNIT_TEST(testAccelerationGate);
+  CPPUNIT_TEST(testFloat);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(MatrixTest::suite());
+  runner.addTest(KalmanTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,96 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstring>
+
+#include "../../include/types.h"
+#include "../../include/native.h"
+
+
+using namespace mru;
+using namespace std;
+
+// Evaluated by the compiler
+constexpr Vec3<double> a(1, 2, 3);
+constexpr Vec3<double> b(-2, 0.5, 4);
+static_assert(dot(a, b) == 11, "dot product");
+static_assert(cross(a, b)[0] == 6.5 && cross(a, b)[1] == -10 && cross(a, b)[2] == 4.5, "cross product");
+constexpr Quat<double> quarter_turn(0.70710678118654752, 0, 0, 0.70710678118654752);
+constexpr Mat3x4<double> shift{{{1, 0, 0, 1}, {0, 1, 0, 2}, {0, 0, 1, 3}}};
+static_assert((shift * shift)(a)[2] == 9, "affine composition");
+static_assert(Mat3x4<float>::identity()(Vec3<float>(1, 2, 3))[1] == 2, "identity");
+
+class NativeTest: public CppUnit::TestFixture {
+  void testVector() {
+    Vec3<float> v(1, 2, 2);
+    CPPUNIT_ASSERT_EQUAL(3.0f, v.length());
+    v += Vec3<float>(1, 1, 1);
+    v *= 2;
+    CPPUNIT_ASSERT_EQUAL(6.0f, v.z());
+    CPPUNIT_ASSERT_EQUAL(-4.0f, (-v)[0]);
+    // Plain bytes: copies with memcpy
+    Vec3<float> buffer[4];
+    Vec3<float> source[4] = { v, v * 2, v / 2, -v };
+    memcpy(buffer, source, sizeof(source));
+    CPPUNIT_ASSERT_EQUAL(12.0f, buffer[1].z());
+  }
+  void testQuaternion() {
+    UnitQuaternion<double> q(0.3, -0.5, 0.2, 0.7);
+    UnitQuaternion<double> r(-0.1, 0.4, 0.8, 0.2);
+    Quat<double> nq = to_native<double>(q), nr = to_native<double>(r);
+    Quaternion<double> product = q * r;
+    Quat<double> native_product = nq * nr;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(product.qr(), native_product.w, 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(product.qi(), native_product.x, 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(product.qj(), native_product.y, 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(product.qk(), native_product.z, 1E-12);
+    Vector<double> v(1, -2, 0.5);
+    Vector<double> expected = q.rotate(v);
+    Vec3<double> rotated = nq.rotate(to_native<double>(v));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.x(), rotated.x(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.y(), rotated.y(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z(), rotated.z(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(q.heading(), to_cgal(nq).heading(), 1E-12);
+    Vec3<double> east = quarter_turn.rotate(Vec3<double>(1, 0, 0));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, east.y(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, Quat<double>(2, 0, 0, 0).normalized().w, 1E-12);
+  }
+  void testTransformation() {
+    Transformation<double> t(
+        0.9, 0.1, 0.0, 1.5,
+        -0.1, 1.1, 0.2, -2.5,
+        0.0, 0.3, 1.0, 0.25);
+    Mat3x4<double> m = to_native<double>(t);
+    Point<double> p(3, -1, 2);
+    Point<double> expected = t(p);
+    Vec3<double> transformed = m(Vec3<double>(3, -1, 2));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.x(), transformed.x(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.y(), transformed.y(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z(), transformed.z(), 1E-12);
+    Transformation<double> back = to_cgal(m);
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 4; ++j)
+        CPPUNIT_ASSERT_EQUAL(t.m(i, j), back.m(i, j));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.1 * -1 + 0.9 * 3, m.linear(Vec3<double>(3, -1, 2)).x(), 1E-12);
+  }
+public:
+  CPPUNIT_TEST_SUITE(NativeTest);
+  CPPUNIT_TEST(testVector);
+  CPPUNIT_TEST(testQuaternion);
+  CPPUNIT_TEST(testTransformation);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(NativeTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,175 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+extern "C" {
+  #include <sched.h>
+}
+
+#include <chrono>
+#include <thread>
+
+#include "../../include/pipeline.h"
+#include "../../include/types.h"
+#include "../../include/errors.h"
+
+
+using namespace mru;
+using namespace std;
+
+typedef Sample<float, Temperature> Temperature_sample;
+
+class PipelineTest: public CppUnit::TestFixture {
+  void testQueue() {
+    Spsc_queue<int> queue(5);
+    CPPUNIT_ASSERT_EQUAL((size_t)8, queue.capacity());
+    CPPUNIT_ASSERT(queue.empty());
+    for (int i = 0; i < 8; ++i)
+      CPPUNIT_ASSERT(queue.try_push(i));
+    CPPUNIT_ASSERT(!queue.try_push(8));
+    int value = -1;
+    for (int i = 0; i < 8; ++i) {
+      CPPUNIT_ASSERT(queue.try_pop(value));
+      CPPUNIT_ASSERT_EQUAL(i, value);
+    }
+    CPPUNIT_ASSERT(!queue.try_pop(value));
+    CPPUNIT_ASSERT_THROW(Spsc_queue<int>(0), Error);
+  }
+  void testQueueThreads() {
+    Spsc_queue<long> queue(16);
+    const long count = 200000;
+    thread producer([&queue, count]() {
+      for (long i = 0; i < count; ++i)
+        while (!queue.try_push(i))
+          this_thread::yield();
+    });
+    long expected = 0;
+    bool ordered = true;
+    while (expected < count) {
+      long value;
+      if (queue.try_pop(value)) {
+        ordered = ordered && value == expected;
+        ++expected;
+      }
+    }
+    producer.join();
+    CPPUNIT_ASSERT(ordered);
+    CPPUNIT_ASSERT(queue.empty());
+  }
+  void testPipeline() {
+    // Source, two stages and a sink: every sample arrives, in order
+    Pipeline pipeline;
+    Channel<Temperature_sample>& raw = pipeline.channel<Temperature_sample>(4);
+    Channel<Temperature_sample>& calibrated = pipeline.channel<Temperature_sample>(4);
+    Channel<float>& values = pipeline.channel<float>(4);
+    int produced = 0;
+    pipeline.source(raw, [&produced](Batch<Temperature_sample>& batch) {
+      for (int i = 0; i < 10; ++i, ++produced)
+        batch.push_back(Temperature_sample(Time::from_nanoseconds(produced), float(produced)));
+      return produced < 1000;
+    });
+    pipeline.stage(raw, calibrated,
+        [](const Batch<Temperature_sample>& in, Batch<Temperature_sample>& out) {
+      for (auto& sample: in)
+        out.push_back(Temperature_sample(sample.time, get<float, Temperature>(sample) * 2 + 1));
+    });
+    pipeline.stage(calibrated, values, [](const Batch<Temperature_sample>& in, Batch<float>& out) {
+      for (auto& sample: in)
+        out.push_back(get<float, Temperature>(sample));
+    }, Placement(sched_getcpu()));
+    vector<float> received;
+    pipeline.sink(values, [&received](const Batch<float>& batch) {
+      received.insert(received.end(), batch.begin(), batch.end());
+    });
+    pipeline.start();
+    CPPUNIT_ASSERT(pipeline.running());
+    pipeline.wait();
+    CPPUNIT_ASSERT(!pipeline.running());
+    CPPUNIT_ASSERT_EQUAL((size_t)1000, received.size());
+    bool correct = true;
+    for (int i = 0; i < 1000; ++i)
+      correct = correct && received[i] == 2 * i + 1;
+    CPPUNIT_ASSERT(correct);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, raw.dropped());
+    CPPUNIT_ASSERT_THROW(pipeline.start(), Error);
+  }
+  void testDrop() {
+    // A slow sink behind a dropping channel doesn't hold up the source
+    Pipeline pipeline;
+    Channel<int>& channel = pipeline.channel<int>(2, Backpressure::Drop);
+    int produced = 0;
+    pipeline.source(channel, [&produced](Batch<int>& batch) {
+      batch.push_back(produced++);
+      return produced < 100;
+    });
+    int received = 0, last = -1;
+    bool ordered = true;
+    pipeline.sink(channel, [&](const Batch<int>& batch) {
+      this_thread::sleep_for(chrono::milliseconds(1));
+      ordered = ordered && batch[0] > last;
+      last = batch[0];
+      ++received;
+    });
+    pipeline.start();
+    pipeline.wait();
+    CPPUNIT_ASSERT(ordered);
+    CPPUNIT_ASSERT(channel.dropped() > 0);
+    CPPUNIT_ASSERT_EQUAL((size_t)100, received + channel.dropped());
+  }
+  void testStop() {
+    // An endless source ends on stop() and what it produced is drained
+    Pipeline pipeline;
+    Channel<int>& channel = pipeline.channel<int>(8);
+    int produced = 0, received = 0;
+    pipeline.source(channel, [&produced](Batch<int>& batch) {
+      batch.push_back(produced++);
+      this_thread::sleep_for(chrono::microseconds(100));
+      return true;
+    });
+    pipeline.sink(channel, [&received](const Batch<int>& batch) {
+      received += batch.size();
+    });
+    pipeline.start();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    pipeline.stop();
+    CPPUNIT_ASSERT(produced > 0);
+    CPPUNIT_ASSERT_EQUAL(produced, received);
+  }
+  void testError() {
+    // A failing stage stops a blocked source and is reported
+    Pipeline pipeline;
+    Channel<int>& in = pipeline.channel<int>(1);
+    Channel<int>& out = pipeline.channel<int>(1);
+    pipeline.source(in, [](Batch<int>& batch) {
+      batch.push_back(1);
+      return true;
+    });
+    pipeline.stage(in, out, [](const Batch<int>&, Batch<int>&) {
+      throw Error("Stage failed");
+    });
+    pipeline.sink(out, [](const Batch<int>&) {});
+    pipeline.start();
+    CPPUNIT_ASSERT_THROW(pipeline.wait(), Error);
+  }
+public:
+  CPPUNIT_TEST_SUITE(PipelineTest);
+  CPPUNIT_TEST(testQueue);
+  CPPUNIT_TEST(testQueueThreads);
+  CPPUNIT_TEST(testPipeline);
+  CPPUNIT_TEST(testDrop);
+  CPPUNIT_TEST(testStop);
+  CPPUNIT_TEST(testError);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(PipelineTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,128 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include "../../include/types.h"
+#include "../../include/calibration.h"
+#include "../../include/published.h"
+#include "../../include/registry.h"
+
+
+using namespace mru;
+using namespace std;
+
+boost::filesystem::path app_path;
+
+struct Fake_chip {
+  Calibration<float> calibration_;
+  Temperature_model<float> model_;
+  string chip_name() { return "fake"; }
+  void set_calibration(const Calibration<float>& calibration) { calibration_ = calibration; }
+  void set_temperature_model(const Temperature_model<float>& model) { model_ = model; }
+};
+
+static bool wait_for_generation(const Calibration_registry<float>& registry, const int generation) {
+  for (int i = 0; i < 200 && registry.generation() < generation; ++i)
+    this_thread::sleep_for(chrono::milliseconds(10));
+  return registry.generation() >= generation;
+}
+
+class RegistryTest: public CppUnit::TestFixture {
+  string filename() const { return (app_path/"calibration/registry.ini").string(); }
+  void testSnapshot() {
+    save_calibration<float>(filename(), "fake", Calibration<float>(2, 1, 3, 1, 4, 1, 1, 0));
+    Temperature_model<float> model;
+    model.bias[0][1] = 0.001f;
+    save_temperature_model<float>(filename(), "fake", model);
+    save_calibration<float>(filename(), "other", Calibration<float>(5, 0, 5, 0, 5, 0, 1, 0));
+    Calibration_registry<float> registry(filename(), false);
+    CPPUNIT_ASSERT_EQUAL(1, registry.generation());
+    auto snapshot = registry.snapshot();
+    CPPUNIT_ASSERT_EQUAL((size_t)2, snapshot->calibrations.size());
+    CPPUNIT_ASSERT_EQUAL(3.0f, registry.calibration("fake").y_factor());
+    CPPUNIT_ASSERT_EQUAL(5.0f, registry.calibration("other").x_factor());
+    CPPUNIT_ASSERT_EQUAL(0.001f, registry.temperature_model("fake").bias[0][1]);
+    CPPUNIT_ASSERT(registry.temperature_model("other").empty());
+    // Missing sections behave like load_calibration
+    CPPUNIT_ASSERT_EQUAL(1.0f, registry.calibration("missing").x_factor());
+
+    save_calibration<float>(filename(), "fake", Calibration<float>(7, 1, 3, 1, 4, 1, 1, 0));
+    CPPUNIT_ASSERT(registry.reload());
+    CPPUNIT_ASSERT_EQUAL(2, registry.generation());
+    CPPUNIT_ASSERT_EQUAL(7.0f, registry.calibration("fake").x_factor());
+    // The old snapshot is unchanged
+    CPPUNIT_ASSERT_EQUAL(2.0f, snapshot->calibration("fake").x_factor());
+    CPPUNIT_ASSERT(registry.snapshot() != snapshot);
+  }
+  void testPublished() {
+    Published<Calibration<float> > published;
+    CPPUNIT_ASSERT(!published.get());
+    published.emplace(Calibration<float>(2, 1, 3, 1, 4, 1, 1, 0));
+    const Calibration<float>* first = published.get();
+    CPPUNIT_ASSERT_EQUAL(2.0f, first->x_factor());
+    // Readers of the replaced value can go on using it
+    published.emplace(Calibration<float>(5, 0, 5, 0, 5, 0, 1, 0));
+    CPPUNIT_ASSERT_EQUAL(5.0f, published.get()->x_factor());
+    CPPUNIT_ASSERT_EQUAL(2.0f, first->x_factor());
+    CPPUNIT_ASSERT_EQUAL((size_t)1, published.retired());
+    published.reclaim();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, published.retired());
+    published.reset();
+    CPPUNIT_ASSERT(!published.get());
+    // Reading is a plain atomic load
+    std::atomic<const Calibration<float>*> pointer(nullptr);
+    CPPUNIT_ASSERT(pointer.is_lock_free());
+  }
+  void testWatch() {
+    save_calibration<float>(filename(), "fake", Calibration<float>(2, 1, 3, 1, 4, 1, 1, 0));
+    Calibration_registry<float> registry(filename());
+    Fake_chip chip;
+    registry.attach(chip);
+    CPPUNIT_ASSERT_EQUAL(2.0f, chip.calibration_.x_factor());
+
+    save_calibration<float>(filename(), "fake", Calibration<float>(8, 1, 3, 1, 4, 1, 1, 0));
+    CPPUNIT_ASSERT(wait_for_generation(registry, 2));
+    CPPUNIT_ASSERT_EQUAL(8.0f, registry.calibration("fake").x_factor());
+    CPPUNIT_ASSERT_EQUAL(8.0f, chip.calibration_.x_factor());
+
+    // A broken file leaves the calibration alone
+    {
+      ofstream file(filename() + ".tmp");
+      file << "[fake\nx_factor=";
+    }
+    boost::filesystem::rename(filename() + ".tmp", filename());
+    this_thread::sleep_for(chrono::milliseconds(100));
+    CPPUNIT_ASSERT_EQUAL(8.0f, chip.calibration_.x_factor());
+    CPPUNIT_ASSERT(!registry.reload());
+  }
+public:
+  virtual void setUp() {
+    boost::filesystem::remove(filename());
+  }
+  CPPUNIT_TEST_SUITE(RegistryTest);
+  CPPUNIT_TEST(testSnapshot);
+  CPPUNIT_TEST(testPublished);
+  CPPUNIT_TEST(testWatch);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main(int argc, char* argv[])
+{
+  app_path = argv[0];
+  app_path.remove_filename();
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(RegistryTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,144 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <vector>
+
+#include "../../include/types.h"
+#include "../../include/resample.h"
+
+
+using namespace mru;
+using namespace std;
+using std::chrono::milliseconds;
+using std::chrono::microseconds;
+
+static const Time start = now();
+
+static double seconds(const Time& time) {
+  return to_seconds(time - start);
+}
+
+struct Source: public Sample_stream<double, Acceleration, Temperature> {
+  void emit(const Sample_type& sample) { push_sample(sample); }
+};
+
+class ResampleTest: public CppUnit::TestFixture {
+  void testLinear() {
+    typedef Sensor_group<double, Acceleration, Pressure> Group;
+    Group group(milliseconds(20), milliseconds(50));
+    vector<Group::Sample_type> out;
+    group.set_sample_handler([&](const Group::Sample_type& s) { out.push_back(s); });
+    size_t most = 0;
+    // Accelerometer at 100 Hz, barometer at about 37 Hz with jitter, starting later
+    int a = 0, p = 0;
+    for (int step = 0; step < 2000; ++step) {
+      double ta = a * 0.01, tp = 0.013 + p * 0.027 + (p % 3) * 0.001;
+      // Values follow the times as they are stored
+      tp = llround(tp * 1E6) * 1E-6;
+      if (ta <= tp) {
+        group.add<Acceleration>(start + microseconds(llround(ta * 1E6)),
+                                Vector<double>(ta, 2 * ta, -3 * ta));
+        ++a;
+      }
+      else {
+        group.add<Pressure>(start + microseconds(llround(tp * 1E6)), 1000 + 10 * tp);
+        ++p;
+      }
+      most = max(most, group.buffered());
+    }
+    CPPUNIT_ASSERT(out.size() > 500);
+    // Nothing before the barometer's first sample
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02, seconds(out[0].time), 1E-9);
+    for (size_t i = 0; i < out.size(); ++i) {
+      double t = seconds(out[i].time);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02 * (i + 1), t, 1E-9);
+      Vector<double> acc = get<double, Acceleration>(out[i]);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(t, acc.x(), 1E-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(-3 * t, acc.z(), 1E-9);
+      double pressure = get<double, Pressure>(out[i]);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1000 + 10 * t, pressure, 1E-9);
+    }
+    // Only the latency window is buffered
+    CPPUNIT_ASSERT(most <= 12);
+  }
+  void testCubic() {
+    typedef Sensor_group<double, Temperature> Group;
+    Group linear(milliseconds(7), milliseconds(100));
+    Group cubic(milliseconds(7), milliseconds(100), Interpolation::Cubic);
+    double linear_error = 0, cubic_error = 0;
+    linear.set_sample_handler([&](const Group::Sample_type& s) {
+      linear_error = max(linear_error, fabs(get<double, Temperature>(s) - sin(seconds(s.time))));
+    });
+    cubic.set_sample_handler([&](const Group::Sample_type& s) {
+      cubic_error = max(cubic_error, fabs(get<double, Temperature>(s) - sin(seconds(s.time))));
+    });
+    for (int i = 0; i < 200; ++i) {
+      double t = i * 0.05;
+      linear.add<Temperature>(start + milliseconds(i * 50), sin(t));
+      cubic.add<Temperature>(start + milliseconds(i * 50), sin(t));
+    }
+    CPPUNIT_ASSERT(linear_error > 2E-4);
+    CPPUNIT_ASSERT(cubic_error < linear_error / 10);
+  }
+  void testRotations() {
+    typedef Sensor_group<double, Rotation, Heading> Group;
+    Group group(milliseconds(10), milliseconds(30), Interpolation::Cubic);
+    vector<Group::Sample_type> out;
+    group.set_sample_handler([&](const Group::Sample_type& s) { out.push_back(s); });
+    // Turning at 1 rad/s about z, through north
+    for (int i = 0; i < 100; ++i) {
+      double t = i * 0.025;
+      double angle = t - 1;
+      Time time = start + milliseconds(i * 25);
+      group.add<Rotation>(time, UnitQuaternion<double>(cos(angle / 2), 0, 0, sin(angle / 2)));
+      group.add<Heading>(time, RotScalar<0, 4, double>(angle));
+    }
+    CPPUNIT_ASSERT(out.size() > 200);
+    for (auto& s: out) {
+      double angle = seconds(s.time) - 1;
+      double expected = angle < 0 ? angle + 2 * M_PI : angle;
+      double rotation = get<double, Rotation>(s).heading().get_value();
+      double heading = get<double, Heading>(s).get_value();
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, rotation, 1E-9);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, heading, 1E-9);
+    }
+  }
+  void testAttach() {
+    typedef Sensor_group<double, Temperature, Pressure> Group;
+    Group group(milliseconds(10), milliseconds(20));
+    Source source;
+    group.attach(source);
+    int count = 0;
+    group.set_sample_handler([&](const Group::Sample_type&) { ++count; });
+    for (int i = 0; i < 50; ++i) {
+      Time time = start + milliseconds(i * 10);
+      source.emit(Source::Sample_type(time, Vector<double>(0, 0, 1), 20));
+      group.add<Pressure>(time, 1000);
+    }
+    CPPUNIT_ASSERT_EQUAL(47, count);
+    double temperature = get<double, Temperature>(group.data());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, temperature, 1E-12);
+    CPPUNIT_ASSERT_THROW(Group(milliseconds(0), milliseconds(10)), Error);
+  }
+public:
+  CPPUNIT_TEST_SUITE(ResampleTest);
+  CPPUNIT_TEST(testLinear);
+  CPPUNIT_TEST(testCubic);
+  CPPUNIT_TEST(testRotations);
+  CPPUNIT_TEST(testAttach);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(ResampleTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
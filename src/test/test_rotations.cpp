@@ -0,0 +1,112 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "../../include/types.h"
+#include "../../include/rotations.h"
+
+
+using namespace mru;
+using namespace std;
+
+static double random_value() {
+  return rand() / double(RAND_MAX) - 0.5;
+}
+
+static UnitQuaternion<double> random_quaternion() {
+  return UnitQuaternion<double>(random_value(), random_value(), random_value(), random_value());
+}
+
+class RotationsTest: public CppUnit::TestFixture {
+  void assertVectorsEqual(const Vector<double>& expected, const Vector<double>& actual) {
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.x(), actual.x(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.y(), actual.y(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.z(), actual.z(), 1E-12);
+  }
+  void testRotate() {
+    srand(1);
+    const size_t n = 101;
+    Vector_array<double> vectors;
+    Quaternion_array<double> quaternions;
+    for (size_t i = 0; i < n; ++i) {
+      vectors.push_back(Vector<double>(random_value(), random_value(), random_value()));
+      quaternions.push_back(random_quaternion());
+    }
+    UnitQuaternion<double> q = random_quaternion();
+    Vector_array<double> out;
+    rotate(q, vectors, out);
+    CPPUNIT_ASSERT_EQUAL(n, out.size());
+    for (size_t i = 0; i < n; ++i) {
+      // Against the full products q v q*
+      Quaternion<double> full = q * Quaternion<double>(0, vectors.get(i)) * q.conjugate();
+      assertVectorsEqual(Vector<double>(full.qi(), full.qj(), full.qk()), out.get(i));
+      assertVectorsEqual(q.rotate(vectors.get(i)), out.get(i));
+    }
+    rotate(quaternions, vectors, out);
+    for (size_t i = 0; i < n; ++i)
+      assertVectorsEqual(quaternions.get(i).rotate(vectors.get(i)), out.get(i));
+    CPPUNIT_ASSERT_THROW(rotate(Quaternion_array<double>(3), vectors, out), Error);
+    CPPUNIT_ASSERT_THROW(rotate(q, vectors, vectors), Error);
+  }
+  void testCompose() {
+    srand(2);
+    Quaternion_array<double> a, b, out;
+    for (int i = 0; i < 17; ++i) {
+      a.push_back(random_quaternion());
+      b.push_back(random_quaternion());
+    }
+    compose(a, b, out);
+    CPPUNIT_ASSERT_THROW(compose(a, b, a), Error);
+    for (int i = 0; i < 17; ++i) {
+      Quaternion<double> expected = a.get(i) * b.get(i);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.qr(), out.w[i], 1E-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.qi(), out.x[i], 1E-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.qj(), out.y[i], 1E-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(expected.qk(), out.z[i], 1E-12);
+    }
+    out.w[3] = 2;
+    normalize(out);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, sqr(out.w[3]) + sqr(out.x[3]) + sqr(out.y[3]) + sqr(out.z[3]), 1E-12);
+  }
+  void testInterpolate() {
+    // From no rotation to 120 degrees about z, the second given with flipped sign
+    Quaternion_array<double> a(5), b(5), slerped, nlerped;
+    vector<double> t;
+    for (int i = 0; i < 5; ++i) {
+      b.set(i, Quaternion<double>(-cos(M_PI / 3), 0, 0, -sin(M_PI / 3)));
+      t.push_back(i / 4.0);
+    }
+    slerp(a, b, t, slerped);
+    nlerp(a, b, t, nlerped);
+    for (int i = 0; i < 5; ++i) {
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(2 * M_PI / 3 * t[i], (double)slerped.get(i).heading(), 1E-9);
+      // Same ends, in between off by a few degrees at most
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(2 * M_PI / 3 * t[i], (double)nlerped.get(i).heading(), 0.1);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2 * M_PI / 3, (double)nlerped.get(4).heading(), 1E-9);
+    // Equal ends don't divide by zero
+    slerp(a, a, t, slerped);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, slerped.w[2], 1E-12);
+  }
+public:
+  CPPUNIT_TEST_SUITE(RotationsTest);
+  CPPUNIT_TEST(testRotate);
+  CPPUNIT_TEST(testCompose);
+  CPPUNIT_TEST(testInterpolate);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(RotationsTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,206 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "../../include/sensor_array.h"
+#include "../../include/stream.h"
+#include "../../include/types.h"
+#include "../../include/errors.h"
+
+
+using namespace mru;
+using namespace std;
+using std::chrono::milliseconds;
+
+static double gaussian() {
+  // Sum of uniforms: close enough to normal for noise
+  double sum = 0;
+  for (int i = 0; i < 12; ++i)
+    sum += rand() / double(RAND_MAX);
+  return sum - 6;
+}
+
+/// Unit measuring a slow ramp in acceleration and a constant temperature,
+/// with its own sampling phase, noise and bias. A poll reads samples from
+/// a FIFO, leaving out the first dropped of them
+struct Fake_unit: public Sample_stream<float, Acceleration, Temperature> {
+  Fake_unit():
+      time(Time::from_nanoseconds(1000000000)), phase(), noise(0), bias(0), temperature(20),
+      samples(1), dropped(0), fail(false) {}
+  void poll() {
+    if (fail) {
+      time += milliseconds(10);
+      throw Error("Unit failed");
+    }
+    for (int k = 0; k < samples; ++k) {
+      time += milliseconds(10);
+      const Time t = time + phase;
+      const float x = ramp(t) + noise * gaussian() + bias;
+      if (k >= dropped)
+        push_sample(Sample_type(t, Vector<float>(x, 0, -9.81f), temperature + noise * gaussian()));
+    }
+  }
+  static float ramp(const Time& t) {
+    return (t.nanoseconds() - 1000000000) * 1E-9f;
+  }
+  Time time;
+  Duration phase;
+  float noise;
+  float bias;
+  float temperature;
+  int samples;
+  int dropped;
+  bool fail;
+};
+
+typedef Sensor_array<Fake_unit, 5> Array;
+
+static const Array::Deviations floors = {{0.1f, 0.5f}};
+
+class SensorArrayTest: public CppUnit::TestFixture {
+  Fake_unit units_[5];
+  Array::Units pointers() {
+    Array::Units result;
+    for (int i = 0; i < 5; ++i)
+      result[i] = &units_[i];
+    return result;
+  }
+  void testAlignment() {
+    // Units sampling at different moments are interpolated onto one time
+    for (int i = 0; i < 5; ++i)
+      units_[i].phase = std::chrono::microseconds(1000 * i);
+    Array array(pointers(), floors);
+    double worst = 0;
+    for (int round = 0; round < 50; ++round) {
+      array.poll();
+      const Array::Sample_type& sample = array.data();
+      CPPUNIT_ASSERT(sample.time == units_[0].time);
+      if (round > 0) {
+        const Vector<float>& a = get<float, Acceleration>(sample);
+        worst = max<double>(worst, fabs(a.x() - Fake_unit::ramp(sample.time)));
+      }
+    }
+    CPPUNIT_ASSERT(worst < 1E-5);
+    CPPUNIT_ASSERT_EQUAL((size_t)50, array.history().size());
+  }
+  void testNoise() {
+    // The mean of five units is less noisy than one
+    srand(3);
+    for (auto& unit: units_)
+      unit.noise = 0.1f;
+    Array array(pointers(), floors);
+    double single = 0, combined = 0;
+    const int rounds = 2000;
+    for (int round = 0; round < rounds; ++round) {
+      array.poll();
+      const Vector<float>& a = get<float, Acceleration>(array.data());
+      const float truth = Fake_unit::ramp(array.data().time);
+      combined += (a.x() - truth) * (a.x() - truth);
+      const float x = get<float, Acceleration>(units_[0].data()).x();
+      single += (x - truth) * (x - truth);
+    }
+    CPPUNIT_ASSERT(sqrt(combined / rounds) < 0.6 * sqrt(single / rounds));
+    CPPUNIT_ASSERT_EQUAL(5, array.healthy_count());
+  }
+  void testOutlier() {
+    // A unit with a bias is rejected and loses its health, then recovers
+    srand(5);
+    for (auto& unit: units_)
+      unit.noise = 0.01f;
+    units_[2].bias = 1;
+    Array array(pointers(), floors, 3, 5, 20);
+    double worst = 0;
+    for (int round = 0; round < 100; ++round) {
+      array.poll();
+      const Vector<float>& a = get<float, Acceleration>(array.data());
+      worst = max<double>(worst, fabs(a.x() - Fake_unit::ramp(array.data().time)));
+    }
+    CPPUNIT_ASSERT(worst < 0.05);
+    CPPUNIT_ASSERT(!array.health(2).healthy);
+    CPPUNIT_ASSERT_EQUAL((size_t)100, array.health(2).outliers);
+    CPPUNIT_ASSERT_EQUAL(4, array.healthy_count());
+    units_[2].bias = 0;
+    for (int round = 0; round < 20; ++round)
+      array.poll();
+    CPPUNIT_ASSERT(array.health(2).healthy);
+    CPPUNIT_ASSERT_EQUAL((size_t)0, array.health(0).outliers);
+  }
+  void testFailure() {
+    // A unit that stops responding is taken out; the output goes on
+    Array array(pointers(), floors, 3, 3);
+    units_[4].fail = true;
+    for (int round = 0; round < 10; ++round)
+      array.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)10, array.history().size());
+    CPPUNIT_ASSERT_EQUAL((size_t)10, array.health(4).errors);
+    CPPUNIT_ASSERT(!array.health(4).healthy);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.0, (get<float, Temperature>(array.data())), 1E-6);
+    // Nothing at all: no output
+    for (auto& unit: units_)
+      unit.fail = true;
+    array.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)10, array.history().size());
+  }
+  void testFifo() {
+    // Several samples per poll: all of them are combined
+    for (auto& unit: units_)
+      unit.samples = 4;
+    units_[4].dropped = 1;
+    Array array(pointers(), floors);
+    for (int poll = 0; poll < 10; ++poll)
+      array.poll();
+    CPPUNIT_ASSERT_EQUAL((size_t)40, array.history().size());
+    CPPUNIT_ASSERT(array.data().time == units_[0].time);
+    double worst = 0;
+    for (size_t k = 1; k < array.history().size(); ++k) {
+      const Array::Sample_type& sample = array.history()[k];
+      CPPUNIT_ASSERT(array.history()[k - 1].time + milliseconds(10) == sample.time);
+      worst = max<double>(worst, fabs(get<float, Acceleration>(sample).x() - Fake_unit::ramp(sample.time)));
+    }
+    CPPUNIT_ASSERT(worst < 1E-5);
+    // The short unit misses one round a poll, but never in a row
+    CPPUNIT_ASSERT_EQUAL((size_t)10, array.health(4).misses);
+    CPPUNIT_ASSERT_EQUAL(5, array.healthy_count());
+  }
+  void testQuantized() {
+    // Most units read exactly the same: one step off is no outlier
+    units_[3].temperature = units_[4].temperature = 21;
+    Array array(pointers(), floors);
+    array.set_min_deviation<Temperature>(1.5f);
+    for (int round = 0; round < 20; ++round)
+      array.poll();
+    CPPUNIT_ASSERT_EQUAL(5, array.healthy_count());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, array.health(4).outliers);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(20.4, (get<float, Temperature>(array.data())), 1E-5);
+    const Array::Deviations none = {{0.1f, 0}};
+    CPPUNIT_ASSERT_THROW(Array(pointers(), none), Error);
+  }
+public:
+  void setUp() {
+    for (auto& unit: units_)
+      unit = Fake_unit();
+  }
+  CPPUNIT_TEST_SUITE(SensorArrayTest);
+  CPPUNIT_TEST(testAlignment);
+  CPPUNIT_TEST(testNoise);
+  CPPUNIT_TEST(testOutlier);
+  CPPUNIT_TEST(testFailure);
+  CPPUNIT_TEST(testFifo);
+  CPPUNIT_TEST(testQuantized);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(SensorArrayTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
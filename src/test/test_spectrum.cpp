@@ -0,0 +1,113 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include "../../include/types.h"
+#include "../../include/spectrum.h"
+
+
+using namespace mru;
+using namespace std;
+
+class SpectrumTest: public CppUnit::TestFixture {
+  void testFFT() {
+    const size_t n = 64;
+    FFT<double> fft(n);
+    vector<double> re(n), im(n);
+    srand(3);
+    for (size_t i = 0; i < n; ++i) {
+      re[i] = rand() / double(RAND_MAX) - 0.5;
+      im[i] = rand() / double(RAND_MAX) - 0.5;
+    }
+    vector<double> xr = re, xi = im;
+    fft.transform(&xr[0], &xi[0]);
+    for (size_t k = 0; k < n; ++k) {
+      double sr = 0, si = 0;
+      for (size_t j = 0; j < n; ++j) {
+        double angle = -2 * M_PI * k * j / n;
+        sr += re[j] * cos(angle) - im[j] * sin(angle);
+        si += re[j] * sin(angle) + im[j] * cos(angle);
+      }
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(sr, xr[k], 1E-12);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(si, xi[k], 1E-12);
+    }
+  }
+  void testSize() {
+    CPPUNIT_ASSERT_THROW(FFT<double>(48), Error);
+    CPPUNIT_ASSERT_THROW((Welch<double, 3>(64, 100, 64)), Error);
+  }
+  void testWelch() {
+    // Separate tones on x and y, nothing on z
+    const double rate = 100;
+    Welch<double, 3> welch(256, rate);
+    int refreshed = 0;
+    welch.set_spectrum_handler([&](const Welch<double, 3>&) { ++refreshed; });
+    for (int i = 0; i < 4096; ++i) {
+      double t = i / rate;
+      welch.add(Vector<double>(2 * sin(2 * M_PI * 12.5 * t), 0.5 * sin(2 * M_PI * 30 * t) + 0.1, 0));
+    }
+    // First segment after 256 samples, then every 128
+    CPPUNIT_ASSERT_EQUAL(31, refreshed);
+    CPPUNIT_ASSERT_EQUAL((size_t)31, welch.segments());
+    CPPUNIT_ASSERT_EQUAL((size_t)129, welch.bins());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(12.5, welch.frequency(32), 1E-12);
+
+    size_t peak_x = 0, peak_y = 1;
+    double variance_x = 0, variance_y = 0, variance_z = 0;
+    for (size_t k = 0; k < welch.bins(); ++k) {
+      if (welch.psd(0)[k] > welch.psd(0)[peak_x])
+        peak_x = k;
+      if (k > 0 && welch.psd(1)[k] > welch.psd(1)[peak_y])
+        peak_y = k;
+      variance_x += welch.psd(0)[k] * welch.frequency_resolution();
+      variance_y += welch.psd(1)[k] * welch.frequency_resolution();
+      variance_z += welch.psd(2)[k] * welch.frequency_resolution();
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(12.5, welch.frequency(peak_x), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(30.0, welch.frequency(peak_y), welch.frequency_resolution());
+    // Power of a sine is half its squared amplitude; y also has its mean
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, variance_x, 0.02);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.125 + 0.01, variance_y, 0.005);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, variance_z, 1E-20);
+  }
+  void testOddChannels() {
+    Welch<float, 1> welch(128, 10, 96, Window::Hamming);
+    for (int i = 0; i < 1000; ++i) {
+      welch.add(float(i % 2 ? 1 : -1));
+    }
+    // Step is 32 samples
+    CPPUNIT_ASSERT_EQUAL((size_t)28, welch.segments());
+    size_t peak = 0;
+    for (size_t k = 0; k < welch.bins(); ++k)
+      if (welch.psd(0)[k] > welch.psd(0)[peak])
+        peak = k;
+    CPPUNIT_ASSERT_EQUAL((size_t)64, peak);
+    // No overlap asked for is none: a step of whole segments
+    Welch<float, 1> adjacent(128, 10, 0);
+    for (int i = 0; i < 1000; ++i)
+      adjacent.add(float(i % 2 ? 1 : -1));
+    CPPUNIT_ASSERT_EQUAL((size_t)7, adjacent.segments());
+  }
+public:
+  CPPUNIT_TEST_SUITE(SpectrumTest);
+  CPPUNIT_TEST(testFFT);
+  CPPUNIT_TEST(testSize);
+  CPPUNIT_TEST(testWelch);
+  CPPUNIT_TEST(testOddChannels);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main()
+{
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(SpectrumTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
@@ -0,0 +1,163 @@
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/TestAssert.h>
+#include <cppunit/ui/text/TestRunner.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#include <boost/filesystem.hpp>
+
+#include "../../include/types.h"
+#include "../../include/calibration.h"
+#include "../../include/thermal.h"
+
+
+using namespace mru;
+using namespace std;
+
+boost::filesystem::path app_path;
+
+static Temperature_model<double> test_model() {
+  Temperature_model<double> model(25);
+  for (int i = 0; i < 3; ++i) {
+    model.bias[i][0] = 0.01 * (i + 1);
+    model.bias[i][1] = 0.002;
+    model.bias[i][2] = -0.00002 * (i + 1);
+    model.scale[i][1] = 0.0005;
+  }
+  return model;
+}
+
+class ThermalTest: public CppUnit::TestFixture {
+  void testModel() {
+    Temperature_model<double> model = test_model();
+    CPPUNIT_ASSERT(!model.empty());
+    CPPUNIT_ASSERT(Temperature_model<double>().empty());
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02, model.bias_at(1, 25), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.02 + 0.02 - 0.004, model.bias_at(1, 35), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-0.005, model.scale_at(0, 15), 1E-12);
+  }
+  void testCompensation() {
+    Temperature_model<double> model = test_model();
+    Temperature_compensation<double> compensation(model);
+    for (double t = -10; t < 60; t += 0.37) {
+      Vector<double> corrected = compensation.correct(Vector<double>(1, -1, 0.5), t);
+      double v[3] = { 1, -1, 0.5 };
+      double c[3] = { corrected.x(), corrected.y(), corrected.z() };
+      for (int i = 0; i < 3; ++i) {
+        double expected = (v[i] - model.bias_at(i, t)) * (1 + model.scale_at(i, t));
+        // Interpolation error of the quadratic over half a degree
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, c[i], 2E-5);
+      }
+    }
+    // Clamped outside the table
+    Vector<double> cold = compensation.correct(Vector<double>(0, 0, 0), -50);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-model.bias_at(0, -20) * (1 + model.scale_at(0, -20)), cold.x(), 1E-9);
+    CPPUNIT_ASSERT_THROW(Temperature_compensation<double>(model, 10, 0), Error);
+  }
+  void testFit() {
+    Temperature_model<double> truth = test_model();
+    Bias_temperature_fit<double> fit(2, 50);
+    srand(5);
+    // Warming up from 10 to 50 degrees, rotating every other block
+    const int blocks = 400;
+    for (int b = 0; b < blocks; ++b) {
+      bool moving = b % 2 == 1;
+      for (int i = 0; i < 50; ++i) {
+        double t = 10 + 40.0 * (b * 50 + i) / (blocks * 50);
+        double noise[3];
+        for (auto& n: noise)
+          n = 0.002 * (rand() / double(RAND_MAX) - 0.5);
+        double rate = moving ? 0.3 * sin(i * 0.2) : 0;
+        fit.add(Vector<double>(
+            truth.bias_at(0, t) + rate + noise[0],
+            truth.bias_at(1, t) + noise[1],
+            truth.bias_at(2, t) + noise[2]), t);
+      }
+    }
+    CPPUNIT_ASSERT_EQUAL((size_t)(blocks / 2), fit.observations());
+    Temperature_model<double> model(25);
+    model.scale[0][1] = 0.0005;
+    CPPUNIT_ASSERT(fit.solve(model));
+    for (int i = 0; i < 3; ++i) {
+      for (int k = 0; k <= 2; ++k)
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(truth.bias[i][k], model.bias[i][k], 2E-5);
+      CPPUNIT_ASSERT_EQUAL(0.0, model.bias[i][3]);
+    }
+    // Scale is not touched
+    CPPUNIT_ASSERT_EQUAL(0.0005, model.scale[0][1]);
+    // A different reference temperature can't take the solution
+    Temperature_model<double> other(20);
+    CPPUNIT_ASSERT(!fit.solve(other));
+    // Fitting compensated rates refines a model instead of replacing it
+    Temperature_model<double> rough(25);
+    for (int i = 0; i < 3; ++i)
+      rough.bias[i][0] = truth.bias[i][0] + 0.003;
+    Temperature_compensation<double> compensation(rough);
+    Bias_temperature_fit<double> refit(2, 50);
+    for (int n = 0; n < 10000; ++n) {
+      double t = 10 + 40.0 * n / 10000;
+      refit.add(compensation.correct(Vector<double>(
+          truth.bias_at(0, t), truth.bias_at(1, t), truth.bias_at(2, t)), t), t);
+    }
+    CPPUNIT_ASSERT(refit.solve(rough));
+    for (int i = 0; i < 3; ++i)
+      for (int k = 0; k <= 2; ++k)
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(truth.bias[i][k], rough.bias[i][k], 2E-5);
+  }
+  void testNarrowSpan() {
+    // Only a couple of degrees: just a constant bias
+    Bias_temperature_fit<double> fit(3, 10);
+    for (int i = 0; i < 1000; ++i) {
+      double t = 30 + 2.0 * i / 1000;
+      fit.add(Vector<double>(0.01 + 0.002 * (t - 25), 0, 0), t);
+    }
+    Temperature_model<double> model(25);
+    CPPUNIT_ASSERT(fit.solve(model));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.01 + 0.002 * 6, model.bias[0][0], 1E-3);
+    CPPUNIT_ASSERT_EQUAL(0.0, model.bias[0][1]);
+  }
+  void testSaveLoad() {
+    Temperature_model<float> model(30);
+    model.bias[1][2] = 1.5E-4f;
+    model.scale[2][1] = -3E-4f;
+    save_temperature_model((app_path/"calibration/thermal.ini").string(), "itg3200", model);
+    Temperature_model<float> loaded =
+        load_temperature_model<float>((app_path/"calibration/thermal.ini").string(), "itg3200");
+    CPPUNIT_ASSERT_EQUAL(30.0f, loaded.reference);
+    CPPUNIT_ASSERT_EQUAL(1.5E-4f, loaded.bias[1][2]);
+    CPPUNIT_ASSERT_EQUAL(-3E-4f, loaded.scale[2][1]);
+    CPPUNIT_ASSERT_EQUAL(0.0f, loaded.bias[0][0]);
+    // The calibration in the same section is unaffected
+    Calibration<float> calibration = load_calibration<float>(
+        (app_path/"calibration/thermal.ini").string(), "itg3200");
+    CPPUNIT_ASSERT_EQUAL(1.0f, calibration.x_factor());
+    CPPUNIT_ASSERT(load_temperature_model<float>(
+        (app_path/"calibration/nonexisting.ini").string(), "itg3200").empty());
+  }
+public:
+  virtual void setUp() {
+    boost::filesystem::remove(app_path/"calibration/thermal.ini");
+  }
+  CPPUNIT_TEST_SUITE(ThermalTest);
+  CPPUNIT_TEST(testModel);
+  CPPUNIT_TEST(testCompensation);
+  CPPUNIT_TEST(testFit);
+  CPPUNIT_TEST(testNarrowSpan);
+  CPPUNIT_TEST(testSaveLoad);
+  CPPUNIT_TEST_SUITE_END();
+};
+
+int main(int argc, char* argv[])
+{
+  app_path = argv[0];
+  app_path.remove_filename();
+  CppUnit::TextUi::TestRunner runner;
+  runner.addTest(ThermalTest::suite());
+  if (runner.run())
+    return 0;
+  else
+    return 1;
+}
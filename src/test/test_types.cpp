@@ -6,6 +6,8 @@
 #include <cstdlib>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <type_traits>
 
 #include "../../include/types.h"
 #include "../../include/errors.h"
@@ -95,12 +97,61 @@ class TypesTest: public CppUnit::TestFixture {
     auto rs7 = rs4 - d2r(150.0);
     CPPUNIT_ASSERT_DOUBLES_EQUAL(-170.0, rs7.to_degrees(), 5E-5);
   }
+  void testQuaternion() {
+    UnitQuaternion<double> q(std::cos(M_PI / 4), 0, 0, std::sin(M_PI / 4));
+    Vector<double> v = q.rotate(Vector<double>(1, 0, 0));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(0.0, v.x(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, v.y(), 1E-12);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, q.heading().to_degrees(), 1E-9);
+    UnitQuaternion<double> p(std::cos(M_PI / 12), 0, std::sin(M_PI / 12), 0);
+    UnitQuaternion<double> r(std::cos(M_PI / 8), std::sin(M_PI / 8), 0, 0);
+    UnitQuaternion<double> qpr = q * p * r;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(90.0, qpr.heading().to_degrees(), 1E-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(30.0, qpr.pitch().to_degrees(), 1E-9);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(45.0, qpr.roll().to_degrees(), 1E-9);
+    CPPUNIT_ASSERT_THROW(UnitQuaternion<double>(0, 0, 0, 0), Error);
+  }
+  void testSampleLayout() {
+    typedef Sample<float, Acceleration, Temperature, Rotation, Heading> Sample_type;
+    CPPUNIT_ASSERT(std::is_trivially_copyable<Sample_type>::value);
+    CPPUNIT_ASSERT(std::is_standard_layout<Sample_type>::value);
+    Sample_type sample(Time::from_nanoseconds(42), Vector<float>(1, 2, 3), 20.5f,
+                       UnitQuaternion<float>(0, 0, 0, 1), RotScalar<0, 4, float>(1.5f));
+    // Copies byte for byte and values stay where offset() says
+    Sample_type copy;
+    std::memcpy(&copy, &sample, sizeof(sample));
+    CPPUNIT_ASSERT(copy.time == Time::from_nanoseconds(42));
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0, (get<float, Acceleration>(copy).y()), 1E-6);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(1.5, (get<float, Heading>(copy).get_value()), 1E-6);
+    const char* base = reinterpret_cast<const char*>(&copy);
+    float temperature;
+    std::memcpy(&temperature, base + Sample_type::offset<Temperature>(), sizeof(temperature));
+    CPPUNIT_ASSERT_EQUAL(20.5f, temperature);
+    CPPUNIT_ASSERT(reinterpret_cast<const char*>(&get<float, Rotation>(copy))
+                   == base + Sample_type::offset<Rotation>());
+    static_assert(Sample_type::offset<Acceleration>() >= sizeof(Time), "Values follow the time");
+    // Vectors and quaternions are stored as plain floats, aligned for SIMD loads
+    static_assert(Sample_type::offset<Acceleration>() % 16 == 0, "Aligned vector");
+    static_assert(Sample_type::offset<Rotation>() % 16 == 0, "Aligned quaternion");
+    float acceleration[3], rotation[4];
+    std::memcpy(acceleration, base + Sample_type::offset<Acceleration>(), sizeof(acceleration));
+    std::memcpy(rotation, base + Sample_type::offset<Rotation>(), sizeof(rotation));
+    CPPUNIT_ASSERT_EQUAL(3.0f, acceleration[2]);
+    CPPUNIT_ASSERT_EQUAL(0.0f, rotation[0]);
+    CPPUNIT_ASSERT_EQUAL(1.0f, rotation[3]);
+    // get returns references into the sample
+    get<float, Temperature>(copy) = 21;
+    CPPUNIT_ASSERT_EQUAL(21.0f, (get<float, Temperature>(copy)));
+    CPPUNIT_ASSERT_EQUAL(20.5f, (get<float, Temperature>(sample)));
+  }
 public:
   CPPUNIT_TEST_SUITE(TypesTest);
   CPPUNIT_TEST(testScalar);
   CPPUNIT_TEST(testRotScalarSize);
   CPPUNIT_TEST(testRotScalarSetValue);
   CPPUNIT_TEST(testRotScalarOperators);
+  CPPUNIT_TEST(testQuaternion);
+  CPPUNIT_TEST(testSampleLayout);
   CPPUNIT_TEST_SUITE_END();
 };
 
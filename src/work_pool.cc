@@ -0,0 +1,196 @@
+/**
+ * \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * \brief Implementation of the work stealing pool
+ * \license
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../include/work_pool.h"
+
+namespace mru {
+
+namespace {
+
+// Pool and worker index of the running thread, for submits from tasks
+thread_local const Work_pool* current_pool = nullptr;
+thread_local int current_worker = -1;
+
+}
+
+Work_pool::Work_pool(const int threads):
+    workers_(), threads_(), mutex_(), wake_(), idle_(),
+    queued_(0), pending_(0), quit_(false), next_(0), executed_(0), stolen_(0), error_()
+{
+  int count = threads > 0 ? threads : int(std::thread::hardware_concurrency());
+  if (count <= 0)
+    count = 1;
+  for (int i = 0; i < count; ++i)
+    workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+  for (int i = 0; i < count; ++i)
+    threads_.push_back(std::thread(&Work_pool::run_, this, i));
+}
+
+Work_pool::~Work_pool()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return pending_ == 0; });
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread: threads_)
+    thread.join();
+}
+
+void Work_pool::submit(Task task)
+{
+  int index = current_pool == this ? current_worker : int(next_++ % workers_.size());
+  // Counted first: a worker may take the task as soon as it is in the deque
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+    ++pending_;
+  }
+  {
+    std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+    workers_[index]->tasks.push_back(std::move(task));
+  }
+  wake_.notify_one();
+}
+
+void Work_pool::wait()
+{
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this]() { return pending_ == 0; });
+    std::swap(error, error_);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+bool Work_pool::take_(const int index, Task& task)
+{
+  {
+    Worker& own = *workers_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  const int count = int(workers_.size());
+  for (int i = 1; i < count; ++i) {
+    Worker& other = *workers_[(index + i) % count];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.tasks.empty()) {
+      task = std::move(other.tasks.front());
+      other.tasks.pop_front();
+      ++stolen_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Work_pool::run_(const int index)
+{
+  current_pool = this;
+  current_worker = index;
+  Task task;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return quit_ || queued_ > 0; });
+      if (quit_ && queued_ == 0)
+        return;
+    }
+    // The counted task may not have reached its deque yet: look again
+    if (!take_(index, task)) {
+      std::this_thread::yield();
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --queued_;
+    }
+    try {
+      task();
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+    }
+    task = Task();
+    ++executed_;
+    bool idle;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      idle = --pending_ == 0;
+    }
+    if (idle)
+      idle_.notify_all();
+  }
+}
+
+void Strand::submit(Task task)
+{
+  bool schedule;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    schedule = !scheduled_;
+    scheduled_ = true;
+  }
+  if (schedule)
+    pool_.submit([this]() { drain_(); });
+}
+
+void Strand::drain_()
+{
+  // One task per turn, then back into the pool: a busy strand doesn't
+  // keep a worker from the others
+  Task task;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+  }
+  try {
+    task();
+  }
+  catch (...) {
+    reschedule_();
+    throw;
+  }
+  reschedule_();
+}
+
+void Strand::reschedule_()
+{
+  bool more;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    more = !tasks_.empty();
+    scheduled_ = more;
+  }
+  if (more)
+    pool_.submit([this]() { drain_(); });
+}
+
+}  // namespace mru
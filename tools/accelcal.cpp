@@ -0,0 +1,116 @@
+/* 
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+/** \file
+ * \author Jaap Versteegh <j.r.versteegh@gmail.com>
+ * Accelerometer calibration from recorded multi position data
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include "../include/types.h"
+#include "../include/calibration.h"
+#include "../include/gravity_fit.h"
+#include "../include/errors.h"
+
+
+using namespace mru;
+using namespace std;
+
+/// Raw readings, one per line: "x y z" or "time x y z", comma or white space separated
+vector<Vector<double> > read_recording(const string& filename) {
+  ifstream file(filename);
+  if (!file.good())
+    throw Error("Failed to open recording: " + filename, 0);
+  vector<Vector<double> > result;
+  string line;
+  while (getline(file, line)) {
+    replace(line.begin(), line.end(), ',', ' ');
+    istringstream fields(line);
+    vector<double> values;
+    double value;
+    while (fields >> value)
+      values.push_back(value);
+    if (values.size() == 3)
+      result.push_back(Vector<double>(values[0], values[1], values[2]));
+    else if (values.size() == 4)
+      result.push_back(Vector<double>(values[1], values[2], values[3]));
+  }
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    cout << "Usage: accelcal <recording> [<calibration_file> [<section>]]" << endl;
+    cout << "Hold the accelerometer still in at least nine different orientations" << endl;
+    cout << "while recording raw readings. Set \"ACCELCAL_WINDOW\" to change the" << endl;
+    cout << "number of readings per stationary block (default 50)." << endl;
+    return 1;
+  }
+  try {
+    size_t window = 50;
+    char *window_env = getenv("ACCELCAL_WINDOW");
+    if (window_env != 0) {
+      char* end = 0;
+      long value = strtol(window_env, &end, 10);
+      if (end == window_env || *end != 0 || value <= 0)
+        throw Error(string("ACCELCAL_WINDOW should be a positive number: ") + window_env);
+      window = value;
+    }
+    auto start = chrono::steady_clock::now();
+    vector<Vector<double> > readings = read_recording(argv[1]);
+    vector<Vector<double> > stationary = stationary_readings<double>(readings, window);
+    cout << "Readings: " << readings.size() << ", stationary: " << stationary.size() << endl;
+
+    Gravity_fit<double> fit;
+    Correction<double> correction(1, 0, 1, 0, 1, 0);
+    if (!fit.solve(stationary, correction)) {
+      cerr << "Not enough distinct orientations to calibrate" << endl;
+      return 1;
+    }
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    cout << "Iterations: " << fit.iterations() << ", rms error: " << fit.rms()
+         << " m/s2, time: " << elapsed.count() << " ms" << endl;
+    cout << scientific << setprecision(8);
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j)
+        cout << setw(17) << correction(i, j);
+      cout << endl;
+    }
+
+    if (argc > 2) {
+      string section = argc > 3 ? argv[3] : "bma180";
+      Calibration<double> calibration = load_calibration<double>(string(argv[2]), section);
+      calibration.correction = correction;
+      save_calibration<double>(string(argv[2]), section, calibration);
+      cout << "Saved to section " << section << " of " << argv[2] << endl;
+    }
+    return 0;
+  } catch (const Error& e) {
+    cerr << "=========================" << endl;
+    cerr << e.get_message() << endl;
+    cerr << "=========================" << endl;
+    return 1;
+  }
+}
@@ -23,12 +23,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <thread>
 #include <iomanip>
 #include <cmath>
+#include <memory>
 
 #include <signal.h>
 
 #include "../include/types.h"
 #include "../include/i2cbus.h"
 #include "../include/chips.h"
+#include "../include/ahrs.h"
+#include "../include/ellipsoid.h"
 #include "../include/errors.h"
 
 
@@ -58,7 +61,8 @@ int main(int argc, char* argv[])
   cout << "Press 'CTRL-C' to quit." << endl;
   cout << "Set \"NINEDOF_SAMPLE_RATE\" for other rates than 1Hz." << endl;
   cout << "Set \"NINEDOF_I2C_BUS\" for i2c bus other than 0." << endl;
-  cout << "Time, Compass, Acceleration, Gyro, Gyro Temp." << endl;
+  cout << "Set \"NINEDOF_MAG_CALIBRATE\" to calibrate the compass while running." << endl;
+  cout << "Time, Heading, Pitch, Roll." << endl;
 
   char *i2c_bus = getenv("NINEDOF_I2C_BUS");
   int busno = 0;
@@ -80,6 +84,24 @@ int main(int argc, char* argv[])
     acceleration.initialize(calibration_file);
     gyro.initialize(calibration_file);
 
+    std::unique_ptr<Magnetic_calibrator<HMC5843> > calibrator;
+    if (getenv("NINEDOF_MAG_CALIBRATE") != 0) {
+      calibrator.reset(new Magnetic_calibrator<HMC5843>(compass, calibration_file.string()));
+    }
+
+    Madgwick_AHRS ahrs;
+    compass.set_sample_handler([&](const HMC5843::Sample_type& sample) {
+      ahrs.add_magnetic_flux(sample);
+      if (calibrator)
+        calibrator->add_sample(sample);
+    });
+    acceleration.set_sample_handler([&](const ADXL345::Sample_type& sample) {
+      ahrs.add_acceleration(sample);
+    });
+    gyro.set_sample_handler([&](const ITG3200::Sample_type& sample) {
+      ahrs.add_angular_velocity(sample);
+    });
+
     int wait = 1000;
     char *sample_rate = getenv("NINEDOF_SAMPLE_RATE");
     if (sample_rate != 0) {
@@ -95,15 +117,12 @@ int main(int argc, char* argv[])
       acceleration.poll();
       gyro.poll();
 
-      /*
-      cout << 
-        compass.data().time << " ## " <<
-        compass.data().vector << " ## " <<
-        acceleration.data().vector << " ## " <<
-        gyro.data().vector << " ## " <<
-        setw(8) << gyro.data().value <<
+      cout << fixed << setprecision(1) <<
+        ahrs.data().time << " ## " <<
+        setw(7) << get<DefaultFT, Heading>(ahrs.data()).to_degrees() <<
+        setw(7) << get<DefaultFT, Pitch>(ahrs.data()).to_degrees() <<
+        setw(7) << get<DefaultFT, Roll>(ahrs.data()).to_degrees() <<
         endl;
-        */
     }
 
     compass.finalize();
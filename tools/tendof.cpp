@@ -29,6 +29,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../include/types.h"
 #include "../include/i2cbus.h"
 #include "../include/chips.h"
+#include "../include/resample.h"
 #include "../include/errors.h"
 
 
@@ -36,7 +37,8 @@ using namespace mru;
 using namespace std;
 using namespace std::chrono;
 
-ostream& operator<<(ostream& o, const Vector<double>& v) {
+template<typename FT>
+ostream& operator<<(ostream& o, const Vector<FT>& v) {
   o << fixed << setprecision(3);
   o << setw(8) << v.x();
   o << setw(8) << v.y();
@@ -58,7 +60,7 @@ int main(int argc, char* argv[])
   cout << "Press 'CTRL-C' to quit." << endl;
   cout << "Set \"NINEDOF_SAMPLE_RATE\" for other rates than 1Hz." << endl;
   cout << "Set \"NINEDOF_I2C_BUS\" for i2c bus other than 0." << endl;
-  cout << "Time, Compass, Acceleration, Gyro, Gyro Temp." << endl;
+  cout << "Time, Compass, Acceleration, Gyro, Pressure." << endl;
 
   char *i2c_bus = getenv("NINEDOF_I2C_BUS");
   int busno = 0;
@@ -94,6 +96,23 @@ int main(int argc, char* argv[])
     if (sample_rate != 0) {
       wait = 1000 / atoi(sample_rate);
     }
+    // The chips sample on their own clocks: align them for output
+    typedef Sensor_group<DefaultFT, MagneticFlux, Acceleration, AngularVelocity, Pressure> Group;
+    Group group(std::chrono::milliseconds(wait), std::chrono::milliseconds(2 * wait));
+    group.attach(compass);
+    group.attach(acceleration);
+    group.attach(gyro);
+    group.attach(pressure);
+    group.set_sample_handler([](const Group::Sample_type& sample) {
+      cout <<
+        to_utc(sample.time) << " ## " <<
+        get<DefaultFT, MagneticFlux>(sample) << " ## " <<
+        get<DefaultFT, Acceleration>(sample) << " ## " <<
+        get<DefaultFT, AngularVelocity>(sample) << " ## " <<
+        setw(8) << get<DefaultFT, Pressure>(sample) <<
+        endl;
+    });
+
     system_clock::time_point next_time = high_resolution_clock::now();
 
     while (!quit) {
@@ -104,19 +123,6 @@ int main(int argc, char* argv[])
       acceleration.poll();
       gyro.poll();
       pressure.poll();
-
-      /*
-      cout << 
-        compass.data().time << " ## " <<
-        compass.data().vector << " ## " <<
-        acceleration.data().vector << " ## " <<
-        setw(8) << acceleration.data().value << " ## " <<
-        gyro.data().vector << " ## " <<
-        setw(8) << gyro.data().value << " ## " <<
-        setw(8) << pressure.data().vector[2] << " ## " <<
-        setw(8) << pressure.data().value <<
-        endl;
-        */
     }
 
     compass.finalize();